@@ -42,6 +42,10 @@ int main(void)
 	OFFSET(CPUTHREAD_STACK_BOT_PC, cpu_thread, stack_bot_pc);
 	OFFSET(CPUTHREAD_STACK_BOT_TOK, cpu_thread, stack_bot_tok);
 #endif
+
+	OFFSET(LOCK_NEXT_TICKET, lock, next_ticket);
+	OFFSET(LOCK_NOW_SERVING, lock, now_serving);
+
 	OFFSET(STACK_TYPE,	stack_frame, type);
 	OFFSET(STACK_LOCALS,	stack_frame, locals);
 	OFFSET(STACK_GPR0,	stack_frame, gpr[0]);
@@ -0,0 +1,152 @@
+/* Copyright 2016 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Boot timeline: named begin/end markers recorded into a fixed table
+ * and handed to the OS in the device-tree, see external/boot-profile
+ * for a tool that renders them.
+ */
+#define pr_fmt(fmt) "PROF: " fmt
+#include <skiboot.h>
+#include <cpu.h>
+#include <lock.h>
+#include <device.h>
+#include <timebase.h>
+#include <opal-internal.h>
+#include <boot-profile.h>
+
+struct boot_prof_mark {
+	const char	*name;
+	uint64_t	start;
+	uint64_t	end;
+	uint32_t	pir;
+	uint32_t	arg;
+	uint16_t	depth;
+	uint16_t	parent;
+	uint16_t	flags;
+};
+
+static struct boot_prof_mark marks[BOOT_PROF_MAX_MARKS];
+static unsigned int nr_marks;
+static unsigned int nr_dropped;
+static bool tb_synced;
+static bool exported;
+static struct lock boot_prof_lock = LOCK_UNLOCKED;
+
+int boot_prof_begin(const char *name, uint32_t arg)
+{
+	uint32_t pir = this_cpu()->pir;
+	struct boot_prof_mark *m;
+	int i, idx = -1;
+
+	lock(&boot_prof_lock);
+	if (exported)
+		goto out;
+	if (nr_marks >= BOOT_PROF_MAX_MARKS) {
+		nr_dropped++;
+		goto out;
+	}
+
+	idx = nr_marks++;
+	m = &marks[idx];
+	m->name = name;
+	m->arg = arg;
+	m->pir = pir;
+	m->start = mftb();
+	m->end = 0;
+	m->flags = BOOT_PROF_OPEN | (tb_synced ? 0 : BOOT_PROF_PRESYNC);
+	m->depth = 0;
+	m->parent = BOOT_PROF_NO_PARENT;
+
+	/* The innermost phase still open on this CPU encloses us */
+	for (i = idx - 1; i >= 0; i--) {
+		if (marks[i].pir == pir && (marks[i].flags & BOOT_PROF_OPEN)) {
+			m->depth = marks[i].depth + 1;
+			m->parent = i;
+			break;
+		}
+	}
+ out:
+	unlock(&boot_prof_lock);
+
+	return idx;
+}
+
+void boot_prof_end(int mark)
+{
+	if (mark < 0)
+		return;
+
+	lock(&boot_prof_lock);
+	if (!exported) {
+		marks[mark].end = mftb();
+		marks[mark].flags &= ~BOOT_PROF_OPEN;
+	}
+	unlock(&boot_prof_lock);
+}
+
+void boot_prof_tb_synced(void)
+{
+	lock(&boot_prof_lock);
+	tb_synced = true;
+	unlock(&boot_prof_lock);
+}
+
+void boot_prof_add_dt(void)
+{
+	struct boot_prof_rec *recs;
+	struct boot_prof_mark *m;
+	struct dt_node *np;
+	unsigned int i;
+
+	lock(&boot_prof_lock);
+	if (exported) {
+		unlock(&boot_prof_lock);
+		return;
+	}
+	exported = true;
+	unlock(&boot_prof_lock);
+
+	if (nr_dropped)
+		prlog(PR_WARNING, "%u markers didn't fit\n", nr_dropped);
+
+	recs = zalloc(nr_marks * sizeof(*recs));
+	np = dt_new(opal_node, "boot-profile");
+	if (!recs || !np) {
+		prerror("Can't export boot profile\n");
+		free(recs);
+		return;
+	}
+
+	for (i = 0; i < nr_marks; i++) {
+		m = &marks[i];
+		recs[i].start = cpu_to_be64(m->start);
+		recs[i].end = cpu_to_be64(m->end);
+		recs[i].pir = cpu_to_be32(m->pir);
+		recs[i].arg = cpu_to_be32(m->arg);
+		recs[i].depth = cpu_to_be16(m->depth);
+		recs[i].parent = cpu_to_be16(m->parent);
+		recs[i].flags = cpu_to_be16(m->flags);
+		strncpy(recs[i].name, m->name, BOOT_PROF_NAME_LEN - 1);
+	}
+
+	dt_add_property_string(np, "compatible", "ibm,opal-boot-profile");
+	dt_add_property_cells(np, "timebase-frequency", tb_hz);
+	dt_add_property(np, "entries", recs, nr_marks * sizeof(*recs));
+	free(recs);
+
+	prlog(PR_DEBUG, "%u markers exported\n", nr_marks);
+}
@@ -28,6 +28,7 @@
 #include <affinity.h>
 #include <chip.h>
 #include <timebase.h>
+#include <opal-msg.h>
 #include <ccan/str/str.h>
 #include <ccan/container_of/container_of.h>
 
@@ -59,8 +60,21 @@ struct cpu_job {
 	bool		        no_return;
 };
 
-static struct lock global_job_queue_lock = LOCK_UNLOCKED;
-static struct list_head	global_job_queue;
+struct cpu_job_queue {
+	struct lock		lock;
+	struct list_head	jobs;
+};
+
+/* Jobs not bound to a CPU are queued on the chip of the submitter.
+ * Threads of that chip pick them first, idle threads of other chips
+ * steal them when they have nothing else to do.
+ */
+static struct cpu_job_queue chip_job_queues[MAX_CHIPS];
+
+static struct cpu_job_queue *chip_job_queue(struct cpu_thread *cpu)
+{
+	return &chip_job_queues[cpu->chip_id & (MAX_CHIPS - 1)];
+}
 
 /* attribute const as cpu_stacks is constant. */
 unsigned long __attrconst cpu_stack_bottom(unsigned int pir)
@@ -80,6 +94,35 @@ unsigned long __attrconst cpu_stack_top(unsigned int pir)
 		NORMAL_STACK_SIZE - STACK_TOP_GAP;
 }
 
+/* Wake up a CPU waiting for jobs in cpu_idle_job_wait() */
+static void cpu_kick(struct cpu_thread *cpu)
+{
+	cpu->job_kick = true;
+}
+
+/* Wake up an idle thread, preferably on the given chip, to pick up
+ * a job that isn't bound to any CPU
+ */
+static void cpu_kick_idle(uint32_t chip_id)
+{
+	struct cpu_thread *cpu, *other = NULL;
+
+	/* Order the queueing vs. the idle flags, see cpu_idle_job_wait() */
+	sync();
+	for_each_available_cpu(cpu) {
+		if (cpu == this_cpu() || !cpu->job_idle || cpu->job_kick)
+			continue;
+		if (cpu->chip_id == chip_id) {
+			cpu_kick(cpu);
+			return;
+		}
+		if (!other)
+			other = cpu;
+	}
+	if (other)
+		cpu_kick(other);
+}
+
 struct cpu_job *__cpu_queue_job(struct cpu_thread *cpu,
 				const char *name,
 				void (*func)(void *data), void *data,
@@ -103,23 +146,72 @@ struct cpu_job *__cpu_queue_job(struct cpu_thread *cpu,
 	job->no_return = no_return;
 
 	if (cpu == NULL) {
-		lock(&global_job_queue_lock);
-		list_add_tail(&global_job_queue, &job->link);
-		unlock(&global_job_queue_lock);
+		struct cpu_job_queue *q = chip_job_queue(this_cpu());
+
+		lock(&q->lock);
+		list_add_tail(&q->jobs, &job->link);
+		unlock(&q->lock);
+		cpu_kick_idle(this_cpu()->chip_id);
 	} else if (cpu != this_cpu()) {
 		lock(&cpu->job_lock);
 		list_add_tail(&cpu->job_queue, &job->link);
 		unlock(&cpu->job_lock);
+		cpu_kick(cpu);
 	} else {
 		func(data);
 		job->complete = true;
 	}
 
-	/* XXX Add poking of CPU with interrupt */
-
 	return job;
 }
 
+/* Pop a job that isn't bound to a CPU, from our own chip first */
+static struct cpu_job *cpu_pop_unbound_job(struct cpu_thread *cpu)
+{
+	unsigned int i, chip_id = cpu->chip_id & (MAX_CHIPS - 1);
+	struct cpu_job_queue *q;
+	struct cpu_job *job;
+
+	for (i = 0; i < MAX_CHIPS; i++) {
+		q = &chip_job_queues[(chip_id + i) & (MAX_CHIPS - 1)];
+		if (list_empty(&q->jobs))
+			continue;
+		lock(&q->lock);
+		job = list_pop(&q->jobs, struct cpu_job, link);
+		unlock(&q->lock);
+		if (job)
+			return job;
+	}
+	return NULL;
+}
+
+/* Is there an unbound job on any chip ? Only a hint, no locking */
+static bool cpu_unbound_jobs_pending(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < MAX_CHIPS; i++)
+		if (!list_empty(&chip_job_queues[i].jobs))
+			return true;
+	return false;
+}
+
+static void cpu_run_job(struct cpu_thread *cpu, struct cpu_job *job)
+{
+	void (*func)(void *) = job->func;
+	void *data = job->data;
+	bool no_return = job->no_return;
+
+	prlog(PR_TRACE, "running job %s on %x\n", job->name, cpu->pir);
+	if (no_return)
+		free(job);
+	func(data);
+	if (!no_return) {
+		lwsync();
+		job->complete = true;
+	}
+}
+
 bool cpu_poll_job(struct cpu_job *job)
 {
 	lwsync();
@@ -128,13 +220,22 @@ bool cpu_poll_job(struct cpu_job *job)
 
 void cpu_wait_job(struct cpu_job *job, bool free_it)
 {
-	unsigned long ticks = usecs_to_tb(5);
+	struct cpu_thread *cpu = this_cpu();
+	struct cpu_job *other;
 
 	if (!job)
 		return;
 
 	while(!job->complete) {
-		time_wait(ticks);
+		/* Rather than just spinning, run unbound jobs ourselves,
+		 * which is often what we are waiting for. Not with locks
+		 * held though, as those jobs might need them.
+		 */
+		other = cpu->lock_depth ? NULL : cpu_pop_unbound_job(cpu);
+		if (other)
+			cpu_run_job(cpu, other);
+		else
+			cpu_relax();
 		lwsync();
 	}
 	lwsync();
@@ -156,50 +257,54 @@ void cpu_free_job(struct cpu_job *job)
 void cpu_process_jobs(void)
 {
 	struct cpu_thread *cpu = this_cpu();
-	struct cpu_job *job = NULL;
-	void (*func)(void *);
-	void *data;
+	struct cpu_job *job;
 
 	sync();
-	if (list_empty(&cpu->job_queue) && list_empty(&global_job_queue))
-		return;
-
 	lock(&cpu->job_lock);
 	while (true) {
-		bool no_return;
-
-		if (list_empty(&cpu->job_queue)) {
-			smt_medium();
-			if (list_empty(&global_job_queue))
-				break;
-			lock(&global_job_queue_lock);
-			job = list_pop(&global_job_queue, struct cpu_job, link);
-			unlock(&global_job_queue_lock);
-		} else {
-			smt_medium();
+		smt_medium();
+		if (list_empty(&cpu->job_queue))
+			job = cpu_pop_unbound_job(cpu);
+		else
 			job = list_pop(&cpu->job_queue, struct cpu_job, link);
-		}
 
 		if (!job)
 			break;
 
-		func = job->func;
-		data = job->data;
-		no_return = job->no_return;
 		unlock(&cpu->job_lock);
-		prlog(PR_TRACE, "running job %s on %x\n", job->name, cpu->pir);
-		if (no_return)
-			free(job);
-		func(data);
+		cpu_run_job(cpu, job);
 		lock(&cpu->job_lock);
-		if (!no_return) {
-			lwsync();
-			job->complete = true;
-		}
 	}
 	unlock(&cpu->job_lock);
 }
 
+void cpu_idle_job_wait(void)
+{
+	struct cpu_thread *cpu = this_cpu();
+	struct cpu_job_queue *q = chip_job_queue(cpu);
+
+	/* Advertise we are idle before checking the queues, pairs with
+	 * the sync in cpu_kick_idle() so a job is never left behind.
+	 */
+	cpu->job_idle = true;
+	sync();
+
+	/* A job queued while nobody was idle didn't get anyone kicked,
+	 * so look at all the chips before settling down to watch ours.
+	 * Anything queued from now on kicks us or another idle thread.
+	 */
+	if (!cpu_unbound_jobs_pending()) {
+		smt_very_low();
+		while (!cpu->job_kick && list_empty(&cpu->job_queue) &&
+		       list_empty(&q->jobs))
+			barrier();
+		smt_medium();
+	}
+
+	cpu->job_idle = false;
+	cpu->job_kick = false;
+}
+
 void cpu_process_local_jobs(void)
 {
 	struct cpu_thread *cpu = first_available_cpu();
@@ -446,7 +551,10 @@ void init_boot_cpu(void)
 	init_boot_tracebuf(boot_cpu);
 	assert(this_cpu() == boot_cpu);
 
-	list_head_init(&global_job_queue);
+	for (i = 0; i < MAX_CHIPS; i++) {
+		init_lock(&chip_job_queues[i].lock);
+		list_head_init(&chip_job_queues[i].jobs);
+	}
 }
 
 void init_all_cpus(void)
@@ -698,6 +806,9 @@ static int64_t opal_reinit_cpus(uint64_t flags)
 
 	prerror("OPAL: Trying a CPU re-init with flags: 0x%llx\n", flags);
 
+	/* A kexec'd kernel doesn't know about its predecessor's ring */
+	opal_msg_ring_reset();
+
 	lock(&reinit_lock);
 
 	for (cpu = first_cpu(); cpu; cpu = next_cpu(cpu)) {
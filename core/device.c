@@ -17,6 +17,8 @@
 #include <device.h>
 #include <stdlib.h>
 #include <skiboot.h>
+#include <lock.h>
+#include <processor.h>
 #include <libfdt/libfdt.h>
 #include <libfdt/libfdt_internal.h>
 #include <ccan/str/str.h>
@@ -43,6 +45,212 @@ static void free_name(const char *name)
 		free((char *)name);
 }
 
+/*
+ * Property names are interned: all properties with the same name point
+ * to the same string, so looking one up is a pointer compare once the
+ * name has been resolved. Names found in rodata, which is what nearly
+ * all callers pass, are resolved through a small cache keyed on the
+ * pointer itself. Interned names are never freed, there are only
+ * a few hundred distinct property names.
+ *
+ * The name tables, the cache and the phandle table below are shared
+ * by all nodes of all trees, and any CPU may add a node or a property
+ * while another looks one up elsewhere. Lookups don't take a lock: an
+ * entry is filled in first, then published with a lwsync and a single
+ * pointer store. Only updates take dt_index_lock, and nothing is
+ * allocated with it held if that can be avoided. That doesn't make a
+ * node itself safe to change from several CPUs at once: its properties
+ * and children still need the caller's locking.
+ *
+ * The cache only ever remembers names that were found, and a name
+ * stays interned. Names not found aren't cached: one could be interned
+ * right after we looked. A cache hit is checked against the alias of
+ * the name in the slot. Another CPU may overwrite that at any time,
+ * but only with another copy of the same string, so the worst a race
+ * can do is turn a hit into a miss.
+ */
+#define DT_NAME_HASH_SIZE	256
+#define DT_NAME_CACHE_SIZE	256
+
+struct dt_name {
+	struct dt_name *next;
+	/* Last rodata copy of the name we resolved, for the cache */
+	const char *alias;
+	const char *str;
+	char buf[];
+};
+
+static struct lock dt_index_lock = LOCK_UNLOCKED;
+static struct dt_name *dt_names[DT_NAME_HASH_SIZE];
+static struct dt_name *dt_name_cache[DT_NAME_CACHE_SIZE];
+
+static unsigned int dt_name_hash(const char *name)
+{
+	unsigned int hash = 2166136261u;
+
+	while (*name)
+		hash = (hash ^ (unsigned char)*(name++)) * 16777619u;
+	return hash % DT_NAME_HASH_SIZE;
+}
+
+static unsigned int dt_name_cache_hash(const char *name)
+{
+	return ((unsigned long)name >> 2) % DT_NAME_CACHE_SIZE;
+}
+
+static struct dt_name *__dt_name_lookup(const char *name, unsigned int hash)
+{
+	struct dt_name *n;
+
+	for (n = dt_names[hash]; n; n = n->next)
+		if (strcmp(n->str, name) == 0)
+			return n;
+	return NULL;
+}
+
+/* Return the interned copy of a name found in rodata, NULL if no
+ * property uses it
+ */
+static const char *dt_name_find_rodata(const char *name)
+{
+	unsigned int c = dt_name_cache_hash(name);
+	struct dt_name *n;
+
+	n = dt_name_cache[c];
+	if (n && n->alias == name)
+		return n->str;
+
+	n = __dt_name_lookup(name, dt_name_hash(name));
+	if (!n)
+		return NULL;
+
+	n->alias = name;
+	lwsync();
+	dt_name_cache[c] = n;
+
+	return n->str;
+}
+
+static const char *dt_name_intern(const char *name)
+{
+	unsigned int hash = dt_name_hash(name);
+	struct dt_name *n, *new;
+
+	n = __dt_name_lookup(name, hash);
+	if (n)
+		return n->str;
+
+	if (is_rodata(name)) {
+		new = malloc(sizeof(*new));
+		if (new)
+			new->str = name;
+	} else {
+		new = malloc(sizeof(*new) + strlen(name) + 1);
+		if (new)
+			new->str = strcpy(new->buf, name);
+	}
+	if (!new) {
+		prerror("Failed to allocate copy of name");
+		abort();
+	}
+	new->alias = NULL;
+
+	/* Another CPU may have interned it since we looked */
+	lock(&dt_index_lock);
+	n = __dt_name_lookup(name, hash);
+	if (!n) {
+		new->next = dt_names[hash];
+		lwsync();
+		dt_names[hash] = n = new;
+		new = NULL;
+	}
+	unlock(&dt_index_lock);
+	free(new);
+
+	return n->str;
+}
+
+/*
+ * phandle -> node hash table, maintained as nodes are created, get
+ * their phandle changed or are freed. It is grown as needed.
+ *
+ * The helpers below are called with dt_index_lock held, lookups are
+ * lock free. The bucket count lives in the table, so a lookup sees a
+ * consistent table from a single load. A table that was replaced by a
+ * bigger one is kept until the last node is gone, since a lookup may
+ * still be walking it. A lookup racing with an update may miss, and
+ * then walks the tree instead. Nodes are unlinked with a single store
+ * and their own link is left alone, but a node still mustn't be freed
+ * while another CPU may be looking up a phandle.
+ */
+#define DT_PHANDLE_MIN_BUCKETS	64
+
+struct dt_phandle_table {
+	struct dt_phandle_table *prev;
+	u32 buckets;
+	struct dt_node *heads[];
+};
+
+static struct dt_phandle_table *dt_phandles;
+static u32 dt_phandle_count;
+
+static void dt_phandle_grow(void)
+{
+	struct dt_phandle_table *old = dt_phandles, *table;
+	u32 i, buckets = old ? old->buckets * 2 : DT_PHANDLE_MIN_BUCKETS;
+	struct dt_node *node, *next, **head;
+
+	table = zalloc(sizeof(*table) + buckets * sizeof(table->heads[0]));
+	if (!table) {
+		prerror("Failed to allocate phandle table\n");
+		abort();
+	}
+	table->prev = old;
+	table->buckets = buckets;
+	for (i = 0; old && i < old->buckets; i++) {
+		for (node = old->heads[i]; node; node = next) {
+			next = node->phandle_next;
+			head = &table->heads[node->phandle % buckets];
+			node->phandle_next = *head;
+			*head = node;
+		}
+	}
+	lwsync();
+	dt_phandles = table;
+}
+
+static void dt_phandle_add(struct dt_node *node)
+{
+	struct dt_node **head;
+
+	if (!dt_phandles || dt_phandle_count >= dt_phandles->buckets)
+		dt_phandle_grow();
+	head = &dt_phandles->heads[node->phandle % dt_phandles->buckets];
+	node->phandle_next = *head;
+	lwsync();
+	*head = node;
+	dt_phandle_count++;
+}
+
+static void dt_phandle_del(struct dt_node *node)
+{
+	struct dt_phandle_table *table;
+	struct dt_node **link;
+
+	link = &dt_phandles->heads[node->phandle % dt_phandles->buckets];
+	while (*link != node)
+		link = &(*link)->phandle_next;
+	*link = node->phandle_next;
+
+	/* Nothing is left to look up when the last tree is gone */
+	if (--dt_phandle_count == 0) {
+		while ((table = dt_phandles) != NULL) {
+			dt_phandles = table->prev;
+			free(table);
+		}
+	}
+}
+
 static struct dt_node *new_node(const char *name)
 {
 	struct dt_node *node = malloc(sizeof *node);
@@ -55,8 +263,10 @@ static struct dt_node *new_node(const char *name)
 	node->parent = NULL;
 	list_head_init(&node->properties);
 	list_head_init(&node->children);
-	/* FIXME: locking? */
+	lock(&dt_index_lock);
 	node->phandle = ++last_phandle;
+	dt_phandle_add(node);
+	unlock(&dt_index_lock);
 	return node;
 }
 
@@ -90,6 +300,9 @@ static inline void dt_destroy(struct dt_node *dn)
 	if (!dn)
 		return;
 
+	lock(&dt_index_lock);
+	dt_phandle_del(dn);
+	unlock(&dt_index_lock);
 	free_name(dn->name);
 	free(dn);
 }
@@ -268,8 +481,23 @@ struct dt_node *dt_find_by_name(struct dt_node *root, const char *name)
 
 struct dt_node *dt_find_by_phandle(struct dt_node *root, u32 phandle)
 {
-	struct dt_node *node;
+	struct dt_phandle_table *table = dt_phandles;
+	struct dt_node *node, *n;
+
+	node = table ? table->heads[phandle % table->buckets] : NULL;
+	for (; node; node = node->phandle_next) {
+		if (node->phandle != phandle)
+			continue;
+		for (n = node; n; n = n->parent)
+			if (n == root)
+				return node;
+		break;
+	}
 
+	/*
+	 * Not in that tree, duplicated phandle, or we raced with an
+	 * update: do it the slow way
+	 */
 	dt_for_each_node(root, node)
 		if (node->phandle == phandle)
 			return node;
@@ -292,7 +520,7 @@ static struct dt_property *new_property(struct dt_node *node,
 
 	}
 
-	p->name = take_name(name);
+	p->name = dt_name_intern(name);
 	p->len = size;
 	list_add_tail(&node->properties, &p->list);
 	return p;
@@ -311,9 +539,13 @@ struct dt_property *dt_add_property(struct dt_node *node,
 	if (strcmp(name, "linux,phandle") == 0 ||
 	    strcmp(name, "phandle") == 0) {
 		assert(size == 4);
+		lock(&dt_index_lock);
+		dt_phandle_del(node);
 		node->phandle = *(const u32 *)val;
+		dt_phandle_add(node);
 		if (node->phandle >= last_phandle)
 			last_phandle = node->phandle;
+		unlock(&dt_index_lock);
 		return NULL;
 	}
 
@@ -431,7 +663,6 @@ struct dt_property *__dt_add_property_strings(struct dt_node *node,
 void dt_del_property(struct dt_node *node, struct dt_property *prop)
 {
 	list_del_from(&node->properties, &prop->list);
-	free_name(prop->name);
 	free(prop);
 }
 
@@ -470,12 +701,7 @@ struct dt_node *dt_next(const struct dt_node *root,
 
 struct dt_property *__dt_find_property(struct dt_node *node, const char *name)
 {
-	struct dt_property *i;
-
-	list_for_each(&node->properties, i, list)
-		if (strcmp(i->name, name) == 0)
-			return i;
-	return NULL;
+	return (struct dt_property *)dt_find_property(node, name);
 }
 
 const struct dt_property *dt_find_property(const struct dt_node *node,
@@ -483,8 +709,20 @@ const struct dt_property *dt_find_property(const struct dt_node *node,
 {
 	const struct dt_property *i;
 
+	/* Names built at runtime aren't worth resolving */
+	if (!is_rodata(name)) {
+		list_for_each(&node->properties, i, list)
+			if (strcmp(i->name, name) == 0)
+				return i;
+		return NULL;
+	}
+
+	name = dt_name_find_rodata(name);
+	if (!name)
+		return NULL;
+
 	list_for_each(&node->properties, i, list)
-		if (strcmp(i->name, name) == 0)
+		if (i->name == name)
 			return i;
 	return NULL;
 }
@@ -652,10 +890,8 @@ void dt_free(struct dt_node *node)
 	while ((child = list_top(&node->children, struct dt_node, list)))
 		dt_free(child);
 
-	while ((p = list_pop(&node->properties, struct dt_property, list))) {
-		free_name(p->name);
+	while ((p = list_pop(&node->properties, struct dt_property, list)))
 		free(p);
-	}
 
 	if (node->parent)
 		list_del_from(&node->parent->children, &node->list);
@@ -788,9 +1024,9 @@ struct dt_node *dt_find_compatible_node_on_chip(struct dt_node *root,
 
 	node = prev ? dt_next(root, prev) : root;
 	for (; node; node = dt_next(root, node)) {
-		u32 cid = __dt_get_chip_id(node);
-		if (cid == chip_id &&
-		    dt_node_is_compatible(node, compat))
+		/* Checking the chip ID walks up the tree, do it last */
+		if (dt_node_is_compatible(node, compat) &&
+		    __dt_get_chip_id(node) == chip_id)
 			return node;
 	}
 	return NULL;
@@ -26,32 +26,122 @@
 #include <vpd.h>
 #include <ccan/str/str.h>
 
-static int fdt_error;
 static void *fdt;
 
 #undef DEBUG_FDT
 
-static void __save_err(int err, const char *str)
+/*
+ * The flattened tree is built in two passes over the live tree. The
+ * first one computes the size of the structure block and builds the
+ * strings block, deduplicating names through a hash table. The second
+ * one writes the structure block into an exactly sized buffer.
+ */
+struct fdt_string {
+	const char	*name;
+	uint32_t	off;
+};
+
+static struct fdt_string *fdt_strtab;
+static uint32_t fdt_strtab_size;	/* Slots, power of 2 */
+static uint32_t fdt_strtab_count;
+static uint32_t fdt_strings_len;
+static uint32_t fdt_struct_len;
+static char *fdt_pos;
+
+static uint32_t fdt_string_hash(const char *name)
 {
-#ifdef DEBUG_FDT
-	printf("FDT: rc: %d from \"%s\"\n", err, str);
-#endif
-	if (err && !fdt_error) {
-		prerror("FDT: Error %d from \"%s\"\n", err, str);
-		fdt_error = err;
+	uint32_t hash = 2166136261u;
+
+	while (*name)
+		hash = (hash ^ (unsigned char)*(name++)) * 16777619u;
+	return hash;
+}
+
+static struct fdt_string *fdt_string_slot(struct fdt_string *tab,
+					  uint32_t size, const char *name)
+{
+	uint32_t i = fdt_string_hash(name) & (size - 1);
+
+	/* Live tree property names are interned, try pointers first */
+	while (tab[i].name && tab[i].name != name &&
+	       strcmp(tab[i].name, name) != 0)
+		i = (i + 1) & (size - 1);
+	return &tab[i];
+}
+
+static bool fdt_string_grow(void)
+{
+	uint32_t i, size = fdt_strtab_size ? fdt_strtab_size * 2 : 256;
+	struct fdt_string *tab;
+
+	tab = zalloc(size * sizeof(*tab));
+	if (!tab)
+		return false;
+	for (i = 0; i < fdt_strtab_size; i++)
+		if (fdt_strtab[i].name)
+			*fdt_string_slot(tab, size, fdt_strtab[i].name) =
+				fdt_strtab[i];
+	free(fdt_strtab);
+	fdt_strtab = tab;
+	fdt_strtab_size = size;
+	return true;
+}
+
+static bool fdt_string_add(const char *name)
+{
+	struct fdt_string *str;
+
+	/* Keep the table at most half full */
+	if (fdt_strtab_count * 2 >= fdt_strtab_size && !fdt_string_grow())
+		return false;
+
+	str = fdt_string_slot(fdt_strtab, fdt_strtab_size, name);
+	if (!str->name) {
+		str->name = name;
+		str->off = fdt_strings_len;
+		fdt_strings_len += strlen(name) + 1;
+		fdt_strtab_count++;
 	}
+	return true;
 }
 
-#define save_err(...) __save_err(__VA_ARGS__, #__VA_ARGS__)
+static uint32_t fdt_string_off(const char *name)
+{
+	return fdt_string_slot(fdt_strtab, fdt_strtab_size, name)->off;
+}
+
+static void fdt_put32(uint32_t val)
+{
+	*(uint32_t *)fdt_pos = cpu_to_fdt32(val);
+	fdt_pos += 4;
+}
+
+static void fdt_put_data(const void *data, size_t len)
+{
+	memcpy(fdt_pos, data, len);
+	memset(fdt_pos + len, 0, ALIGN_UP(len, 4) - len);
+	fdt_pos += ALIGN_UP(len, 4);
+}
+
+static void dt_property(const char *name, const void *val, size_t size)
+{
+	fdt_put32(FDT_PROP);
+	fdt_put32(size);
+	fdt_put32(fdt_string_off(name));
+	fdt_put_data(val, size);
+}
 
 static void dt_property_cell(const char *name, u32 cell)
 {
-	save_err(fdt_property_cell(fdt, name, cell));
+	u32 val = cpu_to_fdt32(cell);
+
+	dt_property(name, &val, sizeof(val));
 }
 
 static void dt_begin_node(const char *name, uint32_t phandle)
 {
-	save_err(fdt_begin_node(fdt, name));
+	fdt_put32(FDT_BEGIN_NODE);
+	fdt_put_data(name, strlen(name) + 1);
 
 	/*
 	 * We add both the new style "phandle" and the legacy
@@ -61,14 +151,9 @@ static void dt_begin_node(const char *name, uint32_t phandle)
 	dt_property_cell("phandle", phandle);
 }
 
-static void dt_property(const char *name, const void *val, size_t size)
-{
-	save_err(fdt_property(fdt, name, val, size));
-}
-
 static void dt_end_node(void)
 {
-	save_err(fdt_end_node(fdt));
+	fdt_put32(FDT_END_NODE);
 }
 
 static void dump_fdt(void)
@@ -113,6 +198,32 @@ static void dump_fdt(void)
 #endif
 }
 
+/* Size a node and its children, and add their names to the strings */
+static bool size_dt_node(const struct dt_node *node)
+{
+	const struct dt_node *i;
+	const struct dt_property *p;
+
+	/* Begin node tag and name, phandles, end node tag */
+	fdt_struct_len += 4 + ALIGN_UP(strlen(node->name) + 1, 4);
+	fdt_struct_len += 2 * (sizeof(struct fdt_property) + 4);
+	fdt_struct_len += 4;
+
+	list_for_each(&node->properties, p, list) {
+		if (strstarts(p->name, DT_PRIVATE))
+			continue;
+		fdt_struct_len += sizeof(struct fdt_property) +
+			ALIGN_UP(p->len, 4);
+		if (!fdt_string_add(p->name))
+			return false;
+	}
+
+	list_for_each(&node->children, i, list)
+		if (!size_dt_node(i))
+			return false;
+	return true;
+}
+
 static void flatten_dt_node(const struct dt_node *root)
 {
 	const struct dt_node *i;
@@ -138,70 +249,106 @@ static void flatten_dt_node(const struct dt_node *root)
 	}
 }
 
-static void create_dtb_reservemap(const struct dt_node *root)
+static void create_dtb_reservemap(const struct dt_property *prop)
 {
-	uint64_t base, size;
+	struct fdt_reserve_entry *re = fdt + fdt_off_mem_rsvmap(fdt);
 	const uint64_t *ranges;
-	const struct dt_property *prop;
 	int i;
 
 	/* Duplicate the reserved-ranges property into the fdt reservemap */
-	prop = dt_find_property(root, "reserved-ranges");
 	if (prop) {
 		ranges = (const void *)prop->prop;
 
 		for (i = 0; i < prop->len / (sizeof(uint64_t) * 2); i++) {
-			base = *(ranges++);
-			size = *(ranges++);
-			save_err(fdt_add_reservemap_entry(fdt, base, size));
+			re->address = cpu_to_fdt64(*(ranges++));
+			re->size = cpu_to_fdt64(*(ranges++));
+			re++;
 		}
 	}
 
-	save_err(fdt_finish_reservemap(fdt));
+	/* Terminating entry */
+	re->address = 0;
+	re->size = 0;
+}
+
+static void free_strtab(void)
+{
+	free(fdt_strtab);
+	fdt_strtab = NULL;
+	fdt_strtab_size = fdt_strtab_count = 0;
 }
 
 void *create_dtb(const struct dt_node *root)
 {
-	size_t len = DEVICE_TREE_MAX_SIZE;
-	uint32_t old_last_phandle = last_phandle;
-
-	do {
-		if (fdt)
-			free(fdt);
-		last_phandle = old_last_phandle;
-		fdt_error = 0;
-		fdt = malloc(len);
-		if (!fdt) {
-			prerror("dtb: could not malloc %lu\n", (long)len);
-			return NULL;
-		}
+	const struct dt_property *ranges;
+	uint32_t rsvmap_off, rsvmap_len, struct_off, strings_off, i;
+	size_t len;
+
+	if (fdt)
+		free(fdt);
+	fdt = NULL;
+
+	/* Size everything, the phandle names go in the strings too */
+	fdt_struct_len = 4; /* End tag */
+	fdt_strings_len = 0;
+	if (!fdt_string_add("linux,phandle") || !fdt_string_add("phandle") ||
+	    !size_dt_node(root)) {
+		prerror("dtb: could not allocate strings table\n");
+		free_strtab();
+		return NULL;
+	}
 
-		fdt_create(fdt, len);
+	ranges = dt_find_property(root, "reserved-ranges");
+	rsvmap_off = ALIGN_UP(sizeof(struct fdt_header),
+			      sizeof(struct fdt_reserve_entry));
+	rsvmap_len = sizeof(struct fdt_reserve_entry);
+	if (ranges)
+		rsvmap_len += (ranges->len / (sizeof(uint64_t) * 2)) *
+			sizeof(struct fdt_reserve_entry);
+	struct_off = rsvmap_off + rsvmap_len;
+	strings_off = struct_off + fdt_struct_len;
+	len = strings_off + fdt_strings_len;
+
+	fdt = zalloc(len);
+	if (!fdt) {
+		prerror("dtb: could not malloc %lu\n", (long)len);
+		free_strtab();
+		return NULL;
+	}
 
-		create_dtb_reservemap(root);
+	fdt_set_magic(fdt, FDT_MAGIC);
+	fdt_set_totalsize(fdt, len);
+	fdt_set_off_dt_struct(fdt, struct_off);
+	fdt_set_off_dt_strings(fdt, strings_off);
+	fdt_set_off_mem_rsvmap(fdt, rsvmap_off);
+	fdt_set_version(fdt, FDT_LAST_SUPPORTED_VERSION);
+	fdt_set_last_comp_version(fdt, FDT_FIRST_SUPPORTED_VERSION);
+	fdt_set_size_dt_strings(fdt, fdt_strings_len);
+	fdt_set_size_dt_struct(fdt, fdt_struct_len);
 
-		/* Open root node */
-		dt_begin_node(root->name, root->phandle);
+	create_dtb_reservemap(ranges);
 
-		/* Unflatten our live tree */
-		flatten_dt_node(root);
+	/* Strings block, in the order they were added */
+	for (i = 0; i < fdt_strtab_size; i++)
+		if (fdt_strtab[i].name)
+			strcpy(fdt + strings_off + fdt_strtab[i].off,
+			       fdt_strtab[i].name);
 
-		/* Close root node */
-		dt_end_node();
+	/* Open root node */
+	fdt_pos = fdt + struct_off;
+	dt_begin_node(root->name, root->phandle);
 
-		save_err(fdt_finish(fdt));
+	/* Unflatten our live tree */
+	flatten_dt_node(root);
 
-		if (!fdt_error)
-			break;
+	/* Close root node */
+	dt_end_node();
+	fdt_put32(FDT_END);
 
-		len *= 2;
-	} while (fdt_error == -FDT_ERR_NOSPACE);
+	assert(fdt_pos == fdt + strings_off);
+	free_strtab();
 
 	dump_fdt();
 
-	if (fdt_error) {
-		prerror("dtb: error %s\n", fdt_strerror(fdt_error));
-		return NULL;
-	}
 	return fdt;
 }
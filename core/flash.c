@@ -20,6 +20,8 @@
 #include <opal.h>
 #include <opal-msg.h>
 #include <device.h>
+#include <timebase.h>
+#include <boot-profile.h>
 #include <libflash/libflash.h>
 #include <libflash/libffs.h>
 #include <libflash/blocklevel.h>
@@ -28,7 +30,9 @@
 struct flash {
 	bool			registered;
 	bool			busy;
+	bool			loading;
 	struct blocklevel_device *bl;
+	struct ffs_handle	*ffs;
 	uint32_t		size;
 	uint32_t		block_size;
 };
@@ -40,6 +44,18 @@ static struct flash *system_flash;
 /* Using a single lock as we only have one flash at present. */
 static struct lock flash_lock;
 
+/*
+ * A resource load only takes the lock for one chunk at a time, and
+ * marks the flash as loading for the whole load. Nobody else may use
+ * it meanwhile, just like when the BMC owns it.
+ *
+ * Called with flash_lock held.
+ */
+static bool flash_busy(struct flash *flash)
+{
+	return flash->busy || flash->loading;
+}
+
 /* nvram-on-flash support */
 static struct flash *nvram_flash;
 static u32 nvram_offset, nvram_size;
@@ -51,7 +67,7 @@ bool flash_reserve(void)
 	if (!try_lock(&flash_lock))
 		return false;
 
-	if (!system_flash->busy) {
+	if (!flash_busy(system_flash)) {
 		system_flash->busy = true;
 		rc = true;
 	}
@@ -74,7 +90,7 @@ static int flash_nvram_info(uint32_t *total_size)
 	lock(&flash_lock);
 	if (!nvram_flash) {
 		rc = OPAL_HARDWARE;
-	} else if (nvram_flash->busy) {
+	} else if (flash_busy(nvram_flash)) {
 		rc = OPAL_BUSY;
 	} else {
 		*total_size = nvram_size;
@@ -97,7 +113,7 @@ static int flash_nvram_start_read(void *dst, uint32_t src, uint32_t len)
 		goto out;
 	}
 
-	if (nvram_flash->busy) {
+	if (flash_busy(nvram_flash)) {
 		rc = OPAL_BUSY;
 		goto out;
 	}
@@ -125,7 +141,7 @@ static int flash_nvram_write(uint32_t dst, void *src, uint32_t len)
 	if (!try_lock(&flash_lock))
 		return OPAL_BUSY;
 
-	if (nvram_flash->busy) {
+	if (flash_busy(nvram_flash)) {
 		rc = OPAL_BUSY;
 		goto out;
 	}
@@ -178,6 +194,35 @@ static int flash_nvram_probe(struct flash *flash, struct ffs_handle *ffs)
 
 /* core flash support */
 
+/*
+ * The partition table is parsed once and kept until the flash is
+ * written to or erased through OPAL, which may have changed it.
+ *
+ * Called with flash_lock held.
+ */
+static struct ffs_handle *flash_get_ffs(struct flash *flash)
+{
+	int rc;
+
+	if (flash->ffs)
+		return flash->ffs;
+
+	rc = ffs_init(0, flash->size, flash->bl, &flash->ffs, 0);
+	if (rc) {
+		prerror("FLASH: Can't open ffs handle\n");
+		flash->ffs = NULL;
+	}
+
+	return flash->ffs;
+}
+
+static void flash_invalidate_ffs(struct flash *flash)
+{
+	if (flash->ffs)
+		ffs_close(flash->ffs);
+	flash->ffs = NULL;
+}
+
 static struct dt_node *flash_add_dt_node(struct flash *flash, int id)
 {
 	struct dt_node *flash_node;
@@ -249,7 +294,9 @@ int flash_register(struct blocklevel_device *bl, bool is_system_flash)
 		flash = &flashes[i];
 		flash->registered = true;
 		flash->busy = false;
+		flash->loading = false;
 		flash->bl = bl;
+		flash->ffs = NULL;
 		flash->size = size;
 		flash->block_size = block_size;
 		break;
@@ -273,7 +320,10 @@ int flash_register(struct blocklevel_device *bl, bool is_system_flash)
 	if (is_system_flash)
 		setup_system_flash(flash, node, name, ffs);
 
-	if (ffs)
+	/* Keep the partition table of the system flash for resource loads */
+	if (ffs && flash == system_flash)
+		flash->ffs = ffs;
+	else if (ffs)
 		ffs_close(ffs);
 
 	unlock(&flash_lock);
@@ -301,7 +351,7 @@ static int64_t opal_flash_op(enum flash_op op, uint64_t id, uint64_t offset,
 
 	flash = &flashes[id];
 
-	if (flash->busy) {
+	if (flash_busy(flash)) {
 		rc = OPAL_BUSY;
 		goto err;
 	}
@@ -322,6 +372,7 @@ static int64_t opal_flash_op(enum flash_op op, uint64_t id, uint64_t offset,
 		rc = blocklevel_read(flash->bl, offset, (void *)buf, size);
 		break;
 	case FLASH_OP_WRITE:
+		flash_invalidate_ffs(flash);
 		/*
 		 * Note: blocklevel_write() uses flash_smart_write(), this call used to
 		 * be flash_write()
@@ -329,6 +380,7 @@ static int64_t opal_flash_op(enum flash_op op, uint64_t id, uint64_t offset,
 		rc = blocklevel_write(flash->bl, offset, (void *)buf, size);
 		break;
 	case FLASH_OP_ERASE:
+		flash_invalidate_ffs(flash);
 		rc = blocklevel_erase(flash->bl, offset, size);
 		break;
 	default:
@@ -495,21 +547,154 @@ end:
 	return rc;
 }
 
+struct flash_load_resource_item {
+	enum resource_id id;
+	uint32_t subid;
+	int result;
+	void *buf;
+	size_t *len;
+	struct list_node link;
+};
+
+static struct lock flash_load_resource_lock = LOCK_UNLOCKED;
+
+/*
+ * Resources are read in chunks of this many bytes (without ECC). The
+ * flash lock is only held for one chunk at a time, the flash stays
+ * marked as loading in between. ECC partitions are decoded by a job
+ * on another CPU while the next chunk is read.
+ */
+#define FLASH_LOAD_CHUNK	0x10000
+
+struct flash_ecc_chunk {
+	struct ecc64	*raw;
+	uint8_t		*dst;
+	uint32_t	len;
+	int		rc;
+	struct cpu_job	*job;
+};
+
+static int flash_load_chunk(struct flash *flash, uint32_t pos, void *buf,
+			    uint32_t len)
+{
+	int rc;
+
+	lock(&flash_lock);
+	assert(flash->loading && !flash->busy);
+	rc = blocklevel_read(flash->bl, pos, buf, len);
+	unlock(&flash_lock);
+
+	return rc;
+}
+
+static void flash_ecc_chunk_decode(void *data)
+{
+	struct flash_ecc_chunk *c = data;
+
+	if (memcpy_from_ecc((uint64_t *)c->dst, c->raw, c->len))
+		c->rc = FLASH_ERR_ECC_INVALID;
+	else
+		c->rc = 0;
+}
+
+/* Wait for a chunk to be decoded, which also frees up its raw buffer */
+static int flash_ecc_chunk_wait(struct flash_ecc_chunk *c)
+{
+	if (!c->job)
+		return 0;
+
+	cpu_wait_job(c->job, true);
+	c->job = NULL;
+
+	return c->rc;
+}
+
+static int flash_load_part(struct flash *flash,
+			   struct flash_load_resource_item *r,
+			   uint32_t pos, uint32_t size, bool ecc)
+{
+	struct flash_ecc_chunk chunks[2], *c;
+	uint8_t *buf = r->buf;
+	uint32_t done, len, i, j;
+	int rc = 0, rc2;
+
+	if (!ecc) {
+		for (done = 0; done < size; done += len) {
+			len = MIN(size - done, FLASH_LOAD_CHUNK);
+			rc = flash_load_chunk(flash, pos + done, buf + done, len);
+			if (rc)
+				break;
+		}
+		return rc;
+	}
+
+	/*
+	 * Double buffer the raw data: while chunk N is being decoded out
+	 * of one buffer, chunk N + 1 is read into the other one.
+	 */
+	memset(chunks, 0, sizeof(chunks));
+	for (i = 0; i < 2; i++) {
+		chunks[i].raw = malloc(ecc_buffer_size(FLASH_LOAD_CHUNK));
+		if (!chunks[i].raw) {
+			rc = OPAL_NO_MEM;
+			goto out;
+		}
+	}
+
+	for (i = 0, done = 0; done < size; i++, done += len) {
+		c = &chunks[i & 1];
+		len = MIN(size - done, FLASH_LOAD_CHUNK);
+
+		rc = flash_ecc_chunk_wait(c);
+		if (rc)
+			break;
+
+		rc = flash_load_chunk(flash, pos + ecc_buffer_size(done),
+				      c->raw, ecc_buffer_size(len));
+		if (rc)
+			break;
+
+		c->dst = buf + done;
+		c->len = len;
+		c->job = cpu_queue_job(NULL, "flash_ecc_decode",
+				       flash_ecc_chunk_decode, c);
+		if (!c->job) {
+			flash_ecc_chunk_decode(c);
+			if (c->rc) {
+				rc = c->rc;
+				break;
+			}
+		}
+	}
+
+out:
+	/* Oldest chunk first, so the first error is the one reported */
+	for (j = 0; j < 2; j++) {
+		c = &chunks[(i + j) & 1];
+		rc2 = flash_ecc_chunk_wait(c);
+		if (!rc)
+			rc = rc2;
+		free(c->raw);
+	}
+	return rc;
+}
+
 /*
  * load a resource from FLASH
  * buf and len shouldn't account for ECC even if partition is ECCed.
  */
-static int flash_load_resource(enum resource_id id, uint32_t subid,
-			       void *buf, size_t *len)
+static int flash_load_resource(struct flash_load_resource_item *r)
 {
 	int i, rc, part_num, part_size, part_start, size;
+	enum resource_id id = r->id;
+	uint32_t subid = r->subid;
 	struct ffs_handle *ffs;
 	struct flash *flash;
 	const char *name;
-	bool status, ecc;
+	unsigned long start, ms;
+	bool ecc;
 
 	rc = OPAL_RESOURCE;
-	status = false;
 
 	lock(&flash_lock);
 
@@ -518,7 +703,7 @@ static int flash_load_resource(enum resource_id id, uint32_t subid,
 
 	flash = system_flash;
 
-	if (flash->busy)
+	if (flash_busy(flash))
 		goto out_unlock;
 
 	for (i = 0, name = NULL; i < ARRAY_SIZE(part_name_map); i++) {
@@ -541,22 +726,22 @@ static int flash_load_resource(enum resource_id id, uint32_t subid,
 		goto out_unlock;
 	}
 
-	rc = ffs_init(0, flash->size, flash->bl, &ffs, 0);
-	if (rc) {
-		prerror("FLASH: Can't open ffs handle\n");
+	ffs = flash_get_ffs(flash);
+	if (!ffs) {
+		rc = OPAL_RESOURCE;
 		goto out_unlock;
 	}
 
 	rc = ffs_lookup_part(ffs, name, &part_num);
 	if (rc) {
 		prerror("FLASH: No %s partition\n", name);
-		goto out_free_ffs;
+		goto out_unlock;
 	}
 	rc = ffs_part_info(ffs, part_num, NULL,
 			   &part_start, &part_size, NULL, &ecc);
 	if (rc) {
 		prerror("FLASH: Failed to get %s partition info\n", name);
-		goto out_free_ffs;
+		goto out_unlock;
 	}
 	prlog(PR_DEBUG,"FLASH: %s partition %s ECC\n",
 	      name, ecc  ? "has" : "doesn't have");
@@ -571,7 +756,7 @@ static int flash_load_resource(enum resource_id id, uint32_t subid,
 		rc = flash_find_subpartition(flash->bl, subid, &part_start,
 					     &part_size, &ecc);
 		if (rc)
-			goto out_free_ffs;
+			goto out_unlock;
 	}
 
 	/* Work out what the final size of buffer will be without ECC */
@@ -580,46 +765,47 @@ static int flash_load_resource(enum resource_id id, uint32_t subid,
 		if (ecc_buffer_size_check(part_size)) {
 			prerror("FLASH: %s image invalid size for ECC %d\n",
 				name, part_size);
-			goto out_free_ffs;
+			rc = OPAL_RESOURCE;
+			goto out_unlock;
 		}
 		size = ecc_buffer_size_minus_ecc(part_size);
 	}
 
-	if (size > *len) {
+	if (size > *r->len) {
 		prerror("FLASH: %s image too large (%d > %zd)\n", name,
-			part_size, *len);
-		goto out_free_ffs;
+			part_size, *r->len);
+		rc = OPAL_RESOURCE;
+		goto out_unlock;
 	}
+	flash->loading = true;
+	unlock(&flash_lock);
+
+	start = mftb();
+	rc = flash_load_part(flash, r, part_start, size, ecc);
+
+	lock(&flash_lock);
+	flash->loading = false;
+	unlock(&flash_lock);
 
-	rc = flash_read_corrected(flash->bl, part_start, buf, size, ecc);
 	if (rc) {
 		prerror("FLASH: failed to read %s partition\n", name);
-		goto out_free_ffs;
+		return OPAL_RESOURCE;
 	}
 
-	*len = size;
-	status = true;
+	ms = tb_to_msecs(mftb() - start) ?: 1;
+	prlog(PR_INFO, "FLASH: Loaded %s (0x%x bytes) in %lu ms, %lu KB/s\n",
+	      name, size, ms, (size / 1024) * 1000 / ms);
+
+	*r->len = size;
+	return OPAL_SUCCESS;
 
-out_free_ffs:
-	ffs_close(ffs);
 out_unlock:
 	unlock(&flash_lock);
-	return status ? OPAL_SUCCESS : rc;
+	return rc ? rc : OPAL_RESOURCE;
 }
 
-
-struct flash_load_resource_item {
-	enum resource_id id;
-	uint32_t subid;
-	int result;
-	void *buf;
-	size_t *len;
-	struct list_node link;
-};
-
 static LIST_HEAD(flash_load_resource_queue);
 static LIST_HEAD(flash_loaded_resources);
-static struct lock flash_load_resource_lock = LOCK_UNLOCKED;
 static struct cpu_job *flash_load_job = NULL;
 
 int flash_resource_loaded(enum resource_id id, uint32_t subid)
@@ -655,7 +841,7 @@ int flash_resource_loaded(enum resource_id id, uint32_t subid)
 static void flash_load_resources(void *data __unused)
 {
 	struct flash_load_resource_item *r;
-	int result;
+	int result, mark;
 
 	lock(&flash_load_resource_lock);
 	do {
@@ -670,7 +856,9 @@ static void flash_load_resources(void *data __unused)
 		r->result = OPAL_BUSY;
 		unlock(&flash_load_resource_lock);
 
-		result = flash_load_resource(r->id, r->subid, r->buf, r->len);
+		mark = boot_prof_begin("flash-load", r->id);
+		result = flash_load_resource(r);
+		boot_prof_end(mark);
 
 		lock(&flash_load_resource_lock);
 		r = list_pop(&flash_load_resource_queue,
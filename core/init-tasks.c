@@ -0,0 +1,239 @@
+/* Copyright 2016 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define pr_fmt(fmt) "INIT: " fmt
+#include <skiboot.h>
+#include <cpu.h>
+#include <chip.h>
+#include <timebase.h>
+#include <init-tasks.h>
+#include <boot-profile.h>
+
+struct init_chip_job {
+	struct init_task	*task;
+	struct proc_chip	*chip;
+	struct cpu_job		*job;
+};
+
+static void init_tasks_resolve(struct init_task *tasks, unsigned int count)
+{
+	struct init_task *t;
+	unsigned int i, j, d;
+
+	for (i = 0; i < count; i++) {
+		t = &tasks[i];
+		t->ndeps = 0;
+		t->state = INIT_TASK_WAITING;
+		t->start_tb = t->end_tb = 0;
+
+		/* Only looking backward keeps the graph free of cycles */
+		for (d = 0; t->deps[d]; d++) {
+			for (j = 0; j < i; j++)
+				if (streq(tasks[j].name, t->deps[d]))
+					break;
+			if (j == i)
+				prerror("Task %s depends on unknown or later"
+					" task %s\n", t->name, t->deps[d]);
+			assert(j < i);
+			t->dep_idx[t->ndeps++] = j;
+		}
+	}
+}
+
+static bool init_task_ready(struct init_task *tasks, struct init_task *t)
+{
+	unsigned int d;
+
+	if (t->state != INIT_TASK_WAITING)
+		return false;
+	for (d = 0; d < t->ndeps; d++)
+		if (tasks[t->dep_idx[d]].state != INIT_TASK_DONE)
+			return false;
+	return true;
+}
+
+static void init_chip_job_fn(void *data)
+{
+	struct init_chip_job *cj = data;
+	int mark = boot_prof_begin(cj->task->name, cj->chip->id);
+
+	cj->task->chip_fn(cj->chip);
+	boot_prof_end(mark);
+}
+
+/* Any thread of the chip but ourselves, so the boot CPU stays free */
+static struct cpu_thread *init_chip_cpu(struct proc_chip *chip)
+{
+	struct cpu_thread *c;
+
+	for_each_available_cpu(c) {
+		if (c->chip_id == chip->id && c != this_cpu())
+			return c;
+	}
+	return this_cpu();
+}
+
+static void init_task_start_chips(struct init_task *t)
+{
+	struct init_chip_job *cj;
+	struct proc_chip *chip;
+	unsigned int n = 0;
+	int mark;
+
+	t->state = INIT_TASK_RUNNING;
+	t->start_tb = mftb();
+
+	for_each_chip(chip)
+		n++;
+	t->jobs = zalloc(n * sizeof(*t->jobs));
+	if (!t->jobs) {
+		prerror("Can't dispatch %s, running it in line\n", t->name);
+		for_each_chip(chip) {
+			mark = boot_prof_begin(t->name, chip->id);
+			t->chip_fn(chip);
+			boot_prof_end(mark);
+		}
+		return;
+	}
+
+	for_each_chip(chip) {
+		cj = &t->jobs[t->njobs++];
+		cj->task = t;
+		cj->chip = chip;
+		cj->job = cpu_queue_job(init_chip_cpu(chip), t->name,
+					init_chip_job_fn, cj);
+		if (!cj->job)
+			init_chip_job_fn(cj);
+	}
+}
+
+/* Returns the first chip job of @t still running, if any */
+static struct cpu_job *init_task_pending_job(struct init_task *t)
+{
+	unsigned int i;
+
+	for (i = 0; i < t->njobs; i++)
+		if (t->jobs[i].job && !cpu_poll_job(t->jobs[i].job))
+			return t->jobs[i].job;
+	return NULL;
+}
+
+static bool init_task_reap_chips(struct init_task *t)
+{
+	unsigned int i;
+
+	if (init_task_pending_job(t))
+		return false;
+
+	for (i = 0; i < t->njobs; i++)
+		cpu_free_job(t->jobs[i].job);
+	free(t->jobs);
+	t->jobs = NULL;
+	t->njobs = 0;
+	t->end_tb = mftb();
+	t->state = INIT_TASK_DONE;
+
+	return true;
+}
+
+void init_tasks_run(struct init_task *tasks, unsigned int count)
+{
+	struct init_task *t, *next;
+	struct cpu_job *job;
+	unsigned int i, left = count;
+	uint64_t start = mftb();
+	int mark;
+
+	init_tasks_resolve(tasks, count);
+
+	while (left) {
+		next = NULL;
+		job = NULL;
+
+		/*
+		 * Get chip tasks going as soon as they can, they run in
+		 * the background, and collect those that are done.
+		 */
+		for (i = 0; i < count; i++) {
+			t = &tasks[i];
+			if (t->chip_fn && init_task_ready(tasks, t))
+				init_task_start_chips(t);
+			if (t->state == INIT_TASK_RUNNING) {
+				if (init_task_reap_chips(t))
+					left--;
+				else if (!job)
+					job = init_task_pending_job(t);
+			}
+			if (!next && !t->chip_fn && init_task_ready(tasks, t))
+				next = t;
+		}
+
+		/* Then the first global task in table order that can run */
+		if (next) {
+			next->state = INIT_TASK_RUNNING;
+			next->start_tb = mftb();
+			mark = boot_prof_begin(next->name, 0);
+			if (next->fn)
+				next->fn();
+			boot_prof_end(mark);
+			next->end_tb = mftb();
+			next->state = INIT_TASK_DONE;
+			left--;
+			continue;
+		}
+
+		/* Nothing for the boot CPU until some chip job is done */
+		if (job)
+			cpu_wait_job(job, false);
+	}
+
+	prlog(PR_INFO, "%d tasks done in %lu ms\n", count,
+	      tb_to_msecs(mftb() - start));
+	init_tasks_dump(tasks, count);
+}
+
+void init_tasks_dump(struct init_task *tasks, unsigned int count)
+{
+	struct init_task *t;
+	uint64_t origin = 0;
+	unsigned int i, d;
+	char deps[80];
+	int len;
+
+	for (i = 0; i < count; i++)
+		if (tasks[i].start_tb && (!origin || tasks[i].start_tb < origin))
+			origin = tasks[i].start_tb;
+
+	for (i = 0; i < count; i++) {
+		t = &tasks[i];
+
+		len = 0;
+		deps[0] = 0;
+		for (d = 0; t->deps[d] && len < (int)sizeof(deps); d++)
+			len += snprintf(deps + len, sizeof(deps) - len, "%s%s",
+					d ? " " : "", t->deps[d]);
+
+		if (t->state == INIT_TASK_DONE)
+			prlog(PR_DEBUG, "%-16s %-6s +%5lu ms %5lu ms after: %s\n",
+			      t->name, t->chip_fn ? "chip" : "global",
+			      tb_to_msecs(t->start_tb - origin),
+			      tb_to_msecs(t->end_tb - t->start_tb), deps);
+		else
+			prlog(PR_DEBUG, "%-16s %-6s %19s after: %s\n",
+			      t->name, t->chip_fn ? "chip" : "global", "-",
+			      deps);
+	}
+}
@@ -44,6 +44,8 @@
 #include <timer.h>
 #include <ipmi.h>
 #include <sensor.h>
+#include <init-tasks.h>
+#include <boot-profile.h>
 
 /*
  * Boot semaphore, incremented by each CPU calling in
@@ -390,6 +392,7 @@ void __noreturn load_and_boot_kernel(bool is_reboot)
 	const struct dt_property *memprop;
 	uint64_t mem_top;
 	void *fdt;
+	int mark;
 
 	memprop = dt_find_property(dt_root, DT_PRIVATE "maxmem");
 	if (memprop)
@@ -404,12 +407,14 @@ void __noreturn load_and_boot_kernel(bool is_reboot)
 		platform.exit();
 
 	/* Load kernel LID */
+	mark = boot_prof_begin("kernel-load", 0);
 	if (!load_kernel()) {
 		op_display(OP_FATAL, OP_MOD_INIT, 1);
 		abort();
 	}
 
 	load_initramfs();
+	boot_prof_end(mark);
 
 	ipmi_set_fw_progress_sensor(IPMI_FW_OS_BOOT);
 
@@ -428,7 +433,9 @@ void __noreturn load_and_boot_kernel(bool is_reboot)
 	 * OCC takes few secs to boot.  Call this as late as
 	 * as possible to avoid delay.
 	 */
+	mark = boot_prof_begin("occ-pstates", 0);
 	occ_pstates_init();
+	boot_prof_end(mark);
 
 	/* Set kernel command line argument if specified */
 #ifdef KERNEL_COMMAND_LINE
@@ -437,6 +444,9 @@ void __noreturn load_and_boot_kernel(bool is_reboot)
 
 	op_display(OP_LOG, OP_MOD_INIT, 0x000B);
 
+	/* Last chance for the boot profile to make it to the OS */
+	boot_prof_add_dt();
+
 	/* Create the device tree blob to boot OS. */
 	fdt = create_dtb(dt_root);
 	if (!fdt) {
@@ -453,9 +463,14 @@ void __noreturn load_and_boot_kernel(bool is_reboot)
 	/* Clear SRCs on the op-panel when Linux starts */
 	op_panel_clear_src();
 
+	/* The OS has to take the message ring itself, we may be rebooting */
+	opal_msg_ring_reset();
+
 	cpu_give_self_os();
 
 	mem_dump_free();
+	malloc_dump_cache_stats();
+	xscom_dump_stats();
 
 	printf("INIT: Starting kernel at 0x%llx, fdt at %p (size 0x%x)\n",
 	       kernel_entry, fdt, fdt_totalsize(fdt));
@@ -553,8 +568,102 @@ static void do_ctors(void)
 		(*call)();
 }
 
+static void init_chiptod(void)
+{
+	chiptod_init();
+	boot_prof_tb_synced();
+}
+
+static void init_platform(void)
+{
+	/*
+	 * We have initialized the basic HW, we can now call into the
+	 * platform to perform subsequent inits, such as establishing
+	 * communication with the FSP or starting IPMI.
+	 */
+	if (platform.init)
+		platform.init();
+}
+
+static void init_dummy_console(void)
+{
+	/* Setup dummy console nodes if it's enabled */
+	if (dummy_console_enabled())
+		dummy_console_add_nodes();
+}
+
+static void init_nvram(void)
+{
+	op_display(OP_LOG, OP_MOD_INIT, 0x0002);
+
+	/* Read in NVRAM and set it up */
+	nvram_init();
+}
+
+static void init_preload_capp(void)
+{
+	phb3_preload_capp_ucode();
+}
+
+static void init_preload_kernel(void)
+{
+	start_preload_kernel();
+}
+
+static void init_probe_io(void)
+{
+	/* Probe IO hubs */
+	probe_p5ioc2();
+	probe_p7ioc();
+
+	/* Probe PHB3 on P8 */
+	probe_phb3();
+}
+
+static void init_pci(void)
+{
+	pci_init_slots();
+	ipmi_set_fw_progress_sensor(IPMI_FW_PCI_INIT);
+}
+
+/*
+ * What runs once the secondaries are called in. Global tasks still go
+ * one at a time on the boot CPU in this order, unless one waits for a
+ * chip task, and chip tasks overlap with whatever doesn't need them.
+ */
+static struct init_task boot_tasks[] = {
+	/*
+	 * Sycnhronize time bases. This resets all the TB values to a
+	 * small value (so they appear to go backward at this point), and
+	 * synchronize all core timebases to the global ChipTOD network
+	 */
+	INIT_TASK("chiptod", init_chiptod),
+	INIT_TASK("i2c", p8_i2c_init, "chiptod"),
+	/* Register routine to dispatch and read sensors */
+	INIT_TASK("sensors", sensor_init, "chiptod"),
+	INIT_TASK("platform", init_platform, "i2c", "sensors"),
+	INIT_TASK("dummy-console", init_dummy_console, "platform"),
+	/* Init SLW related stuff, including fastsleep */
+	INIT_CHIP_TASK("slw-chip", slw_init_chip, "chiptod", "platform"),
+	INIT_TASK("slw", slw_init, "slw-chip", "platform"),
+	INIT_TASK("nvram", init_nvram, "platform"),
+	INIT_TASK("preload-vpd", phb3_preload_vpd, "platform"),
+	INIT_TASK("preload-capp", init_preload_capp, "platform"),
+	INIT_TASK("preload-kernel", init_preload_kernel, "nvram"),
+	INIT_TASK("nx", nx_init, "chiptod"),
+	/* Initialize the opal messaging */
+	INIT_TASK("opal-msg", opal_init_msg),
+	INIT_TASK("probe-io", init_probe_io, "nvram", "preload-vpd",
+		  "preload-capp", "opal-msg"),
+	INIT_TASK("pci", init_pci, "probe-io"),
+	/* Add OPAL timer related properties */
+	INIT_TASK("timers", late_init_timers, "slw", "pci"),
+};
+
 void __noreturn main_cpu_entry(const void *fdt, u32 master_cpu)
 {
+	int mark;
+
 	/*
 	 * WARNING: At this point. the timebases have
 	 * *not* been synchronized yet. Do not use any timebase
@@ -611,6 +720,7 @@ void __noreturn main_cpu_entry(const void *fdt, u32 master_cpu)
 	 * Hack alert: When entering via the OPAL entry point, fdt
 	 * is set to -1, we record that and pass it to parse_hdat
 	 */
+	mark = boot_prof_begin("device-tree", 0);
 	if (fdt == (void *)-1ul)
 		parse_hdat(true, master_cpu);
 	else if (fdt == NULL)
@@ -618,6 +728,7 @@ void __noreturn main_cpu_entry(const void *fdt, u32 master_cpu)
 	else {
 		dt_expand(fdt);
 	}
+	boot_prof_end(mark);
 
 	/*
 	 * From there, we follow a fairly strict initialization order.
@@ -631,11 +742,13 @@ void __noreturn main_cpu_entry(const void *fdt, u32 master_cpu)
 	 * We also initialize the FSI master at that point in case we need
 	 * to access chips via that path early on.
 	 */
+	mark = boot_prof_begin("chips", 0);
 	init_chips();
 	if (chip_quirk(QUIRK_MAMBO_CALLOUTS))
 		enable_mambo_console();
 	xscom_init();
 	mfsi_init();
+	boot_prof_end(mark);
 
 	/*
 	 * Put various bits & pieces in device-tree that might not
@@ -666,6 +779,7 @@ void __noreturn main_cpu_entry(const void *fdt, u32 master_cpu)
 
 	/* Add the /opal node to the device-tree */
 	add_opal_node();
+	lock_add_dt_props();
 
 	/*
 	 * We probe the platform now. This means the platform probe gets
@@ -673,7 +787,9 @@ void __noreturn main_cpu_entry(const void *fdt, u32 master_cpu)
 	 *
 	 * Note: Timebases still not synchronized.
 	 */
+	mark = boot_prof_begin("platform-probe", 0);
 	probe_platform();
+	boot_prof_end(mark);
 
 	/* Initialize the rest of the cpu thread structs */
 	init_all_cpus();
@@ -681,6 +797,9 @@ void __noreturn main_cpu_entry(const void *fdt, u32 master_cpu)
 	/* Allocate our split trace buffers now. Depends add_opal_node() */
 	init_trace_buffers();
 
+	/* Per-CPU small allocation caches, before secondaries call in */
+	init_malloc_caches();
+
 	/* Get the ICPs and make sure they are in a sane state */
 	init_interrupts();
 
@@ -691,65 +810,12 @@ void __noreturn main_cpu_entry(const void *fdt, u32 master_cpu)
 	psi_init();
 
 	/* Call in secondary CPUs */
+	mark = boot_prof_begin("cpu-bringup", 0);
 	cpu_bringup();
+	boot_prof_end(mark);
 
-	/*
-	 * Sycnhronize time bases. Thi resets all the TB values to a small
-	 * value (so they appear to go backward at this point), and synchronize
-	 * all core timebases to the global ChipTOD network
-	 */
-	chiptod_init();
-
-	/* Initialize i2c */
-	p8_i2c_init();
-
-	/* Register routine to dispatch and read sensors */
-	sensor_init();
-
-	/*
-	 * We have initialized the basic HW, we can now call into the
-	 * platform to perform subsequent inits, such as establishing
-	 * communication with the FSP or starting IPMI.
-	 */
-	if (platform.init)
-		platform.init();
-
-	/* Setup dummy console nodes if it's enabled */
-	if (dummy_console_enabled())
-		dummy_console_add_nodes();
-
-	/* Init SLW related stuff, including fastsleep */
-	slw_init();
-
-	op_display(OP_LOG, OP_MOD_INIT, 0x0002);
-
-	/* Read in NVRAM and set it up */
-	nvram_init();
-
-	phb3_preload_vpd();
-	phb3_preload_capp_ucode();
-	start_preload_kernel();
-
-	/* NX init */
-	nx_init();
-
-	/* Initialize the opal messaging */
-	opal_init_msg();
-
-	/* Probe IO hubs */
-	probe_p5ioc2();
-	probe_p7ioc();
-
-	/* Probe PHB3 on P8 */
-	probe_phb3();
-
-	/* Initialize PCI */
-	pci_init_slots();
-
-	/* Add OPAL timer related properties */
-	late_init_timers();
-
-	ipmi_set_fw_progress_sensor(IPMI_FW_PCI_INIT);
+	/* Everything else up to the final DT fixups */
+	init_tasks_run(boot_tasks, ARRAY_SIZE(boot_tasks));
 
 	/*
 	 * These last few things must be done as late as possible
@@ -784,22 +850,11 @@ void __noreturn __secondary_cpu_entry(void)
 
 	/* Wait for work to do */
 	while(true) {
-		int i;
-
 		/* Process pending jobs on this processor */
 		cpu_process_jobs();
 
-		/* Relax a bit to give the simulator some breathing space */
-		i = 1000;
-		smt_very_low();
-		asm volatile("mtctr %0;\n"
-			     "1: nop; nop; nop; nop;\n"
-			     "   nop; nop; nop; nop;\n"
-			     "   nop; nop; nop; nop;\n"
-			     "   nop; nop; nop; nop;\n"
-			     "   bdnz 1b"
-			     : : "r" (i) : "memory", "ctr");
-		smt_medium();
+		/* Sleep at low priority until somebody queues a job */
+		cpu_idle_job_wait();
 	}
 }
 
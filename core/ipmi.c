@@ -43,6 +43,24 @@ void ipmi_free_msg(struct ipmi_msg *msg)
 	msg->backend->free_msg(msg);
 }
 
+static enum ipmi_msg_prio ipmi_code_prio(uint32_t code)
+{
+	switch (code) {
+	case IPMI_RESET_WDT:
+	case IPMI_SET_WDT:
+	case IPMI_GET_MESSAGE_FLAGS:
+	case IPMI_READ_EVENT:
+	case IPMI_PNOR_ACCESS_STATUS:
+		return IPMI_PRIO_HIGH;
+	case IPMI_RESERVE_SEL:
+	case IPMI_PARTIAL_ADD_ESEL:
+	case IPMI_WRITE_FRU:
+		return IPMI_PRIO_BULK;
+	default:
+		return IPMI_PRIO_NORMAL;
+	}
+}
+
 void ipmi_init_msg(struct ipmi_msg *msg, int interface,
 		   uint32_t code, void (*complete)(struct ipmi_msg *),
 		   void *user_data, size_t req_size, size_t resp_size)
@@ -53,6 +71,7 @@ void ipmi_init_msg(struct ipmi_msg *msg, int interface,
 	msg->backend = ipmi_backend;
 	msg->cmd = IPMI_CMD(code);
 	msg->netfn = IPMI_NETFN(code) << 2;
+	msg->prio = ipmi_code_prio(code);
 	msg->req_size = req_size;
 	msg->resp_size = resp_size;
 	msg->complete = complete;
@@ -20,6 +20,9 @@
 #include <processor.h>
 #include <cpu.h>
 #include <console.h>
+#include <timebase.h>
+#include <device.h>
+#include <opal.h>
 
 /* Set to bust locks. Note, this is initialized to true because our
  * lock debugging code is not going to work until we have the per
@@ -66,6 +69,70 @@ static inline void lock_check(struct lock *l) { };
 static inline void unlock_check(struct lock *l) { };
 #endif /* DEBUG_LOCKS */
 
+#ifdef LOCK_STATS
+
+#define LOCK_STATS_MAX	256
+
+static struct lock_stats lock_stats[LOCK_STATS_MAX];
+static uint32_t lock_stats_next;
+
+/* Called with the lock held, so the entry is ours to update. The
+ * last entry is shared by all the locks that didn't get one of their
+ * own, its counters are thus only approximate.
+ */
+static void lock_stats_acquired(struct lock *l, unsigned long spins,
+				void *caller)
+{
+	struct lock_stats *s = l->stats;
+
+	if (!s) {
+		uint32_t i = __take_ticket(&lock_stats_next);
+
+		if (i < LOCK_STATS_MAX - 1) {
+			s = &lock_stats[i];
+			s->lock = (uint64_t)l;
+			s->caller = (uint64_t)caller;
+		} else
+			s = &lock_stats[LOCK_STATS_MAX - 1];
+		l->stats = s;
+	}
+	s->acquisitions++;
+	if (spins) {
+		s->contended++;
+		s->spins += spins;
+	}
+	s->acquired_tb = mftb();
+}
+
+static void lock_stats_released(struct lock *l)
+{
+	struct lock_stats *s = l->stats;
+	uint64_t hold;
+
+	if (!s)
+		return;
+	hold = mftb() - s->acquired_tb;
+	if (hold > s->max_hold)
+		s->max_hold = hold;
+}
+
+void lock_add_dt_props(void)
+{
+	uint64_t addr = (uint64_t)lock_stats;
+
+	dt_add_property_cells(opal_node, "ibm,opal-lock-stats",
+			      hi32(addr), lo32(addr), LOCK_STATS_MAX,
+			      sizeof(struct lock_stats));
+}
+
+#else
+static inline void lock_stats_acquired(struct lock *l __unused,
+				       unsigned long spins __unused,
+				       void *caller __unused) { };
+static inline void lock_stats_released(struct lock *l __unused) { };
+void lock_add_dt_props(void) { }
+#endif /* LOCK_STATS */
+
 bool lock_held_by_me(struct lock *l)
 {
 	uint64_t pir64 = this_cpu()->pir;
@@ -73,12 +140,23 @@ bool lock_held_by_me(struct lock *l)
 	return l->lock_val == ((pir64 << 32) | 1);
 }
 
+static void lock_acquired(struct lock *l, unsigned long spins,
+			  void *caller)
+{
+	struct cpu_thread *cpu = this_cpu();
+	uint64_t pir64 = cpu->pir;
+
+	l->lock_val = (pir64 << 32) | 1;
+	if (l->in_con_path)
+		cpu->con_suspend++;
+	cpu->lock_depth++;
+	lock_stats_acquired(l, spins, caller);
+}
+
 bool try_lock(struct lock *l)
 {
 	if (__try_lock(l)) {
-		if (l->in_con_path)
-			this_cpu()->con_suspend++;
-		this_cpu()->lock_depth++;
+		lock_acquired(l, 0, __builtin_return_address(0));
 		return true;
 	}
 	return false;
@@ -86,15 +164,25 @@ bool try_lock(struct lock *l)
 
 void lock(struct lock *l)
 {
+	unsigned long spins = 0;
+	uint32_t ticket;
+
 	if (bust_locks)
 		return;
 
 	lock_check(l);
-	for (;;) {
-		if (try_lock(l))
-			break;
+
+	/* Waiters are served in the order they took their ticket, so a
+	 * thread can't be starved by its siblings repeatedly winning.
+	 */
+	ticket = __take_ticket(&l->next_ticket);
+	while (*(volatile uint32_t *)&l->now_serving != ticket) {
+		spins++;
 		cpu_relax();
 	}
+	sync();
+
+	lock_acquired(l, spins, __builtin_return_address(0));
 }
 
 void unlock(struct lock *l)
@@ -105,11 +193,16 @@ void unlock(struct lock *l)
 		return;
 
 	unlock_check(l);
+	lock_stats_released(l);
 
 	lwsync();
-	this_cpu()->lock_depth--;
+	cpu->lock_depth--;
 	l->lock_val = 0;
 
+	/* The next owner must not see our lock_val store after its own */
+	lwsync();
+	l->now_serving++;
+
 	if (l->in_con_path) {
 		cpu->con_suspend--;
 		if (cpu->con_suspend == 0 && cpu->con_need_flush)
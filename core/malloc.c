@@ -21,27 +21,174 @@
 
 #define DEFAULT_ALIGN __alignof__(long)
 
+/*
+ * Per-CPU magazines of small heap blocks. malloc() of up to
+ * MALLOC_CACHE_MAX bytes is rounded up to a multiple of
+ * MALLOC_CACHE_GRAIN and served from the calling CPU's magazine for
+ * that size, without taking the heap lock. free() of a block of one of
+ * those sizes puts it back in the calling CPU's magazine. Empty
+ * magazines are refilled, and full ones drained, MALLOC_CACHE_BATCH
+ * blocks at a time under a single lock hold.
+ *
+ * Cached blocks stay allocated as far as the heap is concerned.
+ */
+#define MALLOC_CACHE_GRAIN	32
+#define MALLOC_CACHE_MAX	256
+#define MALLOC_CACHE_CLASSES	(MALLOC_CACHE_MAX / MALLOC_CACHE_GRAIN)
+#define MALLOC_CACHE_DEPTH	8
+#define MALLOC_CACHE_BATCH	(MALLOC_CACHE_DEPTH / 2)
+
+struct malloc_magazine {
+	unsigned int		count;
+	void			*objs[MALLOC_CACHE_DEPTH];
+};
+
+struct malloc_cache {
+	struct malloc_magazine	mags[MALLOC_CACHE_CLASSES];
+	/* Only ever updated by the owning CPU */
+	unsigned long		hits;
+	unsigned long		misses;
+	unsigned long		frees;
+	unsigned long		flushes;
+};
+
+/* Number of times we took the heap lock, protected by that lock */
+static unsigned long heap_lock_count;
+
+#ifdef __SKIBOOT__
+#include <cpu.h>
+#define cpu_malloc_cache()	(this_cpu()->malloc_cache)
+#else
+/* Host unit tests have no cpu_thread: they can point this at a cache */
+static struct malloc_cache *test_malloc_cache;
+#define cpu_malloc_cache()	(test_malloc_cache)
+#endif
+
+static void heap_lock(void)
+{
+	lock(&skiboot_heap.free_list_lock);
+	heap_lock_count++;
+}
+
+static void heap_unlock(void)
+{
+	unlock(&skiboot_heap.free_list_lock);
+}
+
+static void *malloc_cache_get(struct malloc_cache *c, size_t bytes,
+			      const char *location)
+{
+	unsigned int cls = bytes ? (bytes - 1) / MALLOC_CACHE_GRAIN : 0;
+	struct malloc_magazine *mag = &c->mags[cls];
+	size_t size = (cls + 1) * MALLOC_CACHE_GRAIN;
+	void *p;
+
+	if (mag->count) {
+		c->hits++;
+		p = mag->objs[--mag->count];
+		mem_set_location(p, location);
+		return p;
+	}
+
+	/* Refill half a magazine, plus the one we hand out */
+	c->misses++;
+	heap_lock();
+	p = mem_alloc(&skiboot_heap, size, DEFAULT_ALIGN, location);
+	while (p && mag->count < MALLOC_CACHE_BATCH) {
+		void *obj = mem_alloc(&skiboot_heap, size, DEFAULT_ALIGN,
+				      location);
+		if (!obj)
+			break;
+		mag->objs[mag->count++] = obj;
+	}
+	heap_unlock();
+
+	return p;
+}
+
+static bool malloc_cache_put(struct malloc_cache *c, void *p,
+			     const char *location)
+{
+	struct malloc_magazine *mag;
+	unsigned int i, cls;
+	bool cached = false;
+	size_t size;
+
+	/* Let mem_free() complain about anything that isn't ours */
+	if ((unsigned long)p < skiboot_heap.start ||
+	    (unsigned long)p >= skiboot_heap.start + skiboot_heap.len)
+		return false;
+
+	/* Already back in the heap, the size would be garbage */
+	mem_check_free(&skiboot_heap, p, false, location);
+
+	/* A block can serve any class no bigger than itself */
+	size = mem_allocated_size(p);
+	if (size < MALLOC_CACHE_GRAIN ||
+	    size >= MALLOC_CACHE_MAX + MALLOC_CACHE_GRAIN)
+		return false;
+	cls = size / MALLOC_CACHE_GRAIN - 1;
+	mag = &c->mags[cls];
+
+	/*
+	 * Cached blocks look allocated to the heap, so a second free
+	 * would hand the same block out twice. Only this CPU's magazine
+	 * is checked, that's where a double free usually lands.
+	 */
+	for (i = 0; i < mag->count; i++)
+		cached |= mag->objs[i] == p;
+	mem_check_free(&skiboot_heap, p, cached, location);
+
+	c->frees++;
+	if (mag->count == MALLOC_CACHE_DEPTH) {
+		/* Give the oldest half back to the heap */
+		c->flushes++;
+		heap_lock();
+		for (i = 0; i < MALLOC_CACHE_BATCH; i++)
+			mem_free(&skiboot_heap, mag->objs[i], location);
+		heap_unlock();
+		memmove(mag->objs, mag->objs + MALLOC_CACHE_BATCH,
+			(MALLOC_CACHE_DEPTH - MALLOC_CACHE_BATCH) *
+			sizeof(void *));
+		mag->count -= MALLOC_CACHE_BATCH;
+	}
+
+	mem_set_location(p, location);
+	mag->objs[mag->count++] = p;
+	return true;
+}
+
 void *__memalign(size_t blocksize, size_t bytes, const char *location)
 {
 	void *p;
 
-	lock(&skiboot_heap.free_list_lock);
+	heap_lock();
 	p = mem_alloc(&skiboot_heap, bytes, blocksize, location);
-	unlock(&skiboot_heap.free_list_lock);
+	heap_unlock();
 
 	return p;
 }
 
 void *__malloc(size_t bytes, const char *location)
 {
+	struct malloc_cache *c = cpu_malloc_cache();
+
+	if (c && bytes <= MALLOC_CACHE_MAX)
+		return malloc_cache_get(c, bytes, location);
+
 	return __memalign(DEFAULT_ALIGN, bytes, location);
 }
 
 void __free(void *p, const char *location)
 {
-	lock(&skiboot_heap.free_list_lock);
+	struct malloc_cache *c = cpu_malloc_cache();
+
+	if (c && p && malloc_cache_put(c, p, location))
+		return;
+
+	heap_lock();
 	mem_free(&skiboot_heap, p, location);
-	unlock(&skiboot_heap.free_list_lock);
+	heap_unlock();
 }
 
 void *__realloc(void *ptr, size_t size, const char *location)
@@ -56,7 +203,7 @@ void *__realloc(void *ptr, size_t size, const char *location)
 	if (!ptr)
 		return __malloc(size, location);
 
-	lock(&skiboot_heap.free_list_lock);
+	heap_lock();
 	if (mem_resize(&skiboot_heap, ptr, size, location)) {
 		newptr = ptr;
 	} else {
@@ -70,7 +217,7 @@ void *__realloc(void *ptr, size_t size, const char *location)
 			mem_free(&skiboot_heap, ptr, location);
 		}
 	}
-	unlock(&skiboot_heap.free_list_lock);
+	heap_unlock();
 	return newptr;
 }
 
@@ -82,3 +229,51 @@ void *__zalloc(size_t bytes, const char *location)
 		memset(p, 0, bytes);
 	return p;
 }
+
+#ifdef __SKIBOOT__
+/* Called before the secondaries are called in, see main_cpu_entry() */
+void init_malloc_caches(void)
+{
+	struct cpu_thread *t;
+
+	for_each_cpu(t) {
+		t->malloc_cache = zalloc(sizeof(struct malloc_cache));
+		if (!t->malloc_cache)
+			prerror("MALLOC: cpu 0x%x cache allocation failed\n",
+				t->pir);
+	}
+}
+
+void malloc_dump_cache_stats(void)
+{
+	unsigned long hits = 0, misses = 0, frees = 0, flushes = 0;
+	unsigned long cached = 0;
+	struct malloc_cache *c;
+	struct cpu_thread *t;
+	unsigned int i;
+
+	for_each_cpu(t) {
+		c = t->malloc_cache;
+		if (!c)
+			continue;
+		if (c->hits + c->misses)
+			prlog(PR_DEBUG, "MALLOC: cpu 0x%x: %lu/%lu cache hits,"
+			      " %lu frees, %lu flushes\n", t->pir, c->hits,
+			      c->hits + c->misses, c->frees, c->flushes);
+		hits += c->hits;
+		misses += c->misses;
+		frees += c->frees;
+		flushes += c->flushes;
+		for (i = 0; i < MALLOC_CACHE_CLASSES; i++)
+			cached += c->mags[i].count *
+				(i + 1) * MALLOC_CACHE_GRAIN;
+	}
+
+	printf("MALLOC: %lu/%lu small allocs hit the cpu caches (%lu%%),"
+	       " %lu frees, %lu flushes, %lu bytes cached\n",
+	       hits, hits + misses,
+	       (hits + misses) ? hits * 100 / (hits + misses) : 0,
+	       frees, flushes, cached);
+	printf("MALLOC: heap lock taken %lu times\n", heap_lock_count);
+}
+#endif
@@ -129,17 +129,79 @@ static struct alloc_hdr *next_hdr(const struct mem_region *region,
 	return next;
 }
 
+/*
+ * Free blocks are binned by size, so allocation usually looks at one
+ * or two bins instead of walking every free block. Blocks under
+ * 2 * FREE_BIN_SUBS longs get a bin per size, then each power of two is
+ * split into FREE_BIN_SUBS bins. That covers blocks up to 2^31 longs,
+ * more than any region we allocate from, so the last bin is only a
+ * backstop and is searched first-fit. Small allocations mostly come
+ * from the malloc cache, so two bins per power of two are enough.
+ */
+#define FREE_BIN_SUB_SHIFT	1
+#define FREE_BIN_SUBS		(1 << FREE_BIN_SUB_SHIFT)
+#define FREE_BIN_LAST		(MEM_REGION_FREE_BINS - 1)
+
+/*
+ * How many blocks of a bin that may be too small we try before looking
+ * in the higher bins. The rest of the bin is only searched if those
+ * have nothing.
+ */
+#define FREE_BIN_SCAN		8
+
+static unsigned int free_bin(unsigned long longs)
+{
+	unsigned int fl, bin;
+
+	if (longs < 2 * FREE_BIN_SUBS)
+		return longs;
+
+	fl = BITS_PER_LONG - 1 - __builtin_clzl(longs);
+	bin = (fl - FREE_BIN_SUB_SHIFT + 1) * FREE_BIN_SUBS
+		+ ((longs >> (fl - FREE_BIN_SUB_SHIFT)) & (FREE_BIN_SUBS - 1));
+
+	return bin < FREE_BIN_LAST ? bin : FREE_BIN_LAST;
+}
+
+static void free_list_add(struct mem_region *region, struct free_hdr *f)
+{
+	unsigned int bin = free_bin(f->hdr.num_longs);
+
+	list_add(&region->free_list[bin], &f->list);
+	region->free_bins |= 1ul << bin;
+}
+
+/* Must be called before f->hdr.num_longs changes. */
+static void free_list_del(struct mem_region *region, struct free_hdr *f)
+{
+	unsigned int bin = free_bin(f->hdr.num_longs);
+
+	list_del_from(&region->free_list[bin], &f->list);
+	if (list_empty(&region->free_list[bin]))
+		region->free_bins &= ~(1ul << bin);
+}
+
+/* Allocatable regions only get free lists on their first allocation. */
+static bool free_lists_initialised(const struct mem_region *region)
+{
+	return region->free_list[0].n.next != NULL;
+}
+
 /* Creates free block covering entire region. */
 static void init_allocatable_region(struct mem_region *region)
 {
 	struct free_hdr *f = region_start(region);
+	unsigned int i;
+
 	assert(region->type == REGION_SKIBOOT_HEAP);
 	f->hdr.num_longs = region->len / sizeof(long);
 	f->hdr.free = true;
 	f->hdr.prev_free = false;
 	*tailer(f) = f->hdr.num_longs;
-	list_head_init(&region->free_list);
-	list_add(&region->free_list, &f->list);
+	for (i = 0; i < MEM_REGION_FREE_BINS; i++)
+		list_head_init(&region->free_list[i]);
+	region->free_bins = 0;
+	free_list_add(region, f);
 }
 
 static void make_free(struct mem_region *region, struct free_hdr *f,
@@ -166,13 +228,14 @@ static void make_free(struct mem_region *region, struct free_hdr *f,
 		assert(!prev->hdr.prev_free);
 
 		/* Expand to cover the one we just freed. */
+		free_list_del(region, prev);
 		prev->hdr.num_longs += f->hdr.num_longs;
 		f = prev;
 	} else {
 		f->hdr.free = true;
 		f->hdr.location = location;
-		list_add(&region->free_list, &f->list);
 	}
+	free_list_add(region, f);
 
 	/* Fix up tailer. */
 	*tailer(f) = f->hdr.num_longs;
@@ -183,7 +246,7 @@ static void make_free(struct mem_region *region, struct free_hdr *f,
 		next->prev_free = true;
 		if (next->free) {
 			struct free_hdr *next_free = (void *)next;
-			list_del_from(&region->free_list, &next_free->list);
+			free_list_del(region, next_free);
 			/* Maximum of one level of recursion */
 			make_free(region, next_free, location);
 		}
@@ -193,23 +256,64 @@ static void make_free(struct mem_region *region, struct free_hdr *f,
 /* Can we fit this many longs with this alignment in this free block? */
 static bool fits(struct free_hdr *f, size_t longs, size_t align, size_t *offset)
 {
-	*offset = 0;
+	unsigned long addr;
 
-	while (f->hdr.num_longs >= *offset + longs) {
-		size_t addr;
+	/* We may have to skip some to meet alignment. */
+	addr = (unsigned long)f + ALLOC_HDR_LONGS * sizeof(long);
+	if (addr & (align - 1)) {
+		/* Don't make tiny chunks! */
+		addr += ALLOC_MIN_LONGS * sizeof(long);
+		addr = ALIGN_UP(addr, align);
+	}
+	*offset = (addr - (unsigned long)f) / sizeof(long) - ALLOC_HDR_LONGS;
 
-		addr = (unsigned long)f
-			+ (*offset + ALLOC_HDR_LONGS) * sizeof(long);
-		if ((addr & (align - 1)) == 0)
-			return true;
+	return f->hdr.num_longs >= *offset + longs;
+}
 
-		/* Don't make tiny chunks! */
-		if (*offset == 0)
-			*offset = ALLOC_MIN_LONGS;
-		else
-			(*offset)++;
+static struct free_hdr *find_free(struct mem_region *region, size_t longs,
+				  size_t align, size_t *offset)
+{
+	struct free_hdr *f;
+	unsigned long bins;
+	unsigned int bin, tries = 0;
+	size_t need = longs;
+
+	/* Worst case padding fits() may need for this alignment. */
+	if (align > sizeof(long))
+		need += ALLOC_MIN_LONGS + align / sizeof(long);
+
+	/* Our own bin holds blocks both smaller and larger than need. */
+	bin = free_bin(need);
+	list_for_each(&region->free_list[bin], f, list) {
+		if (fits(f, longs, align, offset))
+			return f;
+		if (bin != FREE_BIN_LAST && ++tries == FREE_BIN_SCAN)
+			break;
 	}
-	return false;
+
+	/* Any block in a higher bin is big enough, so try those next. */
+	for (bins = region->free_bins & ~((2ul << bin) - 1); bins;
+	     bins &= bins - 1) {
+		unsigned int up = __builtin_ctzl(bins);
+
+		list_for_each(&region->free_list[up], f, list) {
+			if (fits(f, longs, align, offset))
+				return f;
+		}
+	}
+
+	/* Last resort: the rest of our own bin, past the ones tried above. */
+	if (tries < FREE_BIN_SCAN)
+		return NULL;
+	list_for_each(&region->free_list[bin], f, list) {
+		if (tries) {
+			tries--;
+			continue;
+		}
+		if (fits(f, longs, align, offset))
+			return f;
+	}
+	return NULL;
 }
 
 static void discard_excess(struct mem_region *region,
@@ -275,7 +379,7 @@ void mem_dump_allocs(void)
 		       (long long)region->start,
 		       (long long)(region->start + region->len - 1),
 		       region->name);
-		if (region->free_list.n.next == NULL) {
+		if (!free_lists_initialised(region)) {
 			printf("    no allocs\n");
 			continue;
 		}
@@ -303,7 +407,7 @@ int64_t mem_dump_free(void)
 			continue;
 		region_free = 0;
 
-		if (region->free_list.n.next == NULL) {
+		if (!free_lists_initialised(region)) {
 			continue;
 		}
 		for (hdr = region_start(region); hdr; hdr = next_hdr(region, hdr)) {
@@ -339,7 +443,7 @@ static void *__mem_alloc(struct mem_region *region, size_t size, size_t align,
 		return NULL;
 
 	/* First allocation? */
-	if (region->free_list.n.next == NULL)
+	if (!free_lists_initialised(region))
 		init_allocatable_region(region);
 
 	/* Don't do screwy sizes. */
@@ -357,21 +461,15 @@ static void *__mem_alloc(struct mem_region *region, size_t size, size_t align,
 	if (alloc_longs < ALLOC_MIN_LONGS)
 		alloc_longs = ALLOC_MIN_LONGS;
 
-	/* Walk free list. */
-	list_for_each(&region->free_list, f, list) {
-		/* We may have to skip some to meet alignment. */
-		if (fits(f, alloc_longs, align, &offset))
-			goto found;
-	}
-
-	return NULL;
+	f = find_free(region, alloc_longs, align, &offset);
+	if (!f)
+		return NULL;
 
-found:
 	assert(f->hdr.free);
 	assert(!f->hdr.prev_free);
 
 	/* This block is no longer free. */
-	list_del_from(&region->free_list, &f->list);
+	free_list_del(region, f);
 	f->hdr.free = false;
 	f->hdr.location = location;
 
@@ -460,6 +558,30 @@ size_t mem_allocated_size(const void *ptr)
 	return hdr->num_longs * sizeof(long) - sizeof(struct alloc_hdr);
 }
 
+/* Record a new owner for an allocation, eg. when handing out cached blocks */
+void mem_set_location(void *ptr, const char *location)
+{
+	struct alloc_hdr *hdr = ptr - sizeof(*hdr);
+
+	/* This should be a constant. */
+	assert(is_rodata(location));
+
+	hdr->location = location;
+}
+
+/*
+ * For callers that hold on to freed blocks instead of calling mem_free():
+ * abort if @ptr was already freed to @region or, per @cached, to them.
+ */
+void mem_check_free(struct mem_region *region, const void *ptr, bool cached,
+		    const char *location)
+{
+	const struct alloc_hdr *hdr = ptr - sizeof(*hdr);
+
+	if (hdr->free || cached)
+		bad_header(region, hdr, "re-freed", location);
+}
+
 bool mem_resize(struct mem_region *region, void *mem, size_t len,
 		const char *location)
 {
@@ -497,7 +619,7 @@ bool mem_resize(struct mem_region *region, void *mem, size_t len,
 
 	/* OK, it's free and big enough, absorb it. */
 	f = (struct free_hdr *)next;
-	list_del_from(&region->free_list, &f->list);
+	free_list_del(region, f);
 	hdr->num_longs += next->num_longs;
 	hdr->location = location;
 
@@ -521,6 +643,7 @@ bool mem_check(const struct mem_region *region)
 	size_t frees = 0;
 	struct alloc_hdr *hdr, *prev_free = NULL;
 	struct free_hdr *f;
+	unsigned int bin;
 
 	/* Check it's sanely aligned. */
 	if (region->start % sizeof(struct alloc_hdr)) {
@@ -536,7 +659,7 @@ bool mem_check(const struct mem_region *region)
 
 	/* Not ours to play with, or empty?  Don't do anything. */
 	if (region->type != REGION_SKIBOOT_HEAP ||
-			region->free_list.n.next == NULL)
+			!free_lists_initialised(region))
 		return true;
 
 	/* Walk linearly. */
@@ -581,9 +704,27 @@ bool mem_check(const struct mem_region *region)
 		}
 	}
 
-	/* Now walk free list. */
-	list_for_each(&region->free_list, f, list)
-		frees ^= (unsigned long)f - region->start;
+	/* Now walk free lists. */
+	for (bin = 0; bin < MEM_REGION_FREE_BINS; bin++) {
+		bool used = region->free_bins & (1ul << bin);
+
+		if (used == list_empty(&region->free_list[bin])) {
+			prerror("Region '%s' free bin %u is %sempty but %smarked"
+				" in use\n", region->name, bin,
+				used ? "" : "not ", used ? "" : "not ");
+			return false;
+		}
+		list_for_each(&region->free_list[bin], f, list) {
+			if (free_bin(f->hdr.num_longs) != bin) {
+				prerror("Region '%s' free %p (%s) size %zu"
+					" in wrong bin %u\n",
+					region->name, f, hdr_location(&f->hdr),
+					f->hdr.num_longs * sizeof(long), bin);
+				return false;
+			}
+			frees ^= (unsigned long)f - region->start;
+		}
+	}
 
 	if (frees) {
 		prerror("Region '%s' free list and walk do not match!\n",
@@ -609,7 +750,7 @@ static struct mem_region *new_region(const char *name,
 	region->len = len;
 	region->node = node;
 	region->type = type;
-	region->free_list.n.next = NULL;
+	region->free_list[0].n.next = NULL;
 	init_lock(&region->free_list_lock);
 
 	return region;
@@ -902,15 +1043,17 @@ void mem_region_init(void)
 static uint64_t allocated_length(const struct mem_region *r)
 {
 	struct free_hdr *f, *last = NULL;
+	unsigned int bin;
 
 	/* No allocations at all? */
-	if (r->free_list.n.next == NULL)
+	if (!free_lists_initialised(r))
 		return 0;
 
 	/* Find last free block. */
-	list_for_each(&r->free_list, f, list)
-		if (f > last)
-			last = f;
+	for (bin = 0; bin < MEM_REGION_FREE_BINS; bin++)
+		list_for_each(&r->free_list[bin], f, list)
+			if (f > last)
+				last = f;
 
 	/* No free blocks? */
 	if (!last)
@@ -956,7 +1099,7 @@ void mem_region_release_unused(void)
 			struct free_hdr *last = region_start(r) + used_len;
 
 			/* Remove the final free block. */
-			list_del_from(&r->free_list, &last->list);
+			free_list_del(r, last);
 
 			for_linux = split_region(r, r->start + used_len,
 						 REGION_OS);
@@ -19,21 +19,146 @@
 #include <opal-msg.h>
 #include <opal-api.h>
 #include <lock.h>
+#include <device.h>
+#include <processor.h>
 
 #define OPAL_MAX_MSGS		(OPAL_MSG_TYPE_MAX + OPAL_MAX_ASYNC_COMP - 1)
 
+/* Must be a power of 2 */
+#define OPAL_MSG_RING_ENTRIES	128
+
 struct opal_msg_entry {
 	struct list_node link;
 	void (*consumed)(void *data);
 	void *data;
 	struct opal_msg msg;
+
+	/* On comp_lists[] while queued for OPAL_GET_MSG */
+	struct list_node comp_link;
+	bool comp_indexed;
+
+	/* Ring counter of the slot, while waiting for the host to pass it */
+	uint32_t ring_idx;
 };
 
 static LIST_HEAD(msg_free_list);
 static LIST_HEAD(msg_pending_list);
 
+/*
+ * Pending async completions by token, so that checking one doesn't
+ * have to walk msg_pending_list. Tokens beyond the table size can
+ * only be found by the walk.
+ */
+static struct list_head comp_lists[OPAL_MAX_ASYNC_COMP];
+
+/* Messages sent through the ring that have a consumed callback */
+static LIST_HEAD(msg_ring_list);
+
+static struct opal_msg_ring *msg_ring;
+static uint32_t msg_ring_head;
+
+/* Only set by OPAL_MSG_RING_CONTROL, never trusted from the ring itself */
+static bool msg_ring_enabled;
+
 static struct lock opal_msg_lock = LOCK_UNLOCKED;
 
+static bool opal_msg_ring_empty(void)
+{
+	return !msg_ring || msg_ring_head == msg_ring->tail;
+}
+
+static void opal_msg_update_evt(void)
+{
+	if (list_empty(&msg_pending_list) && opal_msg_ring_empty())
+		opal_update_pending_evt(OPAL_EVENT_MSG_PENDING, 0);
+	else
+		opal_update_pending_evt(OPAL_EVENT_MSG_PENDING,
+					OPAL_EVENT_MSG_PENDING);
+}
+
+/*
+ * Move ring entries the host has consumed onto @done, for the caller
+ * to run their callbacks once it dropped the lock.
+ */
+static void opal_msg_ring_reap(struct list_head *done)
+{
+	struct opal_msg_entry *entry;
+	uint32_t tail;
+
+	if (!msg_ring)
+		return;
+
+	/* Order our reuse of the slots after the host's reads of them */
+	tail = msg_ring->tail;
+	lwsync();
+
+	while ((entry = list_top(&msg_ring_list, struct opal_msg_entry,
+				 link)) != NULL) {
+		if ((int32_t)(tail - entry->ring_idx) <= 0)
+			break;
+		list_del(&entry->link);
+		list_add_tail(done, &entry->link);
+	}
+}
+
+static void opal_msg_run_consumed(struct list_head *done)
+{
+	struct opal_msg_entry *entry;
+
+	list_for_each(done, entry, link)
+		entry->consumed(entry->data);
+
+	lock(&opal_msg_lock);
+	while ((entry = list_pop(done, struct opal_msg_entry, link)) != NULL)
+		list_add(&msg_free_list, &entry->link);
+	unlock(&opal_msg_lock);
+}
+
+/*
+ * Post a message in the ring, returns false if the host doesn't use
+ * it, if it's full or if messages are already waiting for
+ * OPAL_GET_MSG, which must not be overtaken.
+ */
+static bool opal_msg_ring_post(struct opal_msg_entry *entry)
+{
+	struct opal_msg *slot;
+
+	if (!msg_ring_enabled || !list_empty(&msg_pending_list))
+		return false;
+	if (msg_ring_head - msg_ring->tail >= OPAL_MSG_RING_ENTRIES)
+		return false;
+
+	slot = &msg_ring->msgs[msg_ring_head & (OPAL_MSG_RING_ENTRIES - 1)];
+	memcpy(slot, &entry->msg, sizeof(*slot));
+	entry->ring_idx = msg_ring_head++;
+
+	/* Make the message visible before the new head */
+	lwsync();
+	msg_ring->head = msg_ring_head;
+
+	return true;
+}
+
+static void opal_msg_index(struct opal_msg_entry *entry)
+{
+	uint64_t token = entry->msg.params[0];
+
+	entry->comp_indexed = entry->msg.msg_type == OPAL_MSG_ASYNC_COMP &&
+		token < OPAL_MAX_ASYNC_COMP;
+	if (entry->comp_indexed)
+		list_add_tail(&comp_lists[token], &entry->comp_link);
+}
+
+/* Take @entry off the pending list, caller holds the lock */
+static void opal_msg_unqueue(struct opal_msg_entry *entry)
+{
+	list_del(&entry->link);
+	if (entry->comp_indexed) {
+		list_del(&entry->comp_link);
+		entry->comp_indexed = false;
+	}
+}
+
 int _opal_queue_msg(enum opal_msg_type msg_type, void *data,
 		    void (*consumed)(void *data), size_t num_params,
 		    const u64 *params)
@@ -42,6 +167,10 @@ int _opal_queue_msg(enum opal_msg_type msg_type, void *data,
 
 	lock(&opal_msg_lock);
 
+	/*
+	 * Ring entries are reaped by the poller and OPAL_GET_MSG only, so
+	 * their callbacks never run under whatever locks our caller holds.
+	 */
 	entry = list_pop(&msg_free_list, struct opal_msg_entry, link);
 	if (!entry) {
 		prerror("No available node in the free list, allocating\n");
@@ -63,7 +192,16 @@ int _opal_queue_msg(enum opal_msg_type msg_type, void *data,
 	}
 	memcpy(entry->msg.params, params, num_params*sizeof(u64));
 
-	list_add_tail(&msg_pending_list, &entry->link);
+	if (opal_msg_ring_post(entry)) {
+		/* Only keep the entry around if it has to be told */
+		if (consumed)
+			list_add_tail(&msg_ring_list, &entry->link);
+		else
+			list_add(&msg_free_list, &entry->link);
+	} else {
+		list_add_tail(&msg_pending_list, &entry->link);
+		opal_msg_index(entry);
+	}
 	opal_update_pending_evt(OPAL_EVENT_MSG_PENDING,
 				OPAL_EVENT_MSG_PENDING);
 
@@ -77,28 +215,33 @@ static int64_t opal_get_msg(uint64_t *buffer, uint64_t size)
 	struct opal_msg_entry *entry;
 	void (*callback)(void *data);
 	void *data;
+	LIST_HEAD(done);
 
 	if (size < sizeof(struct opal_msg) || !buffer)
 		return OPAL_PARAMETER;
 
 	lock(&opal_msg_lock);
 
-	entry = list_pop(&msg_pending_list, struct opal_msg_entry, link);
+	opal_msg_ring_reap(&done);
+
+	entry = list_top(&msg_pending_list, struct opal_msg_entry, link);
 	if (!entry) {
 		unlock(&opal_msg_lock);
+		opal_msg_run_consumed(&done);
 		return OPAL_RESOURCE;
 	}
+	opal_msg_unqueue(entry);
 
 	memcpy(buffer, &entry->msg, sizeof(entry->msg));
 	callback = entry->consumed;
 	data = entry->data;
 
 	list_add(&msg_free_list, &entry->link);
-	if (list_empty(&msg_pending_list))
-		opal_update_pending_evt(OPAL_EVENT_MSG_PENDING, 0);
+	opal_msg_update_evt();
 
 	unlock(&opal_msg_lock);
 
+	opal_msg_run_consumed(&done);
 	if (callback)
 		callback(data);
 
@@ -109,27 +252,34 @@ opal_call(OPAL_GET_MSG, opal_get_msg, 2);
 static int64_t opal_check_completion(uint64_t *buffer, uint64_t size,
 				     uint64_t token)
 {
-	struct opal_msg_entry *entry, *next_entry;
+	struct opal_msg_entry *entry = NULL, *iter;
 	void (*callback)(void *data) = NULL;
 	int rc = OPAL_BUSY;
 	void *data = NULL;
 
 	lock(&opal_msg_lock);
-	list_for_each_safe(&msg_pending_list, entry, next_entry, link) {
-		if (entry->msg.msg_type == OPAL_MSG_ASYNC_COMP &&
-				entry->msg.params[0] == token) {
-			list_del(&entry->link);
-			callback = entry->consumed;
-			data = entry->data;
-			list_add(&msg_free_list, &entry->link);
-			if (list_empty(&msg_pending_list))
-				opal_update_pending_evt(OPAL_EVENT_MSG_PENDING,
-							0);
-			rc = OPAL_SUCCESS;
-			break;
+	if (token < OPAL_MAX_ASYNC_COMP) {
+		entry = list_top(&comp_lists[token], struct opal_msg_entry,
+				 comp_link);
+	} else {
+		list_for_each(&msg_pending_list, iter, link) {
+			if (iter->msg.msg_type == OPAL_MSG_ASYNC_COMP &&
+			    iter->msg.params[0] == token) {
+				entry = iter;
+				break;
+			}
 		}
 	}
 
+	if (entry) {
+		opal_msg_unqueue(entry);
+		callback = entry->consumed;
+		data = entry->data;
+		list_add(&msg_free_list, &entry->link);
+		opal_msg_update_evt();
+		rc = OPAL_SUCCESS;
+	}
+
 	if (rc == OPAL_SUCCESS && size >= sizeof(struct opal_msg))
 		memcpy(buffer, &entry->msg, sizeof(entry->msg));
 
@@ -143,11 +293,109 @@ static int64_t opal_check_completion(uint64_t *buffer, uint64_t size,
 }
 opal_call(OPAL_CHECK_ASYNC_COMPLETION, opal_check_completion, 3);
 
+/*
+ * The host doesn't call us when it consumes from the ring, so
+ * completion callbacks and the pending event are caught up here.
+ */
+static void opal_msg_poll(void *data __unused)
+{
+	LIST_HEAD(done);
+
+	if (!msg_ring)
+		return;
+
+	lock(&opal_msg_lock);
+	opal_msg_ring_reap(&done);
+	opal_msg_update_evt();
+	unlock(&opal_msg_lock);
+
+	opal_msg_run_consumed(&done);
+}
+
+/*
+ * Empty the ring and set who owns it. Messages the host hadn't read
+ * are dropped, their callbacks go on @done.
+ */
+static void opal_msg_ring_set(bool enable, struct list_head *done)
+{
+	struct opal_msg_entry *entry;
+
+	while ((entry = list_pop(&msg_ring_list, struct opal_msg_entry,
+				 link)) != NULL)
+		list_add_tail(done, &entry->link);
+
+	msg_ring_enabled = enable;
+	msg_ring_head = 0;
+	msg_ring->head = 0;
+	msg_ring->tail = 0;
+	lwsync();
+	msg_ring->enabled = enable;
+	opal_msg_update_evt();
+}
+
+/*
+ * The OS takes the ring with @enable set and hands it back with it
+ * clear. Either way the ring starts empty.
+ */
+static int64_t opal_msg_ring_control(uint64_t enable)
+{
+	LIST_HEAD(done);
+
+	if (!msg_ring)
+		return OPAL_UNSUPPORTED;
+	if (enable > 1)
+		return OPAL_PARAMETER;
+
+	lock(&opal_msg_lock);
+	opal_msg_ring_set(enable, &done);
+	unlock(&opal_msg_lock);
+
+	opal_msg_run_consumed(&done);
+
+	return OPAL_SUCCESS;
+}
+opal_call(OPAL_MSG_RING_CONTROL, opal_msg_ring_control, 1);
+
+void opal_msg_ring_reset(void)
+{
+	opal_msg_ring_control(0);
+}
+
+static void opal_init_msg_ring(void)
+{
+	uint64_t addr;
+	size_t size;
+
+	if (msg_ring)
+		return;
+
+	/* head and tail are padded to be on their own 128 byte lines */
+	size = sizeof(*msg_ring) +
+		OPAL_MSG_RING_ENTRIES * sizeof(struct opal_msg);
+	msg_ring = memalign(128, size);
+	if (!msg_ring) {
+		prerror("Failed to allocate message ring\n");
+		return;
+	}
+	memset(msg_ring, 0, size);
+	msg_ring->entries = OPAL_MSG_RING_ENTRIES;
+
+	addr = (uint64_t)msg_ring;
+	dt_add_property_cells(opal_node, "ibm,opal-msg-ring",
+			      hi32(addr), lo32(addr), OPAL_MSG_RING_ENTRIES);
+	opal_add_poller(opal_msg_poll, NULL);
+}
+
 void opal_init_msg(void)
 {
 	struct opal_msg_entry *entry;
 	int i;
 
+	for (i = 0; i < OPAL_MAX_ASYNC_COMP; i++)
+		list_head_init(&comp_lists[i]);
+
+	opal_init_msg_ring();
+
 	for (i = 0; i < OPAL_MAX_MSGS; i++, entry++) {
                 entry = zalloc(sizeof(*entry));
                 if (!entry)
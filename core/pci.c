@@ -20,6 +20,7 @@
 #include <pci-cfg.h>
 #include <timebase.h>
 #include <device.h>
+#include <boot-profile.h>
 
 /* The eeh event code will need updating if this is ever increased to
  * support more than 64 phbs */
@@ -128,6 +129,34 @@ int64_t pci_find_ecap(struct phb *phb, uint16_t bdfn, uint16_t want,
 	return OPAL_UNSUPPORTED;
 }
 
+static void pci_map_dev(struct phb *phb, struct pci_device *pd)
+{
+	struct pci_device **map = phb->dev_map[pd->bdfn >> 8];
+
+	if (!map) {
+		map = zalloc(256 * sizeof(*map));
+		if (!map) {
+			PCIERR(phb, pd->bdfn, "Failed to allocate device map\n");
+			phb->dev_map_incomplete = true;
+			return;
+		}
+		phb->dev_map[pd->bdfn >> 8] = map;
+	}
+	if (map[pd->bdfn & 0xff]) {
+		PCIERR(phb, pd->bdfn, "Device already known !\n");
+		return;
+	}
+	map[pd->bdfn & 0xff] = pd;
+}
+
+static void pci_unmap_dev(struct phb *phb, struct pci_device *pd)
+{
+	struct pci_device **map = phb->dev_map[pd->bdfn >> 8];
+
+	if (map && map[pd->bdfn & 0xff] == pd)
+		map[pd->bdfn & 0xff] = NULL;
+}
+
 static struct pci_device *pci_scan_one(struct phb *phb, struct pci_device *parent,
 				       uint16_t bdfn)
 {
@@ -244,6 +273,9 @@ static struct pci_device *pci_scan_one(struct phb *phb, struct pci_device *paren
 	       pd->is_bridge ? "+" : "-",
 	       pci_has_cap(pd, PCI_CFG_CAP_ID_EXP, false) ? "+" : "-");
 
+	/* Make it visible to pci_find_dev(), including from the hook */
+	pci_map_dev(phb, pd);
+
 	/*
 	 * Call PHB hook
 	 */
@@ -663,10 +695,12 @@ void pci_device_init(struct phb *phb, struct pci_device *pd)
  * The power state would be checked. If the power has
  * been on, we will issue fundamental reset. Otherwise,
  * we will power it on before issuing fundamental reset.
+ *
+ * This only kicks off the reset state machine. A positive
+ * return is the delay before it wants to be polled again.
  */
-static int64_t pci_phb_reset(struct phb *phb)
+static int64_t pci_phb_reset_start(struct phb *phb, const char **desc)
 {
-	const char *desc;
 	int64_t rc;
 
 	rc = phb->ops->power_state(phb);
@@ -676,36 +710,22 @@ static int64_t pci_phb_reset(struct phb *phb)
 	}
 
 	if (rc == OPAL_SHPC_POWER_ON) {
-		desc = "fundamental reset";
+		*desc = "fundamental reset";
 		rc = phb->ops->fundamental_reset(phb);
 	} else {
-		desc = "power on";
+		*desc = "power on";
 		rc = phb->ops->slot_power_on(phb);
 	}
 
-	if (rc < 0) {
-		/* Don't warn if it's just an empty slot */
-		if (rc != OPAL_CLOSED)
-			goto warn_err;
-		return rc;
-	}
-
-	/* Wait the internal state machine */
-	while (rc > 0) {
-		time_wait(rc);
-		rc = phb->ops->poll(phb);
-	}
+	/* Don't warn if it's just an empty slot */
+	if (rc < 0 && rc != OPAL_CLOSED)
+		PCIERR(phb, 0, "Failed to %s, rc=%lld\n", *desc, rc);
 
- warn_err:
-	if (rc < 0)
-		PCIERR(phb, 0, "Failed to %s, rc=%lld\n", desc, rc);
-
-        return rc;
+	return rc;
 }
 
-static void pci_reset_phb(void *data)
+static int64_t pci_reset_phb_start(struct phb *phb, const char **desc)
 {
-	struct phb *phb = data;
 	int64_t rc;
 
 	PCIDBG(phb, 0, "Init slot...\n");
@@ -720,7 +740,7 @@ static void pci_reset_phb(void *data)
 		rc = phb->ops->presence_detect(phb);
 		if (rc != OPAL_SHPC_DEV_PRESENT) {
 			PCIDBG(phb, 0, "Slot empty\n");
-			return;
+			return OPAL_SUCCESS;
 		}
 	}
 
@@ -729,12 +749,74 @@ static void pci_reset_phb(void *data)
 	 * fundamental way while powering on. The reset
 	 * state machine is going to wait for the link
 	 */
-	pci_phb_reset(phb);
+	return pci_phb_reset_start(phb, desc);
 }
 
-static void pci_scan_phb(void *data)
+/*
+ * Reset all PHBs and wait for their links to train. The state
+ * machines are all stepped from this one loop, each PHB being
+ * polled when the delay it asked for has elapsed, so the waits
+ * overlap however many CPUs we have.
+ */
+static void pci_reset_phbs(void)
+{
+	static uint64_t due[ARRAY_SIZE(phbs)];
+	static const char *desc[ARRAY_SIZE(phbs)];
+	uint64_t now, next, start = mftb();
+	unsigned int i, pending = 0;
+	struct phb *phb;
+	int64_t rc;
+	int mark = boot_prof_begin("pci-reset", 0);
+
+	for (i = 0; i < ARRAY_SIZE(phbs); i++) {
+		due[i] = 0;
+		if (!phbs[i])
+			continue;
+		rc = pci_reset_phb_start(phbs[i], &desc[i]);
+		if (rc <= 0)
+			continue;
+		due[i] = mftb() + rc;
+		pending++;
+	}
+
+	while (pending) {
+		/* Sleep until the first PHB wants attention */
+		next = 0;
+		for (i = 0; i < ARRAY_SIZE(phbs); i++)
+			if (due[i] && (!next ||
+			    tb_compare(due[i], next) == TB_ABEFOREB))
+				next = due[i];
+		now = mftb();
+		if (tb_compare(now, next) == TB_ABEFOREB)
+			time_wait(next - now);
+
+		now = mftb();
+		for (i = 0; i < ARRAY_SIZE(phbs); i++) {
+			if (!due[i] || tb_compare(now, due[i]) == TB_ABEFOREB)
+				continue;
+			phb = phbs[i];
+			rc = phb->ops->poll(phb);
+			if (rc > 0) {
+				due[i] = mftb() + rc;
+				continue;
+			}
+			if (rc < 0)
+				PCIERR(phb, 0, "Failed to %s, rc=%lld\n",
+				       desc[i], rc);
+			PCIDBG(phb, 0, "Reset done after %lu ms\n",
+			       tb_to_msecs(mftb() - start));
+			due[i] = 0;
+			pending--;
+		}
+	}
+
+	boot_prof_end(mark);
+	prlog(PR_DEBUG, "PCI: All PHBs reset in %lu ms\n",
+	      tb_to_msecs(mftb() - start));
+}
+
+static void __pci_scan_phb(struct phb *phb)
 {
-	struct phb *phb = data;
 	uint32_t mps = 0xffffffff;
 	bool has_link = false;
 	int64_t rc;
@@ -770,6 +852,15 @@ static void pci_scan_phb(void *data)
 	pci_walk_dev(phb, pci_configure_mps, NULL);
 }
 
+static void pci_scan_phb(void *data)
+{
+	struct phb *phb = data;
+	int mark = boot_prof_begin("pci-scan", phb->opal_id);
+
+	__pci_scan_phb(phb);
+	boot_prof_end(mark);
+}
+
 int64_t pci_register_phb(struct phb *phb)
 {
 	int64_t rc = OPAL_SUCCESS;
@@ -790,6 +881,8 @@ int64_t pci_register_phb(struct phb *phb)
 		PCIDBG(phb, 0, "PCI: Registered PHB\n");
 	}
 	list_head_init(&phb->devices);
+	memset(phb->dev_map, 0, sizeof(phb->dev_map));
+	phb->dev_map_incomplete = false;
 
 	return rc;
 }
@@ -1387,12 +1480,13 @@ static void pci_add_nodes(struct phb *phb)
 		pci_add_one_node(phb, pd, phb->dt_node, lstate, 0);
 }
 
-static void __pci_reset(struct list_head *list)
+static void __pci_reset(struct phb *phb, struct list_head *list)
 {
 	struct pci_device *pd;
 
 	while ((pd = list_pop(list, struct pci_device, link)) != NULL) {
-		__pci_reset(&pd->children);
+		__pci_reset(phb, &pd->children);
+		pci_unmap_dev(phb, pd);
 		free(pd);
 	}
 }
@@ -1411,7 +1505,7 @@ void pci_reset(void)
 	for (i = 0; i < ARRAY_SIZE(phbs); i++) {
 		if (!phbs[i])
 			continue;
-		__pci_reset(&phbs[i]->devices);
+		__pci_reset(phbs[i], &phbs[i]->devices);
 	}
 }
 
@@ -1449,7 +1543,7 @@ void pci_init_slots(void)
 	unsigned int i;
 
 	prlog(PR_NOTICE, "PCI: Resetting PHBs...\n");
-	pci_do_jobs(pci_reset_phb);
+	pci_reset_phbs();
 
 	prlog(PR_NOTICE, "PCI: Probing slots...\n");
 	pci_do_jobs(pci_scan_phb);
@@ -1522,6 +1616,14 @@ static int __pci_find_dev(struct phb *phb,
 
 struct pci_device *pci_find_dev(struct phb *phb, uint16_t bdfn)
 {
+	struct pci_device **map = phb->dev_map[bdfn >> 8];
+
+	if (map && map[bdfn & 0xff])
+		return map[bdfn & 0xff];
+
+	/* Only walk the tree if we failed to index some devices */
+	if (!phb->dev_map_incomplete)
+		return NULL;
 	return pci_walk_dev(phb, __pci_find_dev, &bdfn);
 }
 
@@ -21,6 +21,7 @@
 #include <timebase.h>
 #include <cpu.h>
 #include <chip.h>
+#include <boot-profile.h>
 
 struct platform	platform;
 
@@ -111,6 +112,7 @@ int wait_for_resource_loaded(enum resource_id id, uint32_t idx)
 {
 	int r = resource_loaded(id, idx);
 	int waited = 0;
+	int mark = boot_prof_begin("resource-wait", id);
 
 	while(r == OPAL_BUSY) {
 		opal_run_pollers();
@@ -118,6 +120,7 @@ int wait_for_resource_loaded(enum resource_id id, uint32_t idx)
 		waited+=5;
 		r = resource_loaded(id, idx);
 	}
+	boot_prof_end(mark);
 
 	prlog(PR_TRACE, "PLATFORM: wait_for_resource_loaded %x/%x %u ms\n",
 	      id, idx, waited);
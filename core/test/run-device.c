@@ -19,7 +19,7 @@
 /* Override this for testing. */
 #define is_rodata(p) fake_is_rodata(p)
 
-char __rodata_start[16];
+char __rodata_start[128];
 #define __rodata_end (__rodata_start + sizeof(__rodata_start))
 
 static inline bool fake_is_rodata(const void *p)
@@ -29,9 +29,28 @@ static inline bool fake_is_rodata(const void *p)
 
 #define zalloc(bytes) calloc((bytes), 1)
 
+/* Don't include this, it's PPC-specific */
+#define __PROCESSOR_H
+static inline void lwsync(void)
+{
+}
+
 #include "../device.c"
 #include "../../ccan/list/list.c" /* For list_check */
 #include <assert.h>
+#include <time.h>
+
+void lock(struct lock *l)
+{
+	assert(!l->lock_val);
+	l->lock_val = 1;
+}
+
+void unlock(struct lock *l)
+{
+	assert(l->lock_val);
+	l->lock_val = 0;
+}
 
 static void check_path(const struct dt_node *node, const char * expected_path)
 {
@@ -44,6 +63,132 @@ static void check_path(const struct dt_node *node, const char * expected_path)
 	free(path);
 }
 
+static double now_secs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Property names as firmware code passes them, ie, from rodata */
+static const char *bench_names[] = { "ibm,chip-id", "compatible", "reg",
+				     "interrupt-parent", "status",
+				     "no-such-property" };
+#define BENCH_CHIP_ID	ro_names[0]
+#define BENCH_COMPAT	ro_names[1]
+#define BENCH_REG	ro_names[2]
+#define BENCH_INTR	ro_names[3]
+#define BENCH_STATUS	ro_names[4]
+#define BENCH_MISSING	ro_names[5]
+static const char *ro_names[ARRAY_SIZE(bench_names)];
+
+#define BENCH_CHIPS	16
+#define BENCH_PHBS	32
+#define BENCH_DEVS	32
+
+/* Build a tree of the size of a large machine and time the lookups the
+ * PCI and interrupt code do on it
+ */
+static void bench_large_tree(void)
+{
+	struct dt_node *root, *chip, *phb, *dev, *n;
+	const struct dt_property *p;
+	unsigned int c, b, d, nodes = 0, found;
+	double start, secs;
+	char *ro = __rodata_start + 16;
+
+	for (c = 0; c < ARRAY_SIZE(bench_names); c++) {
+		ro_names[c] = strcpy(ro, bench_names[c]);
+		ro += strlen(ro) + 1;
+		assert(is_rodata(ro));
+	}
+
+	start = now_secs();
+	root = dt_new_root("");
+	for (c = 0; c < BENCH_CHIPS; c++) {
+		chip = dt_new_addr(root, "chip", c);
+		dt_add_property_cells(chip, BENCH_CHIP_ID, c);
+		nodes++;
+		for (b = 0; b < BENCH_PHBS; b++) {
+			phb = dt_new_addr(chip, "pciex", b);
+			dt_add_property_strings(phb, BENCH_COMPAT,
+						"ibm,power8-pciex",
+						"ibm,ioda2-phb");
+			nodes++;
+			for (d = 0; d < BENCH_DEVS; d++) {
+				dev = dt_new_addr(phb, "dev", d);
+				dt_add_property_cells(dev, BENCH_REG, d);
+				dt_add_property_cells(dev, BENCH_INTR,
+						      phb->phandle);
+				dt_add_property_string(dev, BENCH_COMPAT,
+						       "fake-device");
+				dt_add_property_cells(dev, "vendor-id", 0x1014);
+				dt_add_property_cells(dev, "device-id", 0x3b9);
+				dt_add_property_cells(dev, "revision-id", 1);
+				dt_add_property_cells(dev, "class-code", 0x60400);
+				dt_add_property_cells(dev, "interrupts", d);
+				dt_add_property_string(dev, "ibm,loc-code",
+						       "U78CB.001.WZS0001-P1");
+				dt_add_property_cells(dev,
+					"ibm,pci-config-space-type", 1);
+				dt_add_property_string(dev, BENCH_STATUS, "okay");
+				nodes++;
+			}
+		}
+	}
+	secs = now_secs() - start;
+	printf("Built %u nodes in %.3f secs\n", nodes, secs);
+
+	/* Resolve every interrupt-parent */
+	start = now_secs();
+	found = 0;
+	dt_for_each_node(root, n) {
+		p = dt_find_property(n, BENCH_INTR);
+		if (!p)
+			continue;
+		assert(dt_find_by_phandle(root, dt_property_get_cell(p, 0)) ==
+		       n->parent);
+		found++;
+	}
+	secs = now_secs() - start;
+	assert(found == BENCH_CHIPS * BENCH_PHBS * BENCH_DEVS);
+	printf("%u phandle lookups in %.3f secs: %.0f lookups/sec\n",
+	       found, secs, found / secs);
+
+	/* Property lookups, hits and misses */
+	start = now_secs();
+	for (c = 0; c < 16; c++) {
+		found = 0;
+		dt_for_each_node(root, n) {
+			if (dt_find_property(n, BENCH_STATUS))
+				found++;
+			assert(!dt_find_property(n, BENCH_MISSING));
+		}
+		assert(found == BENCH_CHIPS * BENCH_PHBS * BENCH_DEVS);
+	}
+	secs = now_secs() - start;
+	printf("%u property lookups in %.3f secs: %.0f lookups/sec\n",
+	       32 * nodes, secs, 32 * nodes / secs);
+
+	/* Find the PHBs of every chip */
+	start = now_secs();
+	for (c = 0; c < BENCH_CHIPS; c++) {
+		found = 0;
+		n = NULL;
+		while ((n = dt_find_compatible_node_on_chip(root, n,
+							    "ibm,ioda2-phb",
+							    c)))
+			found++;
+		assert(found == BENCH_PHBS);
+	}
+	secs = now_secs() - start;
+	printf("%u compatible on chip scans in %.3f secs\n", c, secs);
+
+	dt_free(root);
+	assert(!dt_phandle_count && !dt_phandles);
+}
+
 int main(void)
 {
 	struct dt_node *root, *c1, *c2, *gc1, *gc2, *gc3, *ggc1;
@@ -296,6 +441,12 @@ int main(void)
 	assert(dt_find_by_phandle(root, 0xf00) == gc2);
 	assert(dt_find_by_phandle(root, 0xf0f) == NULL);
 
+	/* Phandles follow nodes being freed */
+	dt_free(gc2);
+	assert(dt_find_by_phandle(root, 0xf00) == NULL);
+
 	dt_free(root);
+
+	bench_large_tree();
 	return 0;
 }
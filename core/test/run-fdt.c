@@ -0,0 +1,143 @@
+/* Copyright 2013-2015 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <skiboot.h>
+
+#define zalloc(bytes) calloc((bytes), 1)
+
+/* Don't include this, it's PPC-specific */
+#define __PROCESSOR_H
+static inline void lwsync(void)
+{
+}
+
+#include "../device.c"
+#include "../fdt.c"
+#include "../../ccan/list/list.c" /* For list_check */
+#include "../../libfdt/fdt.c"
+#include "../../libfdt/fdt_ro.c"
+#include <assert.h>
+
+char __rodata_start[1], __rodata_end[1];
+
+void lock(struct lock *l)
+{
+	assert(!l->lock_val);
+	l->lock_val = 1;
+}
+
+void unlock(struct lock *l)
+{
+	assert(l->lock_val);
+	l->lock_val = 0;
+}
+
+static const struct dt_property *next_prop(const struct dt_node *n,
+					   const struct dt_property *p)
+{
+	if (p->list.next == &n->properties.n)
+		return NULL;
+	return list_entry(p->list.next, struct dt_property, list);
+}
+
+/* Check an expanded copy matches the original tree */
+static void check_same(const struct dt_node *a, const struct dt_node *b)
+{
+	const struct dt_property *pa, *pb;
+	const struct dt_node *ca, *cb;
+
+	assert(strcmp(a->name, b->name) == 0);
+	/* dt_add_property() takes the phandle in native endian */
+	assert(a->phandle == fdt32_to_cpu(b->phandle));
+
+	pb = list_top(&b->properties, struct dt_property, list);
+	list_for_each(&a->properties, pa, list) {
+		if (strstarts(pa->name, DT_PRIVATE))
+			continue;
+		assert(pb);
+		assert(strcmp(pa->name, pb->name) == 0);
+		assert(pa->len == pb->len);
+		assert(memcmp(pa->prop, pb->prop, pa->len) == 0);
+		pb = next_prop(b, pb);
+	}
+	assert(!pb);
+
+	cb = dt_first(b);
+	list_for_each(&a->children, ca, list) {
+		assert(cb);
+		check_same(ca, cb);
+		cb = cb->list.next == &b->children.n ? NULL :
+			list_entry(cb->list.next, struct dt_node, list);
+	}
+	assert(!cb);
+}
+
+int main(void)
+{
+	struct dt_node *root, *n, *c, *copy;
+	uint64_t ranges[4] = { 0x1000, 0x2000, 0x100000, 0x30000 };
+	uint64_t addr, size;
+	unsigned int i, j;
+	void *blob;
+	char name[32];
+
+	root = dt_new_root("");
+	dt_add_property_cells(root, "#address-cells", 2);
+	dt_add_property(root, "reserved-ranges", ranges, sizeof(ranges));
+	for (i = 0; i < 64; i++) {
+		n = dt_new_addr(root, "node", i);
+		dt_add_property_cells(n, "reg", i);
+		dt_add_property_string(n, "compatible", "test-node");
+		dt_add_property(n, "empty", NULL, 0);
+		dt_add_property(n, DT_PRIVATE "hidden", &i, sizeof(i));
+		for (j = 0; j < 16; j++) {
+			c = dt_new_addr(n, "child", j);
+			/* Odd sizes to exercise padding */
+			dt_add_property(c, "data", name, j);
+			snprintf(name, sizeof(name), "unique-%u-%u", i, j);
+			dt_add_property_cells(c, name, j);
+		}
+	}
+
+	blob = create_dtb(root);
+	assert(blob);
+	assert(fdt_check_header(blob) == 0);
+
+	/* Exactly sized: strings end the blob */
+	assert(fdt_totalsize(blob) ==
+	       fdt_off_dt_strings(blob) + fdt_size_dt_strings(blob));
+
+	/* Names shared by many properties are stored once */
+	assert(fdt_size_dt_strings(blob) <
+	       64 * 16 * sizeof("unique-xx-xx") + 256);
+
+	assert(fdt_num_mem_rsv(blob) == 2);
+	assert(fdt_get_mem_rsv(blob, 1, &addr, &size) == 0);
+	assert(addr == 0x100000 && size == 0x30000);
+
+	copy = dt_new_root("");
+	assert(dt_expand_node(copy, blob, 0) > 0);
+	check_same(root, copy);
+
+	/* Again, as on a fast reboot */
+	blob = create_dtb(root);
+	assert(blob && fdt_check_header(blob) == 0);
+
+	dt_free(copy);
+	dt_free(root);
+	free(blob);
+	return 0;
+}
@@ -0,0 +1,389 @@
+/* Copyright 2016 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#define __TEST__
+static unsigned long stamp;
+#define mftb()	(stamp += 512000)
+
+/* Don't include these: PPC-specific */
+#define __CPU_H
+#define __PROCESSOR_H
+
+struct cpu_thread;
+
+struct cpu_job {
+	void (*func)(void *data);
+	void *data;
+	bool running;
+	bool complete;
+};
+
+/*
+ * Jobs only run when somebody waits for them, so ECC decodes of
+ * several chunks can be outstanding at once, like on a real machine.
+ */
+static struct cpu_job *queued[4];
+static unsigned int nqueued;
+static bool fail_queue;
+static unsigned int decodes;
+
+static struct cpu_job *cpu_queue_job(struct cpu_thread *cpu,
+				     const char *name,
+				     void (*func)(void *data), void *data)
+{
+	struct cpu_job *job;
+
+	(void)cpu;
+	/* Make every other decode fall back to running inline */
+	if (fail_queue && !strcmp(name, "flash_ecc_decode") && (decodes++ & 1))
+		return NULL;
+
+	job = calloc(1, sizeof(*job));
+	job->func = func;
+	job->data = data;
+	assert(nqueued < 4);
+	queued[nqueued++] = job;
+	return job;
+}
+
+static void cpu_wait_job(struct cpu_job *job, bool free_it)
+{
+	unsigned int i;
+
+	/* Run everything queued up to the job, except the caller's own */
+	for (i = 0; i < nqueued && !job->complete; i++) {
+		if (queued[i]->running || queued[i]->complete)
+			continue;
+		queued[i]->running = true;
+		queued[i]->func(queued[i]->data);
+		queued[i]->complete = true;
+	}
+	assert(job->complete);
+
+	for (i = 0; i < nqueued; ) {
+		if (queued[i]->complete)
+			memmove(&queued[i], &queued[i + 1],
+				(--nqueued - i) * sizeof(queued[0]));
+		else
+			i++;
+	}
+	if (free_it)
+		free(job);
+}
+
+static void cpu_process_local_jobs(void)
+{
+	/* The loader job is queued on the boot CPU, run it now */
+	if (nqueued)
+		cpu_wait_job(queued[nqueued - 1], false);
+}
+
+#include "../flash.c"
+#include "../../libflash/ecc.c"
+
+void lock(struct lock *l)
+{
+	assert(!l->lock_val);
+	l->lock_val = 1;
+}
+
+bool try_lock(struct lock *l)
+{
+	if (l->lock_val)
+		return false;
+	l->lock_val = 1;
+	return true;
+}
+
+static bool in_load;
+static unsigned int reserves_refused;
+
+void unlock(struct lock *l)
+{
+	uint64_t data;
+
+	assert(l->lock_val);
+	l->lock_val = 0;
+
+	/*
+	 * Every time the loader lets go of the lock before or between
+	 * chunks, the BMC and the OS try to get at the flash. Both must
+	 * be told to come back later.
+	 */
+	if (l == &flash_lock && in_load && system_flash->loading) {
+		in_load = false;
+		assert(!flash_reserve());
+		assert(opal_flash_read(0, 0, (uint64_t)&data, sizeof(data), 0)
+		       == OPAL_BUSY);
+		in_load = true;
+		reserves_refused++;
+	}
+}
+
+struct dt_node *opal_node, *dt_chosen;
+struct platform platform;
+
+int boot_prof_begin(const char *name __unused, uint32_t arg __unused)
+{
+	return -1;
+}
+
+void boot_prof_end(int mark __unused)
+{
+}
+
+void nvram_read_complete(bool success __unused)
+{
+}
+
+int _opal_queue_msg(enum opal_msg_type msg_type __unused, void *data __unused,
+		   void (*consumed)(void *data) __unused, size_t num_params,
+		   const u64 *params __unused)
+{
+	(void)num_params;
+	return 0;
+}
+
+struct dt_node *dt_new_addr(struct dt_node *parent __unused,
+			    const char *name __unused, uint64_t addr __unused)
+{
+	return NULL;
+}
+
+struct dt_property *dt_add_property_string(struct dt_node *node __unused,
+					   const char *name __unused,
+					   const char *value __unused)
+{
+	return NULL;
+}
+
+struct dt_property *__dt_add_property_strings(struct dt_node *node __unused,
+					      const char *name __unused,
+					      int count __unused, ...)
+{
+	return NULL;
+}
+
+struct dt_property *__dt_add_property_cells(struct dt_node *node __unused,
+					    const char *name __unused,
+					    int count __unused, ...)
+{
+	return NULL;
+}
+
+char *dt_get_path(const struct dt_node *node __unused)
+{
+	return strdup("/flash");
+}
+
+/*
+ * A fake PNOR: NVRAM first, then BOOTKERNEL without ECC and ROOTFS
+ * with ECC. Both images are several load chunks long, and don't end
+ * on a chunk boundary.
+ */
+#define KERNEL_SIZE	(3 * FLASH_LOAD_CHUNK + 0x1000)
+#define ROOTFS_SIZE	(4 * FLASH_LOAD_CHUNK + 0x2000)
+#define NVRAM_START	0
+#define NVRAM_SIZE	0x1000
+#define KERNEL_START	(NVRAM_START + NVRAM_SIZE)
+#define ROOTFS_START	(KERNEL_START + KERNEL_SIZE)
+#define FLASH_SIZE	(ROOTFS_START + ecc_buffer_size(ROOTFS_SIZE))
+
+static uint8_t *flash_image;
+static uint8_t kernel[KERNEL_SIZE], rootfs[ROOTFS_SIZE];
+static struct blocklevel_device fake_bl;
+static struct ffs_handle *fake_ffs = (struct ffs_handle *)&fake_bl;
+
+int blocklevel_read(struct blocklevel_device *bl, uint32_t pos, void *buf,
+		    uint32_t len)
+{
+	assert(bl == &fake_bl);
+	assert(pos + len <= FLASH_SIZE);
+	memcpy(buf, flash_image + pos, len);
+	return 0;
+}
+
+int blocklevel_write(struct blocklevel_device *bl __unused,
+		     uint32_t pos __unused, const void *buf __unused,
+		     uint32_t len __unused)
+{
+	return 0;
+}
+
+int blocklevel_erase(struct blocklevel_device *bl __unused,
+		     uint32_t pos __unused, uint32_t len __unused)
+{
+	return 0;
+}
+
+int blocklevel_get_info(struct blocklevel_device *bl __unused,
+			const char **name, uint32_t *total_size,
+			uint32_t *erase_granule)
+{
+	*name = "fake";
+	*total_size = FLASH_SIZE;
+	*erase_granule = 0x1000;
+	return 0;
+}
+
+int ffs_init(uint32_t offset __unused, uint32_t max_size __unused,
+	     struct blocklevel_device *bl, struct ffs_handle **ffs,
+	     int mark_ecc __unused)
+{
+	assert(bl == &fake_bl);
+	*ffs = fake_ffs;
+	return 0;
+}
+
+void ffs_close(struct ffs_handle *ffs __unused)
+{
+}
+
+int ffs_lookup_part(struct ffs_handle *ffs __unused, const char *name,
+		    uint32_t *part_idx)
+{
+	if (!strcmp(name, "NVRAM"))
+		*part_idx = 0;
+	else if (!strcmp(name, "BOOTKERNEL"))
+		*part_idx = 1;
+	else if (!strcmp(name, "ROOTFS"))
+		*part_idx = 2;
+	else
+		return FFS_ERR_PART_NOT_FOUND;
+	return 0;
+}
+
+int ffs_part_info(struct ffs_handle *ffs __unused, uint32_t part_idx,
+		  char **name, uint32_t *start, uint32_t *total_size,
+		  uint32_t *act_size, bool *ecc)
+{
+	const struct {
+		uint32_t start, size;
+		bool ecc;
+	} parts[] = {
+		{ NVRAM_START, NVRAM_SIZE, false },
+		{ KERNEL_START, KERNEL_SIZE, false },
+		{ ROOTFS_START, ecc_buffer_size(ROOTFS_SIZE), true },
+	};
+
+	assert(part_idx < 3);
+	assert(!name && !act_size);
+	*start = parts[part_idx].start;
+	*total_size = parts[part_idx].size;
+	if (ecc)
+		*ecc = parts[part_idx].ecc;
+	return 0;
+}
+
+int flash_read_corrected(struct blocklevel_device *bl __unused,
+			 uint32_t pos __unused, void *buf __unused,
+			 uint32_t len __unused, bool ecc __unused)
+{
+	/* Only used for subpartitions, which aren't tested here */
+	return FLASH_ERR_PARM_ERROR;
+}
+
+static void setup_flash(void)
+{
+	unsigned int i;
+
+	flash_image = calloc(1, FLASH_SIZE);
+	for (i = 0; i < KERNEL_SIZE; i++)
+		flash_image[KERNEL_START + i] = i * 7;
+	for (i = 0; i < ROOTFS_SIZE; i++)
+		rootfs[i] = i * 13 + 1;
+	assert(!memcpy_to_ecc((struct ecc64 *)(flash_image + ROOTFS_START),
+			      (uint64_t *)rootfs, ROOTFS_SIZE));
+	memset(rootfs, 0, sizeof(rootfs));
+
+	assert(flash_register(&fake_bl, true) == OPAL_SUCCESS);
+	assert(system_flash);
+}
+
+static void test_load(enum resource_id id, void *buf, size_t size,
+		      bool inline_decodes)
+{
+	size_t len = size;
+
+	fail_queue = inline_decodes;
+	decodes = 0;
+
+	assert(flash_start_preload_resource(id, RESOURCE_SUBID_NONE,
+					    buf, &len) == OPAL_SUCCESS);
+	assert(flash_resource_loaded(id, RESOURCE_SUBID_NONE) == OPAL_SUCCESS);
+	assert(len == size);
+
+	fail_queue = false;
+}
+
+static void test_reserve(void)
+{
+	size_t len = KERNEL_SIZE;
+
+	/* A reserve between two chunks must not fail the load */
+	memset(kernel, 0, sizeof(kernel));
+	in_load = true;
+	assert(flash_start_preload_resource(RESOURCE_ID_KERNEL,
+					    RESOURCE_SUBID_NONE,
+					    kernel, &len) == OPAL_SUCCESS);
+	in_load = false;
+	assert(reserves_refused >= KERNEL_SIZE / FLASH_LOAD_CHUNK);
+	assert(flash_resource_loaded(RESOURCE_ID_KERNEL,
+				     RESOURCE_SUBID_NONE) == OPAL_SUCCESS);
+	assert(!memcmp(kernel, flash_image + KERNEL_START, KERNEL_SIZE));
+
+	/* Once it's done, the BMC can have the flash */
+	assert(flash_reserve());
+	len = KERNEL_SIZE;
+	assert(flash_start_preload_resource(RESOURCE_ID_KERNEL,
+					    RESOURCE_SUBID_NONE,
+					    kernel, &len) == OPAL_SUCCESS);
+	assert(flash_resource_loaded(RESOURCE_ID_KERNEL,
+				     RESOURCE_SUBID_NONE) == OPAL_RESOURCE);
+	flash_release();
+}
+
+int main(void)
+{
+	unsigned int i;
+
+	setup_flash();
+
+	/* Without ECC */
+	test_load(RESOURCE_ID_KERNEL, kernel, KERNEL_SIZE, false);
+	assert(!memcmp(kernel, flash_image + KERNEL_START, KERNEL_SIZE));
+
+	/* With ECC, decoded by jobs, then partly inline */
+	test_load(RESOURCE_ID_INITRAMFS, rootfs, ROOTFS_SIZE, false);
+	for (i = 0; i < ROOTFS_SIZE; i++)
+		assert(rootfs[i] == (uint8_t)(i * 13 + 1));
+	memset(rootfs, 0, sizeof(rootfs));
+	test_load(RESOURCE_ID_INITRAMFS, rootfs, ROOTFS_SIZE, true);
+	for (i = 0; i < ROOTFS_SIZE; i++)
+		assert(rootfs[i] == (uint8_t)(i * 13 + 1));
+
+	test_reserve();
+
+	free(flash_image);
+	return 0;
+}
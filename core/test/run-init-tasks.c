@@ -0,0 +1,322 @@
+/* Copyright 2016 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#define __TEST__
+static unsigned long stamp;
+#define mftb()	(stamp += 512000)
+
+/* Don't include these: PPC-specific */
+#define __CPU_H
+#define __CHIP_H
+#define __PROCESSOR_H
+
+#define zalloc(size) calloc((size), 1)
+
+struct cpu_thread {
+	uint32_t pir;
+	uint32_t chip_id;
+};
+
+struct proc_chip {
+	uint32_t id;
+};
+
+struct cpu_job {
+	struct cpu_thread *cpu;
+	void (*func)(void *data);
+	void *data;
+	bool complete;
+};
+
+/* Chip 0 has the boot CPU and one secondary, chip 1 two, chip 2 none */
+static struct cpu_thread cpus[] = {
+	{ 0x00, 0 }, { 0x01, 0 }, { 0x20, 1 }, { 0x21, 1 },
+};
+static struct proc_chip chips[] = { { 0 }, { 1 }, { 2 } };
+
+#define NUM_CPUS	(sizeof(cpus) / sizeof(cpus[0]))
+#define NUM_CHIPS	(sizeof(chips) / sizeof(chips[0]))
+
+/* Jobs "run" on their CPU as far as this_cpu() is concerned */
+static struct cpu_thread *current_cpu = &cpus[0];
+
+static struct cpu_thread *this_cpu(void)
+{
+	return current_cpu;
+}
+
+static struct cpu_thread *first_available_cpu(void)
+{
+	return &cpus[0];
+}
+
+static struct cpu_thread *next_available_cpu(struct cpu_thread *cpu)
+{
+	return cpu + 1 < &cpus[NUM_CPUS] ? cpu + 1 : NULL;
+}
+
+#define for_each_available_cpu(cpu)	\
+	for (cpu = first_available_cpu(); cpu; cpu = next_available_cpu(cpu))
+
+static struct proc_chip *next_chip(struct proc_chip *chip)
+{
+	if (!chip)
+		return &chips[0];
+	return chip + 1 < &chips[NUM_CHIPS] ? chip + 1 : NULL;
+}
+
+#define for_each_chip(__c) for (__c=next_chip(NULL); __c; __c=next_chip(__c))
+
+/*
+ * Jobs queued on other CPUs only run when the boot CPU waits, which
+ * shows what the scheduler gets done in the meantime.
+ */
+static struct cpu_job *queued[16];
+static unsigned int nqueued, nwaits;
+
+static struct cpu_job *cpu_queue_job(struct cpu_thread *cpu, const char *name,
+				     void (*func)(void *data), void *data)
+{
+	struct cpu_job *job = calloc(1, sizeof(*job));
+
+	(void)name;
+	job->cpu = cpu;
+	job->func = func;
+	job->data = data;
+	if (cpu == this_cpu()) {
+		func(data);
+		job->complete = true;
+	} else {
+		assert(nqueued < 16);
+		queued[nqueued++] = job;
+	}
+	return job;
+}
+
+static bool cpu_poll_job(struct cpu_job *job)
+{
+	return job->complete;
+}
+
+static void cpu_wait_job(struct cpu_job *job, bool free_it)
+{
+	unsigned int i;
+
+	assert(!free_it);
+	nwaits++;
+	for (i = 0; i < nqueued; i++) {
+		current_cpu = queued[i]->cpu;
+		queued[i]->func(queued[i]->data);
+		queued[i]->complete = true;
+	}
+	current_cpu = &cpus[0];
+	nqueued = 0;
+	assert(job->complete);
+}
+
+static void cpu_free_job(struct cpu_job *job)
+{
+	assert(job->complete);
+	free(job);
+}
+
+#include "../init-tasks.c"
+#undef pr_fmt
+#include "../boot-profile.c"
+
+void lock(struct lock *l)
+{
+	assert(!l->lock_val);
+	l->lock_val = 1;
+}
+
+void unlock(struct lock *l)
+{
+	assert(l->lock_val);
+	l->lock_val = 0;
+}
+
+/* The exported profile ends up here */
+static struct dt_node fake_opal_node, profile_node;
+struct dt_node *opal_node = &fake_opal_node;
+static struct boot_prof_rec *exported_recs;
+static size_t exported_size;
+
+struct dt_node *dt_new(struct dt_node *parent, const char *name)
+{
+	assert(parent == opal_node);
+	assert(strcmp(name, "boot-profile") == 0);
+	return &profile_node;
+}
+
+struct dt_property *dt_add_property(struct dt_node *node, const char *name,
+				    const void *val, size_t size)
+{
+	assert(node == &profile_node);
+	assert(strcmp(name, "entries") == 0);
+	exported_recs = malloc(size);
+	memcpy(exported_recs, val, size);
+	exported_size = size;
+	return NULL;
+}
+
+struct dt_property *dt_add_property_string(struct dt_node *node,
+					   const char *name, const char *value)
+{
+	(void)node;
+	(void)name;
+	(void)value;
+	return NULL;
+}
+
+struct dt_property *__dt_add_property_cells(struct dt_node *node,
+					    const char *name, int count, ...)
+{
+	(void)node;
+	(void)name;
+	(void)count;
+	return NULL;
+}
+
+static char order[64];
+
+static void log_task(char c)
+{
+	size_t len = strlen(order);
+
+	assert(len + 1 < sizeof(order));
+	order[len] = c;
+}
+
+static void task_a(void) { log_task('A'); }
+static void task_b(void)
+{
+	int mark = boot_prof_begin("b-inner", 7);
+
+	log_task('B');
+	boot_prof_end(mark);
+}
+
+static void task_d(void) { log_task('D'); }
+static void task_e(void) { log_task('E'); }
+
+static void task_c(struct proc_chip *chip)
+{
+	log_task('0' + chip->id);
+}
+
+static struct init_task tasks[] = {
+	INIT_TASK("a", task_a),
+	INIT_CHIP_TASK("c", task_c, "a"),
+	INIT_TASK("b", task_b, "a"),
+	INIT_TASK("d", task_d, "c"),
+	INIT_TASK("e", task_e, "b"),
+	INIT_TASK("sync", NULL, "d", "e"),
+};
+
+static struct boot_prof_rec *find_rec(const char *name, uint32_t arg)
+{
+	unsigned int i;
+
+	for (i = 0; i < exported_size / sizeof(*exported_recs); i++)
+		if (strcmp(exported_recs[i].name, name) == 0 &&
+		    be32_to_cpu(exported_recs[i].arg) == arg)
+			return &exported_recs[i];
+	assert(0);
+	return NULL;
+}
+
+static void test_profile(void)
+{
+	struct boot_prof_rec *r, *p;
+	int open;
+
+	/* Left open on purpose, it must show as such */
+	open = boot_prof_begin("open", 0);
+	boot_prof_add_dt();
+	assert(boot_prof_begin("late", 0) < 0);
+	boot_prof_end(open);
+
+	/* 6 tasks, 2 extra chip runs, b-inner and open */
+	assert(exported_size == 10 * sizeof(*exported_recs));
+
+	/* Chip tasks show up on the thread that ran them */
+	r = find_rec("c", 0);
+	assert(be32_to_cpu(r->pir) == 0x01);
+	assert(be16_to_cpu(r->depth) == 0);
+	r = find_rec("c", 1);
+	assert(be32_to_cpu(r->pir) == 0x20);
+	r = find_rec("c", 2);
+	assert(be32_to_cpu(r->pir) == 0x00);
+
+	/* Nested under the task that opened it */
+	r = find_rec("b-inner", 7);
+	p = &exported_recs[be16_to_cpu(r->parent)];
+	assert(strcmp(p->name, "b") == 0);
+	assert(be16_to_cpu(r->depth) == 1);
+	assert(be64_to_cpu(r->start) >= be64_to_cpu(p->start));
+	assert(be64_to_cpu(r->end) <= be64_to_cpu(p->end));
+
+	/* Nothing told us chiptod was done */
+	assert(be16_to_cpu(r->flags) == BOOT_PROF_PRESYNC);
+	r = find_rec("open", 0);
+	assert(be16_to_cpu(r->flags) & BOOT_PROF_OPEN);
+	assert(be16_to_cpu(r->parent) == BOOT_PROF_NO_PARENT);
+
+	free(exported_recs);
+}
+
+int main(void)
+{
+	unsigned int i;
+
+	init_tasks_dump(tasks, ARRAY_SIZE(tasks));
+	init_tasks_run(tasks, ARRAY_SIZE(tasks));
+
+	/*
+	 * Chip 2 has no thread, so runs in line as soon as "c" is started.
+	 * "b" and "e" then go while chips 0 and 1 are busy, and "d" only
+	 * once the boot CPU had to wait for them.
+	 */
+assert(strcmp(order, "A2BE01D") == 0);
+	assert(nwaits == 1);
+
+	for (i = 0; i < ARRAY_SIZE(tasks); i++) {
+		assert(tasks[i].state == INIT_TASK_DONE);
+		assert(tasks[i].end_tb >= tasks[i].start_tb);
+		assert(!tasks[i].jobs);
+	}
+
+	/* Nothing ran on the boot CPU that could have gone elsewhere */
+	assert(tasks[3].start_tb > tasks[4].end_tb);
+
+	test_profile();
+
+	/* A table can be run again */
+	memset(order, 0, sizeof(order));
+	nwaits = 0;
+	init_tasks_run(tasks, ARRAY_SIZE(tasks));
+	assert(strcmp(order, "A2BE01D") == 0);
+
+	return 0;
+}
@@ -17,8 +17,12 @@
 #include <config.h>
 
 #define BITS_PER_LONG (sizeof(long) * 8)
-/* Don't include this, it's PPC-specific */
+/* Don't include these, they're PPC-specific */
 #define __CPU_H
+#define __PROCESSOR_H
+static inline void lwsync(void)
+{
+}
 static unsigned int cpu_max_pir = 1;
 struct cpu_thread {
 	unsigned int			chip_id;
@@ -51,6 +55,7 @@ static inline void real_free(void *p)
 
 #include <assert.h>
 #include <stdio.h>
+#include <time.h>
 
 char __rodata_start[1], __rodata_end[1];
 struct dt_node *dt_root;
@@ -76,11 +81,134 @@ bool lock_held_by_me(struct lock *l)
 #define TEST_HEAP_SIZE (1ULL << TEST_HEAP_ORDER)
 
 #define NUM_ALLOCS 4096
+#define NUM_MIXED_OPS (4 * 1024 * 1024)
+#define NUM_FRAGMENTED_ALLOCS 2048
+
+/* Cheap, repeatable pseudo-random numbers (xorshift64) */
+static uint64_t rand_state = 0x2545f4914f6cdd1dULL;
+
+static unsigned long next_rand(void)
+{
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 7;
+	rand_state ^= rand_state << 17;
+	return rand_state;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+/* Mostly small objects, some medium ones and the odd big buffer. */
+static size_t mixed_size(void)
+{
+	unsigned long r = next_rand();
+
+	switch (r % 64) {
+	case 0:
+		return 16384 + (r >> 8) % 65536;
+	case 1 ... 8:
+		return 512 + (r >> 8) % 4096;
+	default:
+		return 8 + (r >> 8) % 256;
+	}
+}
+
+/* Three in four use the default alignment, the rest up to 4K. */
+static size_t mixed_align(void)
+{
+	unsigned long r = next_rand();
+
+	if (r % 4)
+		return sizeof(long);
+	return 16ul << ((r >> 8) % 9);
+}
+
+static void mixed_benchmark(void **p)
+{
+	unsigned long i, allocs = 0, frees = 0;
+	double start, secs;
+
+	memset(p, 0, sizeof(void *) * NUM_ALLOCS);
+
+	start = now();
+	for (i = 0; i < NUM_MIXED_OPS; i++) {
+		unsigned int slot = next_rand() % NUM_ALLOCS;
+
+		if (p[slot]) {
+			__free(p[slot], __location__);
+			p[slot] = NULL;
+			frees++;
+		} else {
+			size_t size = mixed_size(), align = mixed_align();
+
+			p[slot] = __memalign(align, size, __location__);
+			assert(p[slot]);
+			assert(((unsigned long)p[slot] & (align - 1)) == 0);
+			allocs++;
+		}
+	}
+	secs = now() - start;
+
+	assert(mem_check(&skiboot_heap));
+	printf("%lu mixed ops (%lu allocs, %lu frees) in %.3f secs:"
+	       " %.0f ops/sec\n", i, allocs, frees, secs, i / secs);
+
+	for (i = 0; i < NUM_ALLOCS; i++)
+		__free(p[i], __location__);
+	assert(mem_check(&skiboot_heap));
+}
+
+/*
+ * Leave thousands of small holes in the heap, then time page aligned
+ * allocations that none of them can satisfy. Each of those leaves
+ * another hole in front of it for the next one to skip.
+ */
+static void fragmented_benchmark(void **p)
+{
+	void **q = real_malloc(sizeof(void *) * NUM_FRAGMENTED_ALLOCS);
+	unsigned long i;
+	double start, secs;
+
+	assert(q);
+	for (i = 0; i < NUM_ALLOCS; i++) {
+		p[i] = __malloc(64, __location__);
+		assert(p[i]);
+	}
+	for (i = 0; i < NUM_ALLOCS; i += 2) {
+		__free(p[i], __location__);
+		p[i] = NULL;
+	}
+
+	start = now();
+	for (i = 0; i < NUM_FRAGMENTED_ALLOCS; i++) {
+		q[i] = __memalign(0x1000, 256, __location__);
+		assert(q[i]);
+	}
+	secs = now() - start;
+
+	assert(mem_check(&skiboot_heap));
+	printf("%u aligned allocs past %u holes in %.3f secs: %.0f ops/sec\n",
+	       NUM_FRAGMENTED_ALLOCS, NUM_ALLOCS / 2, secs,
+	       NUM_FRAGMENTED_ALLOCS / secs);
+
+	for (i = 0; i < NUM_FRAGMENTED_ALLOCS; i++)
+		__free(q[i], __location__);
+	for (i = 0; i < NUM_ALLOCS; i++)
+		__free(p[i], __location__);
+	assert(mem_check(&skiboot_heap));
+	real_free(q);
+}
 
 int main(void)
 {
 	uint64_t i, len;
 	void **p = real_malloc(sizeof(void*)*NUM_ALLOCS);
+	double start, secs;
 
 	assert(p);
 
@@ -88,14 +216,29 @@ int main(void)
 	skiboot_heap.start = (unsigned long)real_malloc(skiboot_heap.len);
 
 	len = skiboot_heap.len / NUM_ALLOCS - sizeof(struct alloc_hdr);
+	start = now();
 	for (i = 0; i < NUM_ALLOCS; i++) {
 		p[i] = __malloc(len, __location__);
 		assert(p[i] > region_start(&skiboot_heap));
 		assert(p[i] + len <= region_start(&skiboot_heap)
 		       + skiboot_heap.len);
 	}
+	secs = now() - start;
 	assert(mem_check(&skiboot_heap));
 	assert(skiboot_heap.free_list_lock.lock_val == 0);
+	printf("%u fixed-size allocs in %.3f secs: %.0f ops/sec\n",
+	       NUM_ALLOCS, secs, NUM_ALLOCS / secs);
+
+	/* Give it all back: it must coalesce into a single free block. */
+	for (i = 0; i < NUM_ALLOCS; i++)
+		__free(p[i], __location__);
+	assert(mem_check(&skiboot_heap));
+	assert(((struct alloc_hdr *)region_start(&skiboot_heap))->num_longs
+	       == skiboot_heap.len / sizeof(long));
+
+	mixed_benchmark(p);
+	fragmented_benchmark(p);
+
 	free(region_start(&skiboot_heap));
 	real_free(p);
 	return 0;
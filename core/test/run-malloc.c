@@ -18,8 +18,12 @@
 
 #define BITS_PER_LONG (sizeof(long) * 8)
 
-/* Don't include this, it's PPC-specific */
+/* Don't include these, they're PPC-specific */
 #define __CPU_H
+#define __PROCESSOR_H
+static inline void lwsync(void)
+{
+}
 static unsigned int cpu_max_pir = 1;
 struct cpu_thread {
 	unsigned int			chip_id;
@@ -85,6 +89,8 @@ int main(void)
 	char *test_heap = real_malloc(TEST_HEAP_SIZE);
 	char *p, *p2, *p3, *p4;
 	char *pr;
+	void *cached[MALLOC_CACHE_DEPTH + 1];
+	unsigned long locks;
 	size_t i;
 
 	/* Use malloc for the heap, so valgrind can find issues. */
@@ -183,6 +189,70 @@ int main(void)
 	assert(heap_empty());
 	assert(!skiboot_heap.free_list_lock.lock_val);
 
+	/* Small allocations through a per-cpu cache. */
+	test_malloc_cache = real_malloc(sizeof(*test_malloc_cache));
+	memset(test_malloc_cache, 0, sizeof(*test_malloc_cache));
+
+	/* First one refills half a magazine with a single lock hold. */
+	locks = heap_lock_count;
+	cached[0] = malloc(40);
+	assert(cached[0]);
+	assert(mem_allocated_size(cached[0]) >= 64);
+	assert(heap_lock_count == locks + 1);
+	assert(test_malloc_cache->misses == 1);
+	assert(test_malloc_cache->mags[1].count == MALLOC_CACHE_BATCH);
+
+	/* The rest of the batch comes without taking the lock. */
+	for (i = 1; i <= MALLOC_CACHE_BATCH; i++) {
+		cached[i] = malloc(64);
+		assert(cached[i]);
+		/* Now owned by this caller, not the one that refilled */
+		assert(strcmp(((struct alloc_hdr *)cached[i])[-1].location,
+			      ((struct alloc_hdr *)cached[0])[-1].location));
+	}
+	assert(heap_lock_count == locks + 1);
+	assert(test_malloc_cache->hits == MALLOC_CACHE_BATCH);
+	assert(test_malloc_cache->mags[1].count == 0);
+
+	/* Freed blocks go back to the cache, not the heap... */
+	free(cached[0]);
+	assert(heap_lock_count == locks + 1);
+	assert(test_malloc_cache->mags[1].count == 1);
+	p = malloc(33);
+	assert(p == cached[0]);
+
+	/* ...until the magazine is full, then half of it is flushed. */
+	for (i = MALLOC_CACHE_BATCH + 1; i <= MALLOC_CACHE_DEPTH; i++)
+		cached[i] = malloc(64);
+	for (i = 0; i <= MALLOC_CACHE_DEPTH; i++)
+		free(cached[i]);
+	assert(test_malloc_cache->flushes == 1);
+	assert(test_malloc_cache->mags[1].count >
+	       MALLOC_CACHE_DEPTH - MALLOC_CACHE_BATCH);
+	assert(mem_check(&skiboot_heap));
+
+	/* Big allocations bypass the cache altogether. */
+	i = test_malloc_cache->misses + test_malloc_cache->hits;
+	p = malloc(MALLOC_CACHE_MAX + 1);
+	assert(p);
+	assert(test_malloc_cache->misses + test_malloc_cache->hits == i);
+	free(p);
+
+	/* Drain the cache: everything must end up back in the heap. */
+	heap_lock();
+	for (i = 0; i < MALLOC_CACHE_CLASSES; i++) {
+		struct malloc_magazine *mag = &test_malloc_cache->mags[i];
+
+		while (mag->count)
+			mem_free(&skiboot_heap, mag->objs[--mag->count],
+				 "drain");
+	}
+	heap_unlock();
+	real_free(test_malloc_cache);
+	test_malloc_cache = NULL;
+	assert(heap_empty());
+	assert(!skiboot_heap.free_list_lock.lock_val);
+
 	real_free(test_heap);
 	return 0;
 }
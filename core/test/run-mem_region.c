@@ -17,8 +17,12 @@
 #include <config.h>
 
 #define BITS_PER_LONG (sizeof(long) * 8)
-/* Don't include this, it's PPC-specific */
+/* Don't include these, they're PPC-specific */
 #define __CPU_H
+#define __PROCESSOR_H
+static inline void lwsync(void)
+{
+}
 static unsigned int cpu_max_pir = 1;
 struct cpu_thread {
 	unsigned int			chip_id;
@@ -72,7 +76,7 @@ bool lock_held_by_me(struct lock *l)
 	return l->lock_val;
 }
 
-#define TEST_HEAP_ORDER 12
+#define TEST_HEAP_ORDER 13
 #define TEST_HEAP_SIZE (1ULL << TEST_HEAP_ORDER)
 
 static bool heap_empty(void)
@@ -81,6 +85,44 @@ static bool heap_empty(void)
 	return h->num_longs == skiboot_heap.len / sizeof(long);
 }
 
+/*
+ * Nine free blocks in the same bin as an 800 byte allocation, but too
+ * small for it, ahead of one that fits. Nothing in the higher bins.
+ */
+static void test_bin_scan(void)
+{
+	static struct mem_region region;
+	void *blocks[10], *p;
+	size_t i;
+
+	region.type = REGION_SKIBOOT_HEAP;
+	region.len = 2 * TEST_HEAP_SIZE;
+	region.start = (unsigned long)real_malloc(region.len);
+	lock(&region.free_list_lock);
+
+	for (i = 0; i < 10; i++) {
+		blocks[i] = mem_alloc(&region, i < 9 ? 760 : 900, 1, "block");
+		assert(blocks[i]);
+		assert(mem_alloc(&region, 1, 1, "gap"));
+	}
+	while (mem_alloc(&region, 1, 1, "filler"))
+		;
+
+	/* Freed last means first on the list */
+	for (i = 10; i > 0; i--)
+		mem_free(&region, blocks[i - 1], "freed");
+	assert(region.free_bins ==
+	       1ul << free_bin(800 / sizeof(long) + ALLOC_HDR_LONGS));
+	assert(mem_check(&region));
+
+	p = mem_alloc(&region, 800, 1, "800 bytes");
+	assert(p == blocks[9]);
+	assert(mem_check(&region));
+
+	unlock(&region.free_list_lock);
+	real_free(region_start(&region));
+}
+
 int main(void)
 {
 	char *test_heap;
@@ -88,6 +130,15 @@ int main(void)
 	size_t i;
 	struct mem_region *r;
 
+	/* Bins grow with the size and don't run out before the heap does */
+	for (i = 1; i < (1ul << 31); i = i * 3 / 2 + 1) {
+		assert(free_bin(i) <= free_bin(i * 3 / 2 + 1));
+		assert(free_bin(i) < FREE_BIN_LAST);
+	}
+	assert(free_bin(HEAP_SIZE / sizeof(long)) < FREE_BIN_LAST);
+
+	test_bin_scan();
+
 	/* Use malloc for the heap, so valgrind can find issues. */
 	test_heap = real_malloc(TEST_HEAP_SIZE);
 	skiboot_heap.start = (unsigned long)test_heap;
@@ -236,7 +287,7 @@ int main(void)
 			assert(r->len == TEST_HEAP_SIZE/2);
 			assert(strcmp(r->name, "splitter") == 0);
 			assert(r->type == REGION_RESERVED);
-			assert(!r->free_list.n.next);
+			assert(!r->free_list[0].n.next);
 		} else if (region_start(r) == test_heap + TEST_HEAP_SIZE/4*3) {
 			assert(r->len == TEST_HEAP_SIZE/4);
 			assert(strcmp(r->name, "base") == 0);
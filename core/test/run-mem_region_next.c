@@ -17,8 +17,12 @@
 #include <config.h>
 
 #define BITS_PER_LONG (sizeof(long) * 8)
-/* Don't include this, it's PPC-specific */
+/* Don't include these, they're PPC-specific */
 #define __CPU_H
+#define __PROCESSOR_H
+static inline void lwsync(void)
+{
+}
 static unsigned int cpu_max_pir = 1;
 struct cpu_thread {
 	unsigned int			chip_id;
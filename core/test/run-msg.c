@@ -35,9 +35,52 @@ static void *zalloc(size_t size)
         return calloc(size, 1);
 }
 
+static void *memalign(size_t boundary, size_t size)
+{
+	void *p;
+
+	if (posix_memalign(&p, boundary, size))
+		return NULL;
+	return p;
+}
+
+/* Don't include this, it's PPC-specific */
+#define __PROCESSOR_H
+#if defined(__i386__) || defined(__x86_64__)
+/* This is more than a lwsync, but it'll work */
+static void full_barrier(void)
+{
+	asm volatile("mfence" : : : "memory");
+}
+#define lwsync full_barrier
+#elif defined(__powerpc__) || defined(__powerpc64__)
+static inline void lwsync(void)
+{
+	asm volatile("lwsync" : : : "memory");
+}
+#else
+#error "Define lwsync for this arch"
+#endif
+
 #include "../opal-msg.c"
 #include <skiboot.h>
 
+struct dt_node *opal_node;
+
+struct dt_property *__dt_add_property_cells(struct dt_node *node __unused,
+					    const char *name __unused,
+					    int count __unused, ...)
+{
+	return NULL;
+}
+
+static void (*msg_poller)(void *data);
+
+void opal_add_poller(void (*poller)(void *data), void *data __unused)
+{
+	msg_poller = poller;
+}
+
 void lock(struct lock *l)
 {
         assert(!l->lock_val);
@@ -72,6 +115,195 @@ static size_t list_count(struct list_head *list)
         return count;
 }
 
+/* Split in two to keep each frame under the stack usage limit */
+static void test_queue_unsigned(void)
+{
+        static struct opal_msg m;
+        uint64_t *m_ptr = (uint64_t *)&m;
+        int r;
+
+#define test_queue_num(type, val) \
+        r = opal_queue_msg(0, NULL, NULL, \
+                (type)val, (type)val, (type)val, (type)val, \
+                (type)val, (type)val, (type)val, (type)val); \
+        assert(r == 0); \
+        opal_get_msg(m_ptr, sizeof(m)); \
+        assert(r == OPAL_SUCCESS); \
+        assert(m.params[0] == (type)val); \
+        assert(m.params[1] == (type)val); \
+        assert(m.params[2] == (type)val); \
+        assert(m.params[3] == (type)val); \
+        assert(m.params[4] == (type)val); \
+        assert(m.params[5] == (type)val); \
+        assert(m.params[6] == (type)val); \
+        assert(m.params[7] == (type)val)
+
+        /* Test types of various widths */
+        test_queue_num(u64, -1);
+        test_queue_num(u32, -1);
+        test_queue_num(u16, -1);
+        test_queue_num(u8, -1);
+}
+
+static void test_queue_signed(void)
+{
+        static struct opal_msg m;
+        uint64_t *m_ptr = (uint64_t *)&m;
+        int r;
+
+        test_queue_num(s64, -1);
+        test_queue_num(s32, -1);
+        test_queue_num(s16, -1);
+        test_queue_num(s8, -1);
+}
+
+static void test_completion_table(void)
+{
+        static struct opal_msg m;
+        uint64_t *m_ptr = (uint64_t *)&m;
+        int r;
+
+        /* Several tokens, one of them twice, plus one beyond the table */
+        r = opal_queue_msg(OPAL_MSG_ASYNC_COMP, NULL, NULL, 3, 30);
+        assert(r == 0);
+        r = opal_queue_msg(OPAL_MSG_ASYNC_COMP, NULL, NULL, 1, 10);
+        assert(r == 0);
+        r = opal_queue_msg(OPAL_MSG_ASYNC_COMP, NULL, NULL, 3, 31);
+        assert(r == 0);
+        r = opal_queue_msg(OPAL_MSG_ASYNC_COMP, NULL, NULL,
+                           OPAL_MAX_ASYNC_COMP + 5, 50);
+        assert(r == 0);
+
+        r = opal_check_completion(m_ptr, sizeof(m), 2);
+        assert(r == OPAL_BUSY);
+
+        /* Oldest completion for a token comes first */
+        r = opal_check_completion(m_ptr, sizeof(m), 3);
+        assert(r == OPAL_SUCCESS);
+        assert(m.params[1] == 30);
+        r = opal_check_completion(m_ptr, sizeof(m), OPAL_MAX_ASYNC_COMP + 5);
+        assert(r == OPAL_SUCCESS);
+        assert(m.params[1] == 50);
+
+        /* What's left still comes out of OPAL_GET_MSG in order */
+        r = opal_get_msg(m_ptr, sizeof(m));
+        assert(r == OPAL_SUCCESS);
+        assert(m.params[1] == 10);
+        r = opal_check_completion(m_ptr, sizeof(m), 1);
+        assert(r == OPAL_BUSY);
+        r = opal_check_completion(m_ptr, sizeof(m), 3);
+        assert(r == OPAL_SUCCESS);
+        assert(m.params[1] == 31);
+        r = opal_get_msg(m_ptr, sizeof(m));
+        assert(r == OPAL_RESOURCE);
+}
+
+static int ring_consumed;
+
+static void ring_callback(void *data)
+{
+        assert(data == &ring_consumed);
+        ring_consumed++;
+}
+
+static void test_ring(void)
+{
+        static struct opal_msg m;
+        uint64_t *m_ptr = (uint64_t *)&m;
+        struct opal_msg *slot;
+        uint32_t i;
+        int r;
+
+        assert(msg_ring);
+        assert(((unsigned long)msg_ring & 127) == 0);
+        assert(msg_ring->entries == OPAL_MSG_RING_ENTRIES);
+        assert(msg_poller);
+
+        /* Nothing goes in the ring until the host takes it */
+        msg_ring->enabled = 1;
+        r = opal_queue_msg(0, NULL, NULL, 1);
+        assert(r == 0);
+        assert(msg_ring->head == 0);
+        r = opal_get_msg(m_ptr, sizeof(m));
+        assert(r == OPAL_SUCCESS);
+        assert(opal_msg_ring_control(2) == OPAL_PARAMETER);
+        assert(opal_msg_ring_control(1) == OPAL_SUCCESS);
+        assert(msg_ring->enabled == 1);
+
+        /* Fill the ring, then the rest has to go through OPAL_GET_MSG */
+        zalloc_should_fail = false;
+        for (i = 0; i < OPAL_MSG_RING_ENTRIES + 2; i++) {
+                r = opal_queue_msg(0, &ring_consumed, ring_callback, i);
+                assert(r == 0);
+        }
+        assert(msg_ring->head == OPAL_MSG_RING_ENTRIES);
+        assert(list_count(&msg_pending_list) == 2);
+        assert(list_count(&msg_ring_list) == OPAL_MSG_RING_ENTRIES);
+
+        for (i = 0; i < OPAL_MSG_RING_ENTRIES; i++) {
+                slot = &msg_ring->msgs[i];
+                assert(slot->params[0] == i);
+        }
+
+        /* Callbacks only run once the host moved past the message */
+        msg_poller(NULL);
+        assert(ring_consumed == 0);
+        msg_ring->tail = 10;
+        msg_poller(NULL);
+        assert(ring_consumed == 10);
+        assert(list_count(&msg_ring_list) == OPAL_MSG_RING_ENTRIES - 10);
+
+        /* Ring has room again but mustn't overtake the queued ones */
+        r = opal_queue_msg(0, NULL, NULL, 1000);
+        assert(r == 0);
+        assert(msg_ring->head == OPAL_MSG_RING_ENTRIES);
+        assert(list_count(&msg_pending_list) == 3);
+
+        for (i = 0; i < 3; i++) {
+                r = opal_get_msg(m_ptr, sizeof(m));
+                assert(r == OPAL_SUCCESS);
+                assert(m.params[0] == (i < 2 ? OPAL_MSG_RING_ENTRIES + i : 1000));
+        }
+        assert(ring_consumed == 12);
+
+        /* Then it wraps, messages without callbacks aren't tracked */
+        r = opal_queue_msg(0, NULL, NULL, 2000);
+        assert(r == 0);
+        assert(msg_ring->head == OPAL_MSG_RING_ENTRIES + 1);
+        assert(msg_ring->msgs[0].params[0] == 2000);
+        assert(list_count(&msg_ring_list) == OPAL_MSG_RING_ENTRIES - 10);
+
+        msg_ring->tail = msg_ring->head;
+        msg_poller(NULL);
+        assert(ring_consumed == OPAL_MSG_RING_ENTRIES + 2);
+        assert(list_empty(&msg_ring_list));
+
+        /* Queueing never reaps, whatever the host did with tail */
+        r = opal_queue_msg(0, &ring_consumed, ring_callback, 3000);
+        assert(r == 0);
+        r = opal_queue_msg(0, &ring_consumed, ring_callback, 3001);
+        assert(r == 0);
+        msg_ring->tail = msg_ring->head - 1;
+        r = opal_queue_msg(0, NULL, NULL, 3002);
+        assert(r == 0);
+        assert(ring_consumed == OPAL_MSG_RING_ENTRIES + 2);
+        assert(list_count(&msg_ring_list) == 2);
+
+        /* A new OS starts without the ring, unread messages are dropped */
+        opal_msg_ring_reset();
+        assert(ring_consumed == OPAL_MSG_RING_ENTRIES + 4);
+        assert(list_empty(&msg_ring_list));
+        assert(msg_ring->enabled == 0);
+        assert(msg_ring->head == 0 && msg_ring->tail == 0);
+        r = opal_queue_msg(0, NULL, NULL, 4000);
+        assert(r == 0);
+        assert(msg_ring->head == 0);
+        assert(list_count(&msg_pending_list) == 1);
+        r = opal_get_msg(m_ptr, sizeof(m));
+        assert(r == OPAL_SUCCESS);
+        assert(m.params[0] == 4000);
+}
+
 int main(void)
 {
         struct opal_msg_entry* entry;
@@ -226,31 +458,10 @@ int main(void)
         r = opal_get_msg(m_ptr, sizeof(m));
         assert(r == OPAL_RESOURCE);
 
-#define test_queue_num(type, val) \
-        r = opal_queue_msg(0, NULL, NULL, \
-                (type)val, (type)val, (type)val, (type)val, \
-                (type)val, (type)val, (type)val, (type)val); \
-        assert(r == 0); \
-        opal_get_msg(m_ptr, sizeof(m)); \
-        assert(r == OPAL_SUCCESS); \
-        assert(m.params[0] == (type)val); \
-        assert(m.params[1] == (type)val); \
-        assert(m.params[2] == (type)val); \
-        assert(m.params[3] == (type)val); \
-        assert(m.params[4] == (type)val); \
-        assert(m.params[5] == (type)val); \
-        assert(m.params[6] == (type)val); \
-        assert(m.params[7] == (type)val)
-
-        /* Test types of various widths */
-        test_queue_num(u64, -1);
-        test_queue_num(s64, -1);
-        test_queue_num(u32, -1);
-        test_queue_num(s32, -1);
-        test_queue_num(u16, -1);
-        test_queue_num(s16, -1);
-        test_queue_num(u8, -1);
-        test_queue_num(s8, -1);
+        test_queue_unsigned();
+        test_queue_signed();
+        test_completion_table();
+        test_ring();
 
         /* Clean up the list to keep valgrind happy. */
         while(!list_empty(&msg_free_list)) {
@@ -264,6 +475,7 @@ int main(void)
                 assert(entry);
                 free(entry);
         }
+        free(msg_ring);
 
         return 0;
 }
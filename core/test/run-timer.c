@@ -1,6 +1,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
 
 #define __TEST__
 #include <timer.h>
@@ -16,10 +17,18 @@ static inline void unlock(struct lock *l) { (void)l; }
 #include "../timer.c"
 
 #define NUM_TIMERS	100
+#define NUM_STRESS	4096
+#define STRESS_CHECKS	20000
 
 static struct timer timers[NUM_TIMERS];
 static unsigned int rand_shift, count;
 
+static struct timer stress[NUM_STRESS];
+static bool armed[NUM_STRESS];
+static uint64_t prev_stamp;
+static unsigned long fired;
+static bool churn;
+
 static void init_rand(void)
 {
 	unsigned long max = RAND_MAX;
@@ -38,6 +47,174 @@ static void expiry(struct timer *t, void *data)
 	count--;
 }
 
+static double now_secs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Mix of expiries spanning the first few levels of the wheel */
+static uint64_t stress_delay(void)
+{
+	switch (random() & 3) {
+	case 0:
+		return 1 + random() % 0x1000;
+	case 1:
+		return 1 + random() % 0x40000;
+	case 2:
+		return 1 + random() % 0x1000000;
+	default:
+		return 1 + random() % 0x10000000;
+	}
+}
+
+static void stress_arm(unsigned int i)
+{
+	if (!armed[i])
+		count++;
+	armed[i] = true;
+	schedule_timer(&stress[i], stress_delay());
+}
+
+static void stress_expiry(struct timer *t, void *data)
+{
+	unsigned int i = (unsigned long)data;
+
+	/* Fired exactly once, not early, and not at a later check than
+	 * the first one where it was due
+	 */
+	assert(armed[i]);
+	assert(t->target <= stamp);
+	assert(t->target > prev_stamp);
+	armed[i] = false;
+	count--;
+	fired++;
+
+	/* Drivers commonly re-arm from the expiry */
+	if (churn && !(random() & 3))
+		stress_arm(i);
+}
+
+static void stress_test(void)
+{
+	unsigned long checks = 0, ops = 0;
+	unsigned int i, j;
+	double start, secs;
+
+	count = 0;
+	for (i = 0; i < NUM_STRESS; i++) {
+		init_timer(&stress[i], stress_expiry, (void *)(unsigned long)i);
+		stress_arm(i);
+	}
+
+	churn = true;
+	start = now_secs();
+	while (count) {
+		check_timers(false);
+		checks++;
+		prev_stamp = stamp;
+		stamp += 1 + random() % 0x10000;
+
+		if (checks == STRESS_CHECKS)
+			churn = false;
+		if (!churn)
+			continue;
+
+		/* Cancel or move some timers around from the outside */
+		for (j = 0; j < 8; j++, ops++) {
+			i = random() % NUM_STRESS;
+			if (armed[i] && (random() & 1)) {
+				cancel_timer(&stress[i]);
+				armed[i] = false;
+				count--;
+			} else
+				stress_arm(i);
+		}
+	}
+	secs = now_secs() - start;
+	for (i = 0; i < NUM_STRESS; i++)
+		assert(!stress[i].link.next);
+	assert(timer_next == TIMER_POLL);
+	printf("%lu expiries, %lu schedule/cancel over %lu checks in %.3f secs\n",
+	       fired, ops, checks, secs);
+
+	/* Raw schedule + cancel cost with thousands of timers pending */
+	for (i = 0; i < NUM_STRESS; i++)
+		schedule_timer(&stress[i], stress_delay());
+	start = now_secs();
+	for (j = 0; j < 256; j++)
+		for (i = 0; i < NUM_STRESS; i++) {
+			schedule_timer(&stress[i], stress_delay());
+			if (i & 1)
+				cancel_timer(&stress[i]);
+		}
+	secs = now_secs() - start;
+	printf("%u schedule/cancel in %.3f secs: %.0f ops/sec\n",
+	       256 * NUM_STRESS * 3 / 2, secs,
+	       256 * NUM_STRESS * 3 / 2 / secs);
+	for (i = 0; i < NUM_STRESS; i++)
+		cancel_timer(&stress[i]);
+}
+
+static unsigned int far_count;
+
+static void far_expiry(struct timer *t, void *data)
+{
+	(void)data;
+	assert(t->target == stamp);
+	far_count++;
+}
+
+/* Expiries beyond the wheel range get re-filed until they are due */
+static void far_test(void)
+{
+	struct timer t;
+	uint64_t target = stamp + (3ul << 50);
+
+	init_timer(&t, far_expiry, NULL);
+	schedule_timer_at(&t, target);
+	while (stamp < target - 1) {
+		stamp += 1ul << 44;
+		if (stamp > target - 1)
+			stamp = target - 1;
+		check_timers(false);
+		assert(!far_count);
+	}
+	stamp = target;
+	check_timers(false);
+	assert(far_count == 1);
+	assert(!t.link.next);
+}
+
+static unsigned int poll_count;
+
+static void poll_expiry(struct timer *t, void *data)
+{
+	(void)data;
+	poll_count++;
+	schedule_timer(t, TIMER_POLL);
+}
+
+/* A poll timer re-arming itself runs once per poll */
+static void poll_test(void)
+{
+	struct timer t;
+	unsigned int i;
+
+	init_timer(&t, poll_expiry, NULL);
+	schedule_timer(&t, TIMER_POLL);
+	for (i = 0; i < 10; i++)
+		check_timers(false);
+	assert(poll_count == 10);
+	check_timers(true);
+	assert(poll_count == 10);
+	cancel_timer(&t);
+	check_timers(false);
+	assert(poll_count == 10);
+}
+
 int main(void)
 {
 	unsigned int i;
@@ -52,5 +229,9 @@ int main(void)
 		check_timers(false);
 		stamp++;
 	}
+
+	stress_test();
+	far_test();
+	poll_test();
 	return 0;
 }
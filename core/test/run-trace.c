@@ -25,6 +25,7 @@
 #include <stdbool.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/time.h>
 
 /* Don't include these: PPC-specific */
 #define __CPU_H
@@ -63,6 +64,9 @@ static struct cpu_thread *this_cpu(void);
 
 static struct cpu_thread fake_cpus[CPUS];
 
+/* Pairs of fake cpus form a core, see main() */
+static unsigned int cpu_thread_count = 2;
+
 static inline struct cpu_thread *next_cpu(struct cpu_thread *cpu)
 {
 	if (cpu == NULL)
@@ -137,8 +141,11 @@ static void write_trace_entries(int id)
 	void exit(int);
 	unsigned int i;
 	union trace trace;
+	struct timeval start, end;
+	double usecs;
 
 	timestamp = id;
+	gettimeofday(&start, NULL);
 	for (i = 0; i < PER_CHILD_TRACES; i++) {
 		timestamp = i * CPUS + id;
 		assert(sizeof(trace.hdr) % 8 == 0);
@@ -147,8 +154,17 @@ static void write_trace_entries(int id)
 			  sizeof(trace.hdr));
 	}
 
+	gettimeofday(&end, NULL);
+
 	/* Final entry has special type, so parent knows it's over. */
 	trace_add(&trace, 0x70, sizeof(trace.hdr));
+
+	/* All writers run at once against a concurrent reader */
+	usecs = (end.tv_sec - start.tv_sec) * 1000000.0
+		+ (end.tv_usec - start.tv_usec);
+	printf("Child %i: %u records in %.0f usecs (%.0f records/sec)\n",
+	       id, PER_CHILD_TRACES, usecs,
+	       usecs ? PER_CHILD_TRACES * 1000000.0 / usecs : 0.0);
 	exit(0);
 }
 
@@ -259,7 +275,7 @@ int main(void)
 	union trace minimal;
 	union trace large;
 	union trace trace;
-	unsigned int i, j;
+	unsigned int i, j, tbuf_sz;
 
 	opal_node = dt_new_root("opal");
 	for (i = 0; i < CPUS; i++) {
@@ -270,10 +286,18 @@ int main(void)
 	init_trace_buffers();
 	my_fake_cpu = &fake_cpus[0];
 
+	/* Every thread gets its own, unshared, half-sized buffer. */
 	for (i = 0; i < CPUS; i++) {
+		for (j = 0; j < i; j++)
+			assert(fake_cpus[i].trace != fake_cpus[j].trace);
+		assert(!fake_cpus[i].trace->shared);
+		assert(be64_to_cpu(fake_cpus[i].trace->tb.mask) + 1
+		       == TBUF_SZ / cpu_thread_count);
 		assert(trace_empty(&fake_cpus[i].trace->tb));
 		assert(!trace_get(&trace, &fake_cpus[i].trace->tb));
 	}
+	assert(debug_descriptor.num_traces == CPUS + 1);
+	tbuf_sz = be64_to_cpu(my_fake_cpu->trace->tb.mask) + 1;
 
 	assert(sizeof(trace.hdr) % 8 == 0);
 	timestamp = 1;
@@ -283,7 +307,7 @@ int main(void)
 	assert(be64_to_cpu(trace.hdr.timestamp) == timestamp);
 
 	/* Make it wrap once. */
-	for (i = 0; i < TBUF_SZ / (minimal.hdr.len_div_8 * 8) + 1; i++) {
+	for (i = 0; i < tbuf_sz / (minimal.hdr.len_div_8 * 8) + 1; i++) {
 		timestamp = i;
 		trace_add(&minimal, 99 + (i%2), sizeof(trace.hdr));
 	}
@@ -294,7 +318,7 @@ int main(void)
 	assert(trace.hdr.len_div_8 * 8 == sizeof(trace.overflow));
 	assert(be64_to_cpu(trace.overflow.bytes_missed) == minimal.hdr.len_div_8 * 8);
 
-	for (i = 0; i < TBUF_SZ / (minimal.hdr.len_div_8 * 8); i++) {
+	for (i = 0; i < tbuf_sz / (minimal.hdr.len_div_8 * 8); i++) {
 		assert(trace_get(&trace, &my_fake_cpu->trace->tb));
 		assert(trace.hdr.len_div_8 == minimal.hdr.len_div_8);
 		assert(be64_to_cpu(trace.hdr.timestamp) == i+1);
@@ -305,7 +329,7 @@ int main(void)
 	/* Now put in some weird-length ones, to test overlap.
 	 * Last power of 2, minus 8. */
 	for (j = 0; (1 << j) < sizeof(large); j++);
-	for (i = 0; i < TBUF_SZ; i++) {
+	for (i = 0; i < tbuf_sz; i++) {
 		timestamp = i;
 		trace_add(&large, 100 + (i%2), (1 << (j-1)));
 	}
@@ -364,7 +388,7 @@ int main(void)
 	assert(trace.hdr.len_div_8 == minimal.hdr.len_div_8);
 	assert(trace.hdr.type == 100);
 
-	for (i = 1; i < TBUF_SZ; i++) {
+	for (i = 1; i < tbuf_sz; i++) {
 		timestamp = i;
 		trace_add(&minimal, 100, sizeof(trace.hdr));
 		assert(trace_get(&trace, &my_fake_cpu->trace->tb));
@@ -381,8 +405,7 @@ int main(void)
 	}
 
 	for (i = 0; i < CPUS; i++)
-		if (!fake_cpus[i].is_secondary)
-			free(fake_cpus[i].trace);
+		free(fake_cpus[i].trace);
 
 	test_parallel();
 
@@ -13,11 +13,44 @@
 #endif
 
 static struct lock timer_lock = LOCK_UNLOCKED;
-static LIST_HEAD(timer_list);
 static LIST_HEAD(timer_poll_list);
 static bool timer_in_poll;
 static uint64_t timer_poll_gen;
 
+/*
+ * Timers with an expiry are kept in a hierarchical timing wheel so
+ * that scheduling and cancelling are O(1) regardless of how many
+ * timers are pending.
+ *
+ * Time is divided in ticks of TIMER_TICK_SHIFT timebase units. Each
+ * level has TIMER_WHEEL_SLOTS slots, a slot at level n covering
+ * TIMER_WHEEL_SLOTS^n ticks. A timer is put at the lowest level whose
+ * range covers its expiry, and is moved down ("cascaded") when the
+ * wheel reaches the start of its slot. Level 0 slots thus only hold
+ * timers expiring within that tick, which are compared to the exact
+ * timebase before being run.
+ *
+ * timer_wheel_pending has a bit per slot that may contain timers.
+ * Bits are cleared lazily when a slot is found empty, and are used
+ * to jump over idle periods without walking every tick.
+ */
+#define TIMER_TICK_SHIFT	12	/* 8us at 512MHz */
+#define TIMER_WHEEL_BITS	6
+#define TIMER_WHEEL_SLOTS	(1ul << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK	(TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVELS	6
+#define TIMER_WHEEL_MAX		((1ul << (TIMER_WHEEL_BITS * \
+					  TIMER_WHEEL_LEVELS)) - 1)
+
+static struct list_head timer_wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+static uint64_t timer_wheel_pending[TIMER_WHEEL_LEVELS];
+static uint64_t timer_wheel_now;
+static unsigned long timer_wheel_count;
+static bool timer_wheel_ready;
+
+/* Lower bound of the next expiry, for the lockless check */
+static uint64_t timer_next = TIMER_POLL;
+
 void init_timer(struct timer *t, timer_func_t expiry, void *data)
 {
 	t->link.next = t->link.prev = NULL;
@@ -27,10 +60,96 @@ void init_timer(struct timer *t, timer_func_t expiry, void *data)
 	t->running = NULL;
 }
 
+static void __init_timer_wheel(void)
+{
+	unsigned int i, j;
+
+	for (i = 0; i < TIMER_WHEEL_LEVELS; i++)
+		for (j = 0; j < TIMER_WHEEL_SLOTS; j++)
+			list_head_init(&timer_wheel[i][j]);
+	timer_wheel_now = mftb() >> TIMER_TICK_SHIFT;
+	timer_wheel_ready = true;
+}
+
+static void __timer_wheel_add(struct timer *t)
+{
+	uint64_t expires = t->target >> TIMER_TICK_SHIFT;
+	uint64_t delta;
+	unsigned int level, slot;
+
+	if (expires < timer_wheel_now)
+		expires = timer_wheel_now;
+	delta = expires - timer_wheel_now;
+
+	/* Too far out, park it at the end, it will be re-filed when
+	 * cascaded
+	 */
+	if (delta > TIMER_WHEEL_MAX) {
+		delta = TIMER_WHEEL_MAX;
+		expires = timer_wheel_now + delta;
+	}
+
+	for (level = 0; level < TIMER_WHEEL_LEVELS - 1; level++)
+		if (delta < (1ul << (TIMER_WHEEL_BITS * (level + 1))))
+			break;
+	slot = (expires >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+	list_add_tail(&timer_wheel[level][slot], &t->link);
+	timer_wheel_pending[level] |= 1ul << slot;
+}
+
 static void __remove_timer(struct timer *t)
 {
 	list_del(&t->link);
 	t->link.next = t->link.prev = NULL;
+	if (t->target != TIMER_POLL)
+		timer_wheel_count--;
+}
+
+/* Re-file the timers of the slots starting at the current tick */
+static void __timer_wheel_cascade(void)
+{
+	unsigned int level, shift, slot;
+	struct timer *t;
+
+	for (level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+		shift = TIMER_WHEEL_BITS * level;
+		if (timer_wheel_now & ((1ul << shift) - 1))
+			break;
+		slot = (timer_wheel_now >> shift) & TIMER_WHEEL_MASK;
+		if (!(timer_wheel_pending[level] & (1ul << slot)))
+			continue;
+		timer_wheel_pending[level] &= ~(1ul << slot);
+
+		/* Timers never get re-filed in the slot they come from */
+		while ((t = list_pop(&timer_wheel[level][slot],
+				     struct timer, link)) != NULL)
+			__timer_wheel_add(t);
+	}
+}
+
+/*
+ * Return the first tick after the current one at which the wheel has
+ * work to do, ie, a level 0 slot to run or a slot to cascade.
+ */
+static uint64_t __timer_wheel_next_event(void)
+{
+	unsigned int level, shift, slot;
+	uint64_t ahead, base;
+
+	for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+		if (!timer_wheel_pending[level])
+			continue;
+		shift = TIMER_WHEEL_BITS * level;
+		slot = (timer_wheel_now >> shift) & TIMER_WHEEL_MASK;
+		base = (timer_wheel_now >> shift) & ~TIMER_WHEEL_MASK;
+		ahead = timer_wheel_pending[level] & ~((2ul << slot) - 1);
+		if (ahead)
+			return (base | __builtin_ctzl(ahead)) << shift;
+
+		/* Only slots of the next rotation */
+		return (base + TIMER_WHEEL_SLOTS) << shift;
+	}
+	return TIMER_POLL;
 }
 
 static void __sync_timer(struct timer *t)
@@ -74,9 +193,9 @@ void cancel_timer_async(struct timer *t)
 
 void schedule_timer_at(struct timer *t, uint64_t when)
 {
-	struct timer *lt;
-
 	lock(&timer_lock);
+	if (!timer_wheel_ready)
+		__init_timer_wheel();
 	if (t->link.next)
 		__remove_timer(t);
 	t->target = when;
@@ -84,15 +203,10 @@ void schedule_timer_at(struct timer *t, uint64_t when)
 		t->gen = timer_poll_gen;
 		list_add_tail(&timer_poll_list, &t->link);
 	} else {
-		list_for_each(&timer_list, lt, link) {
-			if (when < lt->target) {
-				list_add_before(&timer_list, &t->link,
-						&lt->link);
-				unlock(&timer_lock);
-				return;
-			}
-		}
-		list_add_tail(&timer_list, &t->link);
+		__timer_wheel_add(t);
+		timer_wheel_count++;
+		if (when < timer_next)
+			timer_next = when;
 	}
 	unlock(&timer_lock);
 }
@@ -164,22 +278,61 @@ static void __check_poll_timers(void)
 
 static void __check_timers(uint64_t now)
 {
-	struct timer *t;
+	struct list_head *slot;
+	struct timer *t, *lt;
+	uint64_t tick, next;
+	unsigned int idx;
+	bool busy;
 
-	for (;;) {
-		t = list_top(&timer_list, struct timer, link);
+	if (!timer_wheel_ready)
+		return;
 
-		/* Top of list not expired ? that's it ... */
-		if (!t || t->target > now)
+	for (;;) {
+		/* Look for an expired timer in the current tick */
+		idx = timer_wheel_now & TIMER_WHEEL_MASK;
+		slot = &timer_wheel[0][idx];
+		next = TIMER_POLL;
+		busy = false;
+		t = NULL;
+		list_for_each(slot, lt, link) {
+			if (lt->target > now) {
+				if (lt->target < next)
+					next = lt->target;
+				continue;
+			}
+			/* Still running, we have to delay handling it. For
+			 * now just skip until the next poll, when we have
+			 * SLW interrupts, we'll probably want to trip
+			 * another one ASAP
+			 */
+			if (lt->running) {
+				busy = true;
+				break;
+			}
+			t = lt;
 			break;
+		}
+		if (busy) {
+			timer_next = now;
+			return;
+		}
 
-		/* Top of list still running, we have to delay handling
-		 * it. For now just skip until the next poll, when we have
-		 * SLW interrupts, we'll probably want to trip another one
-		 * ASAP
-		 */
-		if (t->running)
-			break;
+		if (!t) {
+			if (list_empty(slot))
+				timer_wheel_pending[0] &= ~(1ul << idx);
+
+			/* Caught up ? that's it ... */
+			tick = now >> TIMER_TICK_SHIFT;
+			if (timer_wheel_now >= tick)
+				break;
+
+			/* Move on to the next tick with something to do */
+			timer_wheel_now = __timer_wheel_next_event();
+			if (timer_wheel_now > tick)
+				timer_wheel_now = tick;
+			__timer_wheel_cascade();
+			continue;
+		}
 
 		/* Allright, first remove it and mark it running */
 		__remove_timer(t);
@@ -196,11 +349,21 @@ static void __check_timers(uint64_t now)
 		/* Update time stamp */
 		now = mftb();
 	}
+
+	/* Nothing expired, work out when we next need the lock */
+	if (!timer_wheel_count)
+		timer_next = TIMER_POLL;
+	else {
+		uint64_t event = __timer_wheel_next_event();
+
+		if (event != TIMER_POLL && (event << TIMER_TICK_SHIFT) < next)
+			next = event << TIMER_TICK_SHIFT;
+		timer_next = next;
+	}
 }
 
 void check_timers(bool from_interrupt)
 {
-	struct timer *t;
 	uint64_t now = mftb();
 
 	/* This is the polling variant, the SLW interrupt path, when it
@@ -209,8 +372,7 @@ void check_timers(bool from_interrupt)
 	 */
 
 	/* Lockless "peek", a bit racy but shouldn't be a problem */
-	t = list_top(&timer_list, struct timer, link);
-	if (list_empty(&timer_poll_list) && (!t || t->target > now))
+	if (list_empty(&timer_poll_list) && timer_next > now)
 		return;
 
 	/* Take lock and try again */
@@ -32,6 +32,9 @@
 
 /* Smaller trace buffer for early booting */
 #define BOOT_TBUF_SZ 65536
+
+/* Smallest per-thread buffer we split a core's TBUF_SZ down to */
+#define MIN_TBUF_SZ 65536
 static struct {
 	struct trace_info trace_info;
 	char buf[BOOT_TBUF_SZ + MAX_SIZE];
@@ -40,16 +43,35 @@ static struct {
 void init_boot_tracebuf(struct cpu_thread *boot_cpu)
 {
 	init_lock(&boot_tracebuf.trace_info.lock);
+	/* Every CPU writes here until init_trace_buffers() */
+	boot_tracebuf.trace_info.shared = true;
 	boot_tracebuf.trace_info.tb.mask = BOOT_TBUF_SZ - 1;
 	boot_tracebuf.trace_info.tb.max_size = MAX_SIZE;
 
 	boot_cpu->trace = &boot_tracebuf.trace_info;
 }
 
+/*
+ * Each thread has its own buffer so the writer never needs a lock. To
+ * keep the memory (and TCE) footprint the same as one buffer per core,
+ * a core's TBUF_SZ is split between its threads.
+ */
+static size_t tracebuf_size(void)
+{
+	unsigned int threads = cpu_thread_count;
+	size_t size = TBUF_SZ;
+
+	while (threads > 1 && size > MIN_TBUF_SZ) {
+		threads >>= 1;
+		size >>= 1;
+	}
+	return size;
+}
+
 static size_t tracebuf_extra(void)
 {
 	/* We make room for the largest possible record */
-	return TBUF_SZ + MAX_SIZE;
+	return tracebuf_size() + MAX_SIZE;
 }
 
 /* To avoid bloating each entry, repeats are actually specific entries.
@@ -78,7 +100,6 @@ static bool handle_repeat(struct tracebuf *tb, const union trace *trace)
 	/* OK, it's a duplicate.  Do we already have repeat? */
 	if (be64_to_cpu(tb->last) + len != be64_to_cpu(tb->end)) {
 		u64 pos = be64_to_cpu(tb->last) + len;
-		/* FIXME: Reader is not protected from seeing this! */
 		rpt = (void *)tb->buf + (pos & be64_to_cpu(tb->mask));
 		assert(pos + rpt->len_div_8*8 == be64_to_cpu(tb->end));
 		assert(rpt->type == TRACE_REPEAT);
@@ -87,8 +108,15 @@ static bool handle_repeat(struct tracebuf *tb, const union trace *trace)
 		if (be16_to_cpu(rpt->num) == 0xFFFF)
 			return false;
 
-		rpt->num = cpu_to_be16(be16_to_cpu(rpt->num) + 1);
+		/*
+		 * The reader may be looking at this record. It reads num
+		 * before timestamp, so update them in the opposite order:
+		 * a reader then sees a timestamp at least as recent as the
+		 * count, at worst one repeat short (see trace_types.h).
+		 */
 		rpt->timestamp = trace->hdr.timestamp;
+		lwsync(); /* write barrier: timestamp before count */
+		rpt->num = cpu_to_be16(be16_to_cpu(rpt->num) + 1);
 		return true;
 	}
 
@@ -133,7 +161,13 @@ void trace_add(union trace *trace, u8 type, u16 len)
 	trace->hdr.timestamp = cpu_to_be64(mftb());
 	trace->hdr.cpu = cpu_to_be16(this_cpu()->server_no);
 
-	lock(&ti->lock);
+	/*
+	 * Per-thread buffers have a single writer and need no lock; only
+	 * the boot buffer (or a fallback shared one) is written by several
+	 * threads at once.
+	 */
+	if (ti->shared)
+		lock(&ti->lock);
 
 	/* Throw away old entries before we overwrite them. */
 	while ((be64_to_cpu(ti->tb.start) + be64_to_cpu(ti->tb.mask) + 1)
@@ -158,7 +192,9 @@ void trace_add(union trace *trace, u8 type, u16 len)
 		lwsync(); /* write barrier: write entry before exposing */
 		ti->tb.end = cpu_to_be64(be64_to_cpu(ti->tb.end) + tsz);
 	}
-	unlock(&ti->lock);
+
+	if (ti->shared)
+		unlock(&ti->lock);
 }
 
 static void trace_add_dt_props(void)
@@ -197,47 +233,72 @@ static void trace_add_desc(struct trace_info *t, uint64_t size)
 	debug_descriptor.trace_size[i] = size;
 }
 
+static struct trace_info *alloc_trace_buffer(struct cpu_thread *t)
+{
+	struct trace_info *ti;
+	uint64_t size;
+
+	/* Use a 4K alignment for TCE mapping */
+	size = ALIGN_UP(sizeof(*ti) + tracebuf_extra(), 0x1000);
+	ti = local_alloc(t->chip_id, size, 0x1000);
+	if (!ti)
+		return NULL;
+
+	memset(ti, 0, size);
+	init_lock(&ti->lock);
+	ti->tb.mask = cpu_to_be64(tracebuf_size() - 1);
+	ti->tb.max_size = cpu_to_be32(MAX_SIZE);
+	trace_add_desc(ti, sizeof(ti->tb) + tracebuf_extra());
+
+	return ti;
+}
+
 /* Allocate trace buffers once we know memory topology */
 void init_trace_buffers(void)
 {
 	struct cpu_thread *t;
 	struct trace_info *any = &boot_tracebuf.trace_info;
-	uint64_t size;
 
 	/* Boot the boot trace in the debug descriptor */
 	trace_add_desc(any, sizeof(boot_tracebuf.buf));
 
-	/* Allocate a trace buffer for each primary cpu. */
+	/*
+	 * Allocate a trace buffer for each cpu. Primaries go first so
+	 * that, should we run out of descriptor slots, every core still
+	 * has at least one buffer the host can see.
+	 */
 	for_each_cpu(t) {
 		if (t->is_secondary)
 			continue;
 
-		/* Use a 4K alignment for TCE mapping */
-		size = ALIGN_UP(sizeof(*t->trace) + tracebuf_extra(), 0x1000);
-		t->trace = local_alloc(t->chip_id, size, 0x1000);
-		if (t->trace) {
+		t->trace = alloc_trace_buffer(t);
+		if (t->trace)
 			any = t->trace;
-			memset(t->trace, 0, size);
-			init_lock(&t->trace->lock);
-			t->trace->tb.mask = cpu_to_be64(TBUF_SZ - 1);
-			t->trace->tb.max_size = cpu_to_be32(MAX_SIZE);
-			trace_add_desc(any, sizeof(t->trace->tb) +
-				       tracebuf_extra());
-		} else
+		else
 			prerror("TRACE: cpu 0x%x allocation failed\n", t->pir);
 	}
 
-	/* In case any allocations failed, share trace buffers. */
 	for_each_cpu(t) {
-		if (!t->is_secondary && !t->trace)
-			t->trace = any;
+		if (!t->is_secondary)
+			continue;
+
+		t->trace = NULL;
+		if (t->primary->trace &&
+		    debug_descriptor.num_traces < DEBUG_DESC_MAX_TRACES)
+			t->trace = alloc_trace_buffer(t);
+		if (!t->trace) {
+			t->trace = t->primary->trace;
+			if (t->trace)
+				t->trace->shared = true;
+		}
 	}
 
-	/* And copy those to the secondaries. */
+	/* In case any allocations failed, share trace buffers. */
 	for_each_cpu(t) {
-		if (!t->is_secondary)
-			continue;
-		t->trace = t->primary->trace;
+		if (!t->trace) {
+			t->trace = any;
+			any->shared = true;
+		}
 	}
 
 	/* Trace node in DT. */
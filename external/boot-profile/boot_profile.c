@@ -0,0 +1,281 @@
+/* Copyright 2016 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Render the boot profile skiboot leaves in the device-tree, either as
+ * a text timeline or as folded stacks for flamegraph.pl.
+ */
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include "../../ccan/endian/endian.h"
+#include "../../ccan/short_types/short_types.h"
+#include <boot_profile_types.h>
+
+#define DEFAULT_PATH	"/proc/device-tree/ibm,opal/boot-profile"
+
+struct mark {
+	u64		start, end;
+	u32		pir, arg;
+	u16		depth, parent, flags;
+	char		name[BOOT_PROF_NAME_LEN + 1];
+	bool		show_arg;
+	u64		child_ticks;
+};
+
+static struct mark *marks;
+static unsigned int nr_marks;
+static u64 tb_hz = 512000000;
+
+static void *read_file(const char *path, size_t *len)
+{
+	size_t size = 0, alloc = 4096;
+	char *buf = malloc(alloc);
+	FILE *f = fopen(path, "r");
+	size_t r;
+
+	if (!f)
+		return NULL;
+	while (buf && (r = fread(buf + size, 1, alloc - size, f)) > 0) {
+		size += r;
+		if (size == alloc)
+			buf = realloc(buf, alloc *= 2);
+	}
+	if (!buf)
+		errx(1, "Out of memory reading %s", path);
+	fclose(f);
+	*len = size;
+	return buf;
+}
+
+static void load(const char *dir, const char *file)
+{
+	struct boot_prof_rec *recs;
+	char path[4096];
+	size_t len;
+	unsigned int i, j;
+	__be32 *hz;
+
+	if (!file) {
+		snprintf(path, sizeof(path), "%s/timebase-frequency", dir);
+		hz = read_file(path, &len);
+		if (hz && len == sizeof(*hz))
+			tb_hz = be32_to_cpu(*hz);
+		free(hz);
+		snprintf(path, sizeof(path), "%s/entries", dir);
+		file = path;
+	}
+
+	recs = read_file(file, &len);
+	if (!recs)
+		err(1, "Opening %s", file);
+	if (len % sizeof(*recs))
+		errx(1, "%s: size %zu isn't a whole number of records",
+		     file, len);
+
+	nr_marks = len / sizeof(*recs);
+	marks = calloc(nr_marks, sizeof(*marks));
+	if (!marks)
+		errx(1, "Out of memory");
+
+	for (i = 0; i < nr_marks; i++) {
+		marks[i].start = be64_to_cpu(recs[i].start);
+		marks[i].end = be64_to_cpu(recs[i].end);
+		marks[i].pir = be32_to_cpu(recs[i].pir);
+		marks[i].arg = be32_to_cpu(recs[i].arg);
+		marks[i].depth = be16_to_cpu(recs[i].depth);
+		marks[i].parent = be16_to_cpu(recs[i].parent);
+		marks[i].flags = be16_to_cpu(recs[i].flags);
+		memcpy(marks[i].name, recs[i].name, BOOT_PROF_NAME_LEN);
+		if (marks[i].parent != BOOT_PROF_NO_PARENT &&
+		    marks[i].parent >= i)
+			errx(1, "%s: bad parent for record %u", file, i);
+	}
+	free(recs);
+
+	/* Only tell apart instances of a name that shows up more than once */
+	for (i = 0; i < nr_marks; i++)
+		for (j = 0; j < nr_marks; j++)
+			if (i != j && !strcmp(marks[i].name, marks[j].name))
+				marks[i].show_arg = true;
+}
+
+static bool usable(const struct mark *m)
+{
+	return !(m->flags & (BOOT_PROF_PRESYNC | BOOT_PROF_OPEN)) &&
+		m->end >= m->start;
+}
+
+static double ms(u64 ticks)
+{
+	return (double)ticks * 1000 / tb_hz;
+}
+
+static void print_name(const struct mark *m, int width)
+{
+	char buf[64];
+
+	if (m->show_arg)
+		snprintf(buf, sizeof(buf), "%*s%s:%u", m->depth * 2, "",
+			 m->name, m->arg);
+	else
+		snprintf(buf, sizeof(buf), "%*s%s", m->depth * 2, "", m->name);
+	printf("%-*s", width, buf);
+}
+
+static void timeline(unsigned int width)
+{
+	u64 origin = UINT64_MAX, last = 0;
+	unsigned int i, c, from, to;
+	struct mark *m;
+
+	for (i = 0; i < nr_marks; i++) {
+		m = &marks[i];
+		if (m->flags & BOOT_PROF_PRESYNC)
+			continue;
+		if (m->start < origin)
+			origin = m->start;
+		if (usable(m) && m->end > last)
+			last = m->end;
+	}
+
+	printf("Before timebase sync (durations only, approximate):\n");
+	for (i = 0; i < nr_marks; i++) {
+		m = &marks[i];
+		if (!(m->flags & BOOT_PROF_PRESYNC))
+			continue;
+		printf("  %04x  ", m->pir);
+		print_name(m, 32);
+		if (m->flags & BOOT_PROF_OPEN)
+			printf("   (not finished)\n");
+		else if (m->end < m->start)
+			printf("   (spans sync)\n");
+		else
+			printf(" %9.3f ms\n", ms(m->end - m->start));
+	}
+
+	if (origin == UINT64_MAX || last <= origin)
+		return;
+
+	printf("\nAfter timebase sync, %.3f ms:\n", ms(last - origin));
+	printf("  %-4s  %-32s %9s %9s\n", "cpu", "phase", "start", "ms");
+	for (i = 0; i < nr_marks; i++) {
+		m = &marks[i];
+		if (m->flags & BOOT_PROF_PRESYNC)
+			continue;
+		printf("  %04x  ", m->pir);
+		print_name(m, 32);
+		printf(" %9.3f", ms(m->start - origin));
+		if (m->flags & BOOT_PROF_OPEN)
+			printf(" %9s |", "-");
+		else
+			printf(" %9.3f |", ms(m->end - m->start));
+
+		from = (m->start - origin) * width / (last - origin);
+		to = usable(m) ? (m->end - origin) * width / (last - origin)
+			: width;
+		for (c = 0; c < width; c++)
+			putchar(c < from || c > to ? ' ' :
+				(m->flags & BOOT_PROF_OPEN) ? '-' : '#');
+		printf("|\n");
+	}
+}
+
+static void print_stack(unsigned int i)
+{
+	struct mark *m = &marks[i];
+
+	if (m->parent != BOOT_PROF_NO_PARENT) {
+		print_stack(m->parent);
+		putchar(';');
+	} else
+		printf("cpu %04x;", m->pir);
+
+	if (m->show_arg)
+		printf("%s:%u", m->name, m->arg);
+	else
+		printf("%s", m->name);
+}
+
+/* One line per phase: its stack and the time spent in it, not children */
+static void folded(void)
+{
+	unsigned int i;
+	struct mark *m;
+	u64 self;
+
+	for (i = 0; i < nr_marks; i++) {
+		m = &marks[i];
+		if (usable(m) && m->parent != BOOT_PROF_NO_PARENT)
+			marks[m->parent].child_ticks += m->end - m->start;
+	}
+
+	for (i = 0; i < nr_marks; i++) {
+		m = &marks[i];
+		if (!usable(m))
+			continue;
+		self = m->end - m->start;
+		self = self > m->child_ticks ? self - m->child_ticks : 0;
+		print_stack(i);
+		printf(" %" PRIu64 "\n", self * 1000000 / tb_hz);
+	}
+}
+
+static void usage(void)
+{
+	errx(1, "Usage: boot_profile [-f] [-w width] [-t tb_hz] [file]\n"
+	     "  -f  folded stacks in microseconds, for flamegraph.pl\n"
+	     "  Reads " DEFAULT_PATH " by default");
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int width = 60;
+	bool fold = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "fw:t:")) != -1) {
+		switch (opt) {
+		case 'f':
+			fold = true;
+			break;
+		case 'w':
+			width = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			tb_hz = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (argc - optind > 1 || !width || !tb_hz)
+		usage();
+
+	load(DEFAULT_PATH, argv[optind]);
+
+	if (fold)
+		folded();
+	else
+		timeline(width);
+
+	return 0;
+}
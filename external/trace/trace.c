@@ -64,6 +64,20 @@ again:
 	 */
 	memcpy(t, tb->buf + be64_to_cpu(tb->rpos & tb->mask), len);
 
+	/*
+	 * The writer updates a repeat in place, timestamp first and then
+	 * num. Re-read them in the opposite order so we never pair a count
+	 * with an older timestamp than the one it was written with.
+	 */
+	if (t->hdr.type == TRACE_REPEAT) {
+		const struct trace_repeat *rep;
+
+		rep = (void *)tb->buf + be64_to_cpu(tb->rpos & tb->mask);
+		t->repeat.num = *(volatile __be16 *)&rep->num;
+		rmb();
+		t->repeat.timestamp = *(volatile __be64 *)&rep->timestamp;
+	}
+
 	rmb(); /* read barrier, so we read tb->start after copying record. */
 
 	start = be64_to_cpu(tb->start);
@@ -45,6 +45,10 @@ static void *ntuple_addr(const struct spira_ntuple *n);
 #define __PROCESSOR_H
 #define PVR_TYPE(_pvr)	_pvr
 
+static inline void lwsync(void)
+{
+}
+
 /* PVR definitions */
 #define PVR_TYPE_P7	0x003f
 #define PVR_TYPE_P7P	0x004a
@@ -101,6 +105,18 @@ char __rodata_start[1], __rodata_end[1];
 
 enum proc_gen proc_gen = proc_gen_p7;
 
+void lock(struct lock *l)
+{
+	assert(!l->lock_val);
+	l->lock_val = 1;
+}
+
+void unlock(struct lock *l)
+{
+	assert(l->lock_val);
+	l->lock_val = 0;
+}
+
 static void *ntuple_addr(const struct spira_ntuple *n)
 {
 	uint64_t addr = be64_to_cpu(n->addr);
@@ -59,6 +59,19 @@
  */
 #define BT_MAX_QUEUE_LEN 10
 
+/*
+ * Maximum number of requests we keep outstanding at the BMC. The BMC
+ * tells us how many it takes via Get BT Interface Capabilities, until
+ * we have the answer we send one at a time.
+ */
+#define BT_MAX_INFLIGHT 4
+
+/*
+ * Number of sequence numbers, responses are matched back to their
+ * request through a table indexed by seq.
+ */
+#define BT_NUM_SEQ 256
+
 /*
  * How long (in TB ticks) before a message is timed out.
  */
@@ -69,6 +82,11 @@
  */
 #define BT_MAX_RETRY_COUNT 1
 
+/*
+ * How often (in TB ticks) the queue statistics are logged.
+ */
+#define BT_STATS_INTERVAL (secs_to_tb(60))
+
 #define BT_QUEUE_DEBUG 0
 
 #define BT_ERR(msg, fmt, args...) \
@@ -76,31 +94,50 @@
 	     (msg)->seq, (msg)->ipmi_msg.netfn, (msg)->ipmi_msg.cmd, ##args); \
 	} while(0)
 
-enum bt_states {
-	BT_STATE_IDLE = 0,
-	BT_STATE_RESP_WAIT,
-};
-
 struct bt_msg {
 	struct list_node link;
-	unsigned long tb;
+	unsigned long tb;		/* When sent, 0 while queued */
+	unsigned long queued_tb;
 	uint8_t seq;
 	uint8_t retry_count;
 	struct ipmi_msg ipmi_msg;
 };
 
+struct bt_prio_stats {
+	uint64_t msgs;			/* Completed */
+	uint64_t total_latency;		/* Queued to completed, TB ticks */
+	uint64_t max_latency;
+	uint32_t depth;			/* Currently waiting to be sent */
+	uint32_t max_depth;
+};
+
+struct bt_stats {
+	uint64_t sent;
+	uint64_t retries;
+	uint64_t timeouts;
+	uint64_t dropped;
+	uint64_t unmatched;		/* Responses nobody waited for */
+	uint32_t max_inflight;
+	unsigned long last_print;
+	struct bt_prio_stats prio[IPMI_PRIO_COUNT];
+};
+
 struct bt {
 	uint32_t base_addr;
-	enum bt_states state;
 	struct lock lock;
-	struct list_head msgq;
+	struct list_head msgq[IPMI_PRIO_COUNT];	/* Waiting to be sent */
+	struct list_head inflight;		/* Sent, oldest first */
+	struct bt_msg *seq_tbl[BT_NUM_SEQ];	/* Sent, by seq */
+	unsigned int inflight_count;
+	unsigned int max_inflight;
 	struct timer poller;
 	bool irq_ok;
 	int queue_len;
+	struct bt_stats stats;
 };
 static struct bt bt;
 
-static int ipmi_seq;
+static uint8_t ipmi_seq;
 
 static inline uint8_t bt_inb(uint32_t reg)
 {
@@ -128,15 +165,42 @@ static inline bool bt_idle(void)
 	return !(bt_ctrl & BT_CTRL_B_BUSY) && !(bt_ctrl & BT_CTRL_H2B_ATN);
 }
 
-static inline void bt_set_state(enum bt_states next_state)
+static inline bool bt_msg_inflight(struct bt_msg *bt_msg)
+{
+	return bt_msg->tb && bt.seq_tbl[bt_msg->seq] == bt_msg;
+}
+
+/* Queue a message to be sent, either first or last of its class */
+static void bt_msg_enqueue(struct bt_msg *bt_msg, bool head)
+{
+	enum ipmi_msg_prio prio = bt_msg->ipmi_msg.prio;
+	struct bt_prio_stats *ps = &bt.stats.prio[prio];
+
+	assert(prio < IPMI_PRIO_COUNT);
+	bt_msg->tb = 0;
+	if (head)
+		list_add(&bt.msgq[prio], &bt_msg->link);
+	else
+		list_add_tail(&bt.msgq[prio], &bt_msg->link);
+	if (++ps->depth > ps->max_depth)
+		ps->max_depth = ps->depth;
+}
+
+/* Take a message off the send queue or out of the in flight table */
+static void bt_msg_unlink(struct bt_msg *bt_msg)
 {
-	bt.state = next_state;
+	if (bt_msg_inflight(bt_msg)) {
+		bt.seq_tbl[bt_msg->seq] = NULL;
+		bt.inflight_count--;
+	} else
+		bt.stats.prio[bt_msg->ipmi_msg.prio].depth--;
+	list_del(&bt_msg->link);
 }
 
 /* Must be called with bt.lock held */
 static void bt_msg_del(struct bt_msg *bt_msg)
 {
-	list_del(&bt_msg->link);
+	bt_msg_unlink(bt_msg);
 	bt.queue_len--;
 	unlock(&bt.lock);
 	ipmi_cmd_done(bt_msg->ipmi_msg.cmd,
@@ -145,6 +209,18 @@ static void bt_msg_del(struct bt_msg *bt_msg)
 	lock(&bt.lock);
 }
 
+/* Put everything the BMC was working on back at the head of the
+ * send queues, eg. after the interface has been reset. */
+static void bt_requeue_inflight(void)
+{
+	struct bt_msg *bt_msg;
+
+	while ((bt_msg = list_tail(&bt.inflight, struct bt_msg, link))) {
+		bt_msg_unlink(bt_msg);
+		bt_msg_enqueue(bt_msg, true);
+	}
+}
+
 static void bt_init_interface(void)
 {
 	/* Clear interrupt condition & enable irq */
@@ -152,8 +228,6 @@ static void bt_init_interface(void)
 
 	/* Take care of a stable H_BUSY if any */
 	bt_set_h_busy(false);
-
-	bt_set_state(BT_STATE_IDLE);
 }
 
 static void bt_reset_interface(void)
@@ -162,20 +236,55 @@ static void bt_reset_interface(void)
 	bt_init_interface();
 }
 
-/* Try and send a message from the message queue. Caller must hold
- * bt.bt_lock and bt.lock and ensue the message queue is not
- * empty. */
+static struct bt_msg *bt_next_msg(void)
+{
+	struct bt_msg *bt_msg;
+	int prio;
+
+	for (prio = 0; prio < IPMI_PRIO_COUNT; prio++) {
+		bt_msg = list_top(&bt.msgq[prio], struct bt_msg, link);
+		if (bt_msg)
+			return bt_msg;
+	}
+	return NULL;
+}
+
+/* Sequence numbers are handed out in order, skipping any still in use
+ * by a request the BMC hasn't answered. */
+static uint8_t bt_alloc_seq(void)
+{
+	int i;
+
+	for (i = 0; i < BT_NUM_SEQ; i++, ipmi_seq++)
+		if (!bt.seq_tbl[ipmi_seq])
+			break;
+	assert(i < BT_NUM_SEQ);
+	return ipmi_seq++;
+}
+
+/* Send the highest priority message waiting. Caller must hold bt.lock
+ * and ensure a message is waiting and the interface can take it. */
 static void bt_send_msg(void)
 {
 	int i;
 	struct bt_msg *bt_msg;
 	struct ipmi_msg *ipmi_msg;
 
-	bt_msg = list_top(&bt.msgq, struct bt_msg, link);
+	bt_msg = bt_next_msg();
 	assert(bt_msg);
 
 	ipmi_msg = &bt_msg->ipmi_msg;
 
+	/* Move it to the in flight table */
+	bt.stats.prio[ipmi_msg->prio].depth--;
+	list_del(&bt_msg->link);
+	bt_msg->seq = bt_alloc_seq();
+	bt.seq_tbl[bt_msg->seq] = bt_msg;
+	list_add_tail(&bt.inflight, &bt_msg->link);
+	if (++bt.inflight_count > bt.stats.max_inflight)
+		bt.stats.max_inflight = bt.inflight_count;
+	bt.stats.sent++;
+
 	/* Send the message */
 	bt_outb(BT_CTRL_CLR_WR_PTR, BT_CTRL);
 
@@ -197,7 +306,6 @@ static void bt_send_msg(void)
 
 	bt_msg->tb = mftb();
 	bt_outb(BT_CTRL_H2B_ATN, BT_CTRL);
-	bt_set_state(BT_STATE_RESP_WAIT);
 
 	return;
 }
@@ -208,10 +316,21 @@ static void bt_flush_msg(void)
 	bt_set_h_busy(false);
 }
 
+static void bt_account_done(struct bt_msg *bt_msg)
+{
+	struct bt_prio_stats *ps = &bt.stats.prio[bt_msg->ipmi_msg.prio];
+	unsigned long latency = mftb() - bt_msg->queued_tb;
+
+	ps->msgs++;
+	ps->total_latency += latency;
+	if (latency > ps->max_latency)
+		ps->max_latency = latency;
+}
+
 static void bt_get_resp(void)
 {
 	int i;
-	struct bt_msg *tmp_bt_msg, *bt_msg = NULL;
+	struct bt_msg *bt_msg;
 	struct ipmi_msg *ipmi_msg;
 	uint8_t resp_len, netfn, seq, cmd;
 	uint8_t cc = IPMI_CC_NO_ERROR;
@@ -240,18 +359,12 @@ static void bt_get_resp(void)
 	cc = bt_inb(BT_HOST2BMC);
 
 	/* Find the corresponding message */
-	list_for_each(&bt.msgq, tmp_bt_msg, link) {
-		if (tmp_bt_msg->seq == seq) {
-			bt_msg = tmp_bt_msg;
-			break;
-		}
-
-	}
+	bt_msg = bt.seq_tbl[seq];
 	if (!bt_msg) {
 		/* A response to a message we no longer care about. */
 		prlog(PR_INFO, "BT: Nobody cared about a response to an BT/IPMI message\n");
+		bt.stats.unmatched++;
 		bt_flush_msg();
-		bt_set_state(BT_STATE_IDLE);
 		return;
 	}
 
@@ -274,10 +387,9 @@ static void bt_get_resp(void)
 		ipmi_msg->data[i] = bt_inb(BT_HOST2BMC);
 	bt_set_h_busy(false);
 
-	bt_set_state(BT_STATE_IDLE);
-
-	list_del(&bt_msg->link);
+	bt_msg_unlink(bt_msg);
 	bt.queue_len--;
+	bt_account_done(bt_msg);
 	unlock(&bt.lock);
 
 	/*
@@ -299,42 +411,82 @@ static void bt_expire_old_msg(void)
 	struct bt_msg *bt_msg;
 
 	tb = mftb();
-	bt_msg = list_top(&bt.msgq, struct bt_msg, link);
+	bt_msg = list_top(&bt.inflight, struct bt_msg, link);
 
-	if (bt_msg && bt_msg->tb > 0 && (bt_msg->tb + BT_MSG_TIMEOUT) < tb) {
+	if (bt_msg && (bt_msg->tb + BT_MSG_TIMEOUT) < tb) {
 		if (bt_msg->retry_count < BT_MAX_RETRY_COUNT) {
 			/* A message timeout is usually due to the BMC
 			clearing the H2B_ATN flag without actually
-			doing anything. The data will still be in the
-			FIFO so just reset the flag.*/
+			doing anything. Other requests may have gone
+			through the FIFO since, so send it again in
+			full. It gets a new seq and a late response
+			to the old one is dropped. */
 			BT_ERR(bt_msg, "Retry sending message");
 			bt_msg->retry_count++;
-			bt_msg->tb = mftb();
-			bt_outb(BT_CTRL_H2B_ATN, BT_CTRL);
+			bt.stats.retries++;
+			bt_msg_unlink(bt_msg);
+			bt_msg_enqueue(bt_msg, true);
 		} else {
 			BT_ERR(bt_msg, "Timeout sending message");
+			bt.stats.timeouts++;
 			bt_msg_del(bt_msg);
 
 			/* Timing out a message is inherently racy as the BMC
 			   may start writing just as we decide to kill the
 			   message. Hopefully resetting the interface is
-			   sufficient to guard against such things. */
+			   sufficient to guard against such things. The
+			   reset loses whatever else the BMC was working
+			   on, so send that again. */
 			bt_reset_interface();
+			bt_requeue_inflight();
 		}
 	}
 }
 
+static void bt_print_stats(void)
+{
+	struct bt_prio_stats *ps;
+	int prio;
+
+	prlog(PR_DEBUG, "BT: sent %llu retries %llu timeouts %llu dropped %llu"
+	      " unmatched %llu, max in flight %u/%u\n",
+	      (unsigned long long)bt.stats.sent,
+	      (unsigned long long)bt.stats.retries,
+	      (unsigned long long)bt.stats.timeouts,
+	      (unsigned long long)bt.stats.dropped,
+	      (unsigned long long)bt.stats.unmatched,
+	      bt.stats.max_inflight, bt.max_inflight);
+	for (prio = 0; prio < IPMI_PRIO_COUNT; prio++) {
+		ps = &bt.stats.prio[prio];
+		if (!ps->msgs)
+			continue;
+		prlog(PR_DEBUG, "BT: prio %d: %llu msgs, depth %u (max %u),"
+		      " latency avg %lu us max %lu us\n", prio,
+		      (unsigned long long)ps->msgs, ps->depth, ps->max_depth,
+		      tb_to_usecs(ps->total_latency / ps->msgs),
+		      tb_to_usecs(ps->max_latency));
+	}
+}
+
 #if BT_QUEUE_DEBUG
 static void print_debug_queue_info(void)
 {
 	struct bt_msg *msg;
 	static bool printed = false;
+	int prio;
 
-	if (!list_empty(&bt.msgq)) {
+	if (bt.queue_len) {
 		printed = false;
 		prlog(PR_DEBUG, "-------- BT Msg Queue --------\n");
-		list_for_each(&bt.msgq, msg, link) {
-			prlog(PR_DEBUG, "Seq: 0x%02x Cmd: 0x%02x\n", msg->seq, msg->ipmi_msg.cmd);
+		list_for_each(&bt.inflight, msg, link) {
+			prlog(PR_DEBUG, "Seq: 0x%02x Cmd: 0x%02x (in flight)\n",
+			      msg->seq, msg->ipmi_msg.cmd);
+		}
+		for (prio = 0; prio < IPMI_PRIO_COUNT; prio++) {
+			list_for_each(&bt.msgq[prio], msg, link) {
+				prlog(PR_DEBUG, "Prio: %d Cmd: 0x%02x\n",
+				      prio, msg->ipmi_msg.cmd);
+			}
 		}
 		prlog(PR_DEBUG, "-----------------------------\n");
 	} else if (!printed) {
@@ -348,8 +500,10 @@ static void print_debug_queue_info(void) {}
 
 static void bt_send_and_unlock(void)
 {
-	if (lpc_ok() && bt_idle() && !list_empty(&bt.msgq)
-	    && bt.state == BT_STATE_IDLE)
+	/* The BMC can take a new request as soon as it has picked up
+	 * the previous one, we don't wait for the response. */
+	if (lpc_ok() && bt.inflight_count < bt.max_inflight &&
+	    bt_next_msg() && bt_idle())
 		bt_send_msg();
 
 	unlock(&bt.lock);
@@ -358,7 +512,7 @@ static void bt_send_and_unlock(void)
 
 static void bt_poll(struct timer *t __unused, void *data __unused)
 {
-	uint8_t bt_ctrl;
+	unsigned int i;
 
 	/* Don't do anything if the LPC bus is offline */
 	if (!lpc_ok())
@@ -371,12 +525,13 @@ static void bt_poll(struct timer *t __unused, void *data __unused)
 	print_debug_queue_info();
 	bt_expire_old_msg();
 
-	bt_ctrl = bt_inb(BT_CTRL);
-
-	/* Is there a response waiting for us? */
-	if (bt.state == BT_STATE_RESP_WAIT &&
-	    (bt_ctrl & BT_CTRL_B2H_ATN))
+	/* Is there a response waiting for us? With several requests
+	 * out, the next one may be there as soon as we've read one. */
+	for (i = 0; i < bt.max_inflight; i++) {
+		if (!(bt_inb(BT_CTRL) & BT_CTRL_B2H_ATN))
+			break;
 		bt_get_resp();
+	}
 
 	/* Check for sms_atn */
 	if (bt_inb(BT_CTRL) & BT_CTRL_SMS_ATN) {
@@ -386,6 +541,11 @@ static void bt_poll(struct timer *t __unused, void *data __unused)
 		lock(&bt.lock);
 	}
 
+	if (mftb() - bt.stats.last_print > BT_STATS_INTERVAL) {
+		bt.stats.last_print = mftb();
+		bt_print_stats();
+	}
+
 	/* Send messages if we can. If the BMC was really quick we
 	   could loop back to the start and check for a response
 	   instead of unlocking, but testing shows the BMC isn't that
@@ -397,19 +557,27 @@ static void bt_poll(struct timer *t __unused, void *data __unused)
 		       bt.irq_ok ? TIMER_POLL : msecs_to_tb(BT_DEFAULT_POLL_MS));
 }
 
-static void bt_add_msg(struct bt_msg *bt_msg)
+/* Must be called with bt.lock held */
+static void bt_add_msg(struct bt_msg *bt_msg, bool head)
 {
-	bt_msg->tb = 0;
-	bt_msg->seq = ipmi_seq++;
+	int prio;
+
+	bt_msg->queued_tb = mftb();
 	bt_msg->retry_count = 0;
+	bt_msg_enqueue(bt_msg, head);
 	bt.queue_len++;
 	if (bt.queue_len > BT_MAX_QUEUE_LEN) {
-		/* Maximum queue length exceeded - remove the oldest message
-		   from the queue. */
+		/* Maximum queue length exceeded - drop the newest of the
+		   lowest priority messages still waiting to be sent. */
 		BT_ERR(bt_msg, "Maximum queue length exceeded");
-		bt_msg = list_tail(&bt.msgq, struct bt_msg, link);
+		for (prio = IPMI_PRIO_COUNT - 1; prio >= 0; prio--) {
+			bt_msg = list_tail(&bt.msgq[prio], struct bt_msg, link);
+			if (bt_msg)
+				break;
+		}
 		assert(bt_msg);
 		BT_ERR(bt_msg, "Removed from queue");
+		bt.stats.dropped++;
 		bt_msg_del(bt_msg);
 	}
 }
@@ -419,8 +587,7 @@ static int bt_add_ipmi_msg_head(struct ipmi_msg *ipmi_msg)
 	struct bt_msg *bt_msg = container_of(ipmi_msg, struct bt_msg, ipmi_msg);
 
 	lock(&bt.lock);
-	bt_add_msg(bt_msg);
-	list_add(&bt.msgq, &bt_msg->link);
+	bt_add_msg(bt_msg, true);
 	bt_send_and_unlock();
 
 	return 0;
@@ -431,8 +598,7 @@ static int bt_add_ipmi_msg(struct ipmi_msg *ipmi_msg)
 	struct bt_msg *bt_msg = container_of(ipmi_msg, struct bt_msg, ipmi_msg);
 
 	lock(&bt.lock);
-	bt_add_msg(bt_msg);
-	list_add_tail(&bt.msgq, &bt_msg->link);
+	bt_add_msg(bt_msg, false);
 	bt_send_and_unlock();
 
 	return 0;
@@ -491,7 +657,7 @@ static int bt_del_ipmi_msg(struct ipmi_msg *ipmi_msg)
 	struct bt_msg *bt_msg = container_of(ipmi_msg, struct bt_msg, ipmi_msg);
 
 	lock(&bt.lock);
-	list_del_from(&bt.msgq, &bt_msg->link);
+	bt_msg_unlink(bt_msg);
 	bt.queue_len--;
 	bt_send_and_unlock();
 	return 0;
@@ -505,6 +671,35 @@ static struct ipmi_backend bt_backend = {
 	.dequeue_msg = bt_del_ipmi_msg,
 };
 
+static void bt_caps_complete(struct ipmi_msg *msg)
+{
+	/* Byte 1 - Number of outstanding requests supported */
+	uint8_t nreq = msg->resp_size ? msg->data[0] : 1;
+
+	ipmi_free_msg(msg);
+
+	lock(&bt.lock);
+	bt.max_inflight = MIN(MAX(nreq, 1), BT_MAX_INFLIGHT);
+	unlock(&bt.lock);
+	prlog(PR_DEBUG, "BT: BMC takes %d outstanding requests, using %d\n",
+	      nreq, bt.max_inflight);
+}
+
+/* Ask the BMC how many requests it lets us have outstanding */
+static void bt_get_caps(void)
+{
+	struct ipmi_msg *msg;
+
+	msg = ipmi_mkmsg(IPMI_DEFAULT_INTERFACE, IPMI_GET_BT_CAPS,
+			 bt_caps_complete, NULL, NULL, 0, 5);
+	if (!msg) {
+		prerror("BT: Unable to allocate get caps message\n");
+		return;
+	}
+	msg->prio = IPMI_PRIO_HIGH;
+	ipmi_queue_msg(msg);
+}
+
 static struct lpc_client bt_lpc_client = {
 	.interrupt = bt_irq,
 };
@@ -514,6 +709,7 @@ void bt_init(void)
 	struct dt_node *n;
 	const struct dt_property *prop;
 	uint32_t irq;
+	int i;
 
 	/* We support only one */
 	n = dt_find_compatible_node(dt_root, NULL, "ipmi-bt");
@@ -536,17 +732,16 @@ void bt_init(void)
 	bt_init_interface();
 	init_lock(&bt.lock);
 
-	/*
-	 * The iBT interface comes up in the busy state until the daemon has
-	 * initialised it.
-	 */
-	bt_set_state(BT_STATE_IDLE);
-	list_head_init(&bt.msgq);
+	for (i = 0; i < IPMI_PRIO_COUNT; i++)
+		list_head_init(&bt.msgq[i]);
+	list_head_init(&bt.inflight);
 	bt.queue_len = 0;
+	bt.max_inflight = 1;
 
 	printf("BT: Interface initialized, IO 0x%04x\n", bt.base_addr);
 
 	ipmi_register_backend(&bt_backend);
+	bt_get_caps();
 
 	/* We initially schedule the poller as a relatively fast timer, at
 	 * least until we have at least one interrupt occurring at which
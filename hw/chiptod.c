@@ -26,6 +26,7 @@
 #include <cpu.h>
 #include <timebase.h>
 #include <opal-api.h>
+#include <boot-profile.h>
 
 /* TOD chip XSCOM addresses */
 #define TOD_MASTER_PATH_CTRL		0x00040000 /* Master Path ctrl reg */
@@ -1706,6 +1707,7 @@ void chiptod_init(void)
 {
 	struct cpu_thread *cpu0, *cpu;
 	bool sres;
+	int mark;
 
 	/* Mambo and qemu doesn't simulate the chiptod */
 	if (chip_quirk(QUIRK_NO_CHIPTOD))
@@ -1731,8 +1733,10 @@ void chiptod_init(void)
 
 	/* Schedule master sync */
 	sres = false;
+	mark = boot_prof_begin("chiptod-master", chiptod_primary);
 	cpu_wait_job(cpu_queue_job(cpu0, "chiptod_sync_master",
 				   chiptod_sync_master, &sres), true);
+	boot_prof_end(mark);
 	if (!sres) {
 		op_display(OP_FATAL, OP_MOD_CHIPTOD, 2);
 		abort();
@@ -1741,6 +1745,7 @@ void chiptod_init(void)
 	op_display(OP_LOG, OP_MOD_CHIPTOD, 2);
 
 	/* Schedule slave sync */
+	mark = boot_prof_begin("chiptod-slaves", 0);
 	for_each_available_cpu(cpu) {
 		/* Skip master */
 		if (cpu == cpu0)
@@ -1759,6 +1764,7 @@ void chiptod_init(void)
 		}
 		op_display(OP_LOG, OP_MOD_CHIPTOD, 3|(cpu->pir << 8));
 	}
+	boot_prof_end(mark);
 
 	/* Display TBs */
 	for_each_available_cpu(cpu) {
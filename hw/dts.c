@@ -20,6 +20,10 @@
 #include <dts.h>
 #include <skiboot.h>
 #include <opal-api.h>
+#include <lock.h>
+#include <timer.h>
+#include <timebase.h>
+#include <platform.h>
 
 /* Per core Digital Thermal Sensors */
 #define EX_THERM_DTS_RESULT0	0x10050000
@@ -44,6 +48,54 @@ struct dts {
 	int16_t		temp;
 };
 
+/*
+ * Sensor reads are answered from a per-chip cache of the cores' DTS
+ * result registers. While the OS keeps reading them, a timer refreshes
+ * it in the background, one batch of SCOMs per chip. The timer stops
+ * once nobody read a sensor for DTS_IDLE_SAMPLES sampling periods, the
+ * next read starts it again. A read finding its chip's sample too old
+ * refreshes it first. The platform can tune both the sampling period
+ * and the maximum age, in milliseconds.
+ */
+#define DTS_SAMPLE_MS		1000
+#define DTS_IDLE_SAMPLES	10
+#define DTS_MAX_CORES		16
+#define DTS_CORE_REGS		2
+
+struct dts_chip {
+	struct lock	lock;
+	uint32_t	chip_id;
+	uint64_t	stamp;		/* Timebase of the last sample, 0: none */
+	unsigned int	nops;
+	int8_t		core_op[DTS_MAX_CORES];	/* Index in ops, -1: none */
+	struct xscom_op	ops[DTS_MAX_CORES * DTS_CORE_REGS];
+};
+
+static struct dts_chip *dts_chips[MAX_CHIPS];
+static struct timer dts_sampler;
+static struct lock dts_sampler_lock = LOCK_UNLOCKED;
+static bool dts_sampler_armed;
+static uint64_t dts_last_read;
+static uint64_t dts_sample_interval;
+static uint64_t dts_max_age;
+
+/* Centaurs are read through FSI, only on demand, but cached all the same */
+struct dts_mem {
+	struct list_node link;
+	uint32_t	chip_id;
+	uint64_t	stamp;
+	uint64_t	result;
+};
+
+static LIST_HEAD(dts_mems);
+static struct lock dts_mem_lock = LOCK_UNLOCKED;
+
+static bool dts_is_stale(uint64_t stamp)
+{
+	return !stamp ||
+		tb_compare(mftb(), stamp + dts_max_age) == TB_AAFTERB;
+}
+
 /* Different sensor locations */
 #define P7_CT_ZONE_LSU	0
 #define P7_CT_ZONE_ISU	1
@@ -71,20 +123,13 @@ struct dts {
  * 60		reserved1
  * 61..63	ID of worst case DTS2 (Only valid in EX core chiplets)
  */
-static int dts_read_core_temp_p7(uint32_t pir, struct dts *dts)
+static void dts_decode_core_temp_p7(uint32_t chip_id, uint32_t core,
+				    const struct xscom_op *res,
+				    struct dts *dts)
 {
-	int32_t chip_id = pir_to_chip_id(pir);
-	int32_t core = pir_to_core_id(pir);
-	uint64_t dts0;
+	uint64_t dts0 = res[0].data;
 	struct dts temps[P7_CT_ZONES];
 	int i;
-	int rc;
-
-	rc = xscom_read(chip_id,
-			XSCOM_ADDR_P8_EX(core, EX_THERM_P7_DTS_RESULT0),
-			&dts0);
-	if (rc)
-		return rc;
 
 	temps[P7_CT_ZONE_LSU].temp = (dts0 >> 56) & 0xff;
 	temps[P7_CT_ZONE_ISU].temp = (dts0 >> 48) & 0xff;
@@ -102,8 +147,6 @@ static int dts_read_core_temp_p7(uint32_t pir, struct dts *dts)
 
 	prlog(PR_TRACE, "DTS: Chip %x Core %x temp:%dC trip:%x\n",
 	      chip_id, core, dts->temp, dts->trip);
-
-	return 0;
 }
 
 /* Therm mac result masking for DTS (result(0:15)
@@ -143,24 +186,13 @@ static void dts_decode_one_dts(uint16_t raw, struct dts *dts)
  * Returns the temperature as the max of all 4 zones and a global trip
  * attribute.
  */
-static int dts_read_core_temp_p8(uint32_t pir, struct dts *dts)
+static void dts_decode_core_temp_p8(uint32_t chip_id, uint32_t core,
+				    const struct xscom_op *res,
+				    struct dts *dts)
 {
-	int32_t chip_id = pir_to_chip_id(pir);
-	int32_t core = pir_to_core_id(pir);
-	uint64_t dts0, dts1;
+	uint64_t dts0 = res[0].data, dts1 = res[1].data;
 	struct dts temps[P8_CT_ZONES];
 	int i;
-	int rc;
-
-	rc = xscom_read(chip_id, XSCOM_ADDR_P8_EX(core, EX_THERM_DTS_RESULT0),
-			&dts0);
-	if (rc)
-		return rc;
-
-	rc = xscom_read(chip_id, XSCOM_ADDR_P8_EX(core, EX_THERM_DTS_RESULT1),
-			&dts1);
-	if (rc)
-		return rc;
 
 	dts_decode_one_dts(dts0 >> 48, &temps[P8_CT_ZONE_LSU]);
 	dts_decode_one_dts(dts0 >> 32, &temps[P8_CT_ZONE_ISU]);
@@ -189,23 +221,140 @@ static int dts_read_core_temp_p8(uint32_t pir, struct dts *dts)
 	 * them for the moment until we understand why.
 	 */
 	dts->trip = 0;
-	return 0;
 }
 
-static int dts_read_core_temp(uint32_t pir, struct dts *dts)
+/* Result registers read per core */
+static unsigned int dts_core_regs(void)
 {
-	int rc;
-
 	switch (proc_gen) {
 	case proc_gen_p7:
-		rc = dts_read_core_temp_p7(pir, dts);
-		break;
+		return 1;
 	case proc_gen_p8:
-		rc = dts_read_core_temp_p8(pir, dts);
-		break;
+		return 2;
 	default:
 		assert(false);
 	}
+	return 0;
+}
+
+static struct dts_chip *dts_chip_alloc(struct proc_chip *chip)
+{
+	struct dts_chip *dc;
+	struct cpu_thread *c;
+	struct xscom_op *op;
+	uint32_t core;
+
+	dc = zalloc(sizeof(*dc));
+	if (!dc)
+		return NULL;
+
+	init_lock(&dc->lock);
+	dc->chip_id = chip->id;
+	memset(dc->core_op, -1, sizeof(dc->core_op));
+
+	for_each_available_core_in_chip(c, chip->id) {
+		core = pir_to_core_id(c->pir);
+		assert(core < DTS_MAX_CORES);
+
+		dc->core_op[core] = dc->nops;
+		op = &dc->ops[dc->nops];
+		op->type = XSCOM_OP_READ;
+		if (proc_gen == proc_gen_p7) {
+			op->addr = XSCOM_ADDR_P8_EX(core,
+						    EX_THERM_P7_DTS_RESULT0);
+		} else {
+			op->addr = XSCOM_ADDR_P8_EX(core, EX_THERM_DTS_RESULT0);
+			op[1].type = XSCOM_OP_READ;
+			op[1].addr = XSCOM_ADDR_P8_EX(core,
+						      EX_THERM_DTS_RESULT1);
+		}
+		dc->nops += dts_core_regs();
+	}
+
+	return dc;
+}
+
+/* Called with the chip's lock held */
+static void dts_chip_sample(struct dts_chip *dc)
+{
+	unsigned int i = 0;
+
+	/* A failed read doesn't keep the other cores from being sampled */
+	while (i < dc->nops) {
+		if (!xscom_batch(dc->chip_id, &dc->ops[i], dc->nops - i))
+			break;
+		/* Skip what ran, including the op that failed */
+		while (i < dc->nops && !dc->ops[i++].rc)
+			;
+	}
+	dc->stamp = mftb();
+}
+
+static void dts_sample_all(struct timer *t, void *data __unused)
+{
+	struct dts_chip *dc;
+	unsigned int i;
+
+	for (i = 0; i < MAX_CHIPS; i++) {
+		dc = dts_chips[i];
+		if (!dc)
+			continue;
+		lock(&dc->lock);
+		dts_chip_sample(dc);
+		unlock(&dc->lock);
+	}
+
+	lock(&dts_sampler_lock);
+	if (tb_compare(mftb(), dts_last_read +
+		       DTS_IDLE_SAMPLES * dts_sample_interval) == TB_AAFTERB)
+		dts_sampler_armed = false;
+	else
+		schedule_timer(t, dts_sample_interval);
+	unlock(&dts_sampler_lock);
+}
+
+/* Keep the sampler going while sensors are being read */
+static void dts_sampler_kick(void)
+{
+	lock(&dts_sampler_lock);
+	dts_last_read = mftb();
+	if (!dts_sampler_armed) {
+		dts_sampler_armed = true;
+		schedule_timer(&dts_sampler, dts_sample_interval);
+	}
+	unlock(&dts_sampler_lock);
+}
+
+static int dts_read_core_temp(uint32_t pir, struct dts *dts)
+{
+	uint32_t chip_id = pir_to_chip_id(pir);
+	uint32_t core = pir_to_core_id(pir);
+	struct xscom_op *res;
+	struct dts_chip *dc;
+	unsigned int i;
+	int rc = 0;
+
+	dc = chip_id < MAX_CHIPS ? dts_chips[chip_id] : NULL;
+	if (!dc || core >= DTS_MAX_CORES || dc->core_op[core] < 0)
+		return OPAL_PARAMETER;
+
+	lock(&dc->lock);
+	if (dts_is_stale(dc->stamp))
+		dts_chip_sample(dc);
+
+	res = &dc->ops[dc->core_op[core]];
+	for (i = 0; i < dts_core_regs() && !rc; i++)
+		rc = res[i].rc;
+	if (!rc) {
+		prlog(PR_TRACE, "DTS: Chip %x Core %x sample %lu ms old\n",
+		      chip_id, core, tb_to_msecs(mftb() - dc->stamp));
+		if (proc_gen == proc_gen_p7)
+			dts_decode_core_temp_p7(chip_id, core, res, dts);
+		else
+			dts_decode_core_temp_p8(chip_id, core, res, dts);
+	}
+	unlock(&dc->lock);
+
 	return rc;
 }
 
@@ -217,14 +366,32 @@ static int dts_read_core_temp(uint32_t pir, struct dts *dts)
 
 static int dts_read_mem_temp(uint32_t chip_id, struct dts *dts)
 {
+	struct dts_mem *m = NULL, *it;
 	uint64_t dts0;
 	struct dts temps[P8_MEM_ZONES];
 	int i;
 	int rc;
 
-	rc = xscom_read(chip_id, THERM_MEM_DTS_RESULT0, &dts0);
-	if (rc)
-		return rc;
+	lock(&dts_mem_lock);
+	list_for_each(&dts_mems, it, link) {
+		if (it->chip_id == chip_id) {
+			m = it;
+			break;
+		}
+	}
+	if (!m || dts_is_stale(m->stamp)) {
+		rc = xscom_read(chip_id, THERM_MEM_DTS_RESULT0, &dts0);
+		if (rc) {
+			unlock(&dts_mem_lock);
+			return rc;
+		}
+		if (m) {
+			m->result = dts0;
+			m->stamp = mftb();
+		}
+	} else
+		dts0 = m->result;
+	unlock(&dts_mem_lock);
 
 	dts_decode_one_dts(dts0 >> 48, &temps[P8_MEM_DTS0]);
 	dts_decode_one_dts(dts0 >> 32, &temps[P8_MEM_DTS1]);
@@ -286,6 +453,7 @@ int64_t dts_sensor_read(uint32_t sensor_hndl, uint32_t *sensor_data)
 
 	switch (sensor_get_frc(sensor_hndl) & ~SENSOR_DTS) {
 	case SENSOR_DTS_CORE_TEMP:
+		dts_sampler_kick();
 		rc = dts_read_core_temp(rid, &dts);
 		break;
 	case SENSOR_DTS_MEM_TEMP:
@@ -329,6 +497,13 @@ bool dts_sensor_create_nodes(struct dt_node *sensors)
 	for_each_chip(chip) {
 		struct cpu_thread *c;
 
+		dts_chips[chip->id] = dts_chip_alloc(chip);
+		if (!dts_chips[chip->id]) {
+			prerror("DTS: Can't allocate chip %x cache\n",
+				chip->id);
+			continue;
+		}
+
 		for_each_available_core_in_chip(c, chip->id) {
 			struct dt_node *node;
 			uint32_t handler;
@@ -358,10 +533,18 @@ bool dts_sensor_create_nodes(struct dt_node *sensors)
 	dt_for_each_compatible(dt_root, cn, "ibm,centaur") {
 		uint32_t chip_id;
 		struct dt_node *node;
+		struct dts_mem *m;
 		uint32_t handler;
 
 		chip_id = dt_prop_get_u32(cn, "ibm,chip-id");
 
+		/* Without a cache entry, reads just go to the hardware */
+		m = zalloc(sizeof(*m));
+		if (m) {
+			m->chip_id = chip_id;
+			list_add_tail(&dts_mems, &m->link);
+		}
+
 		snprintf(name, sizeof(name), "mem-temp@%x", chip_id);
 
 		/*
@@ -383,5 +566,14 @@ bool dts_sensor_create_nodes(struct dt_node *sensors)
 		dt_add_property_string(node, "label", "Centaur");
 	}
 
+	dts_sample_interval = msecs_to_tb(platform.dts_sample_ms ?
+					  platform.dts_sample_ms :
+					  DTS_SAMPLE_MS);
+	dts_max_age = platform.dts_max_age_ms ?
+		msecs_to_tb(platform.dts_max_age_ms) : 2 * dts_sample_interval;
+
+	/* Not started until the first read */
+	init_timer(&dts_sampler, dts_sample_all, NULL);
+
 	return true;
 }
@@ -27,6 +27,14 @@
  * expected as an argument for OPAL read call which has already been exported
  * to the device tree during fsp init. The sapphire code decodes this Id to
  * determine requested attribute and sensor.
+ *
+ * A single SPCN read of a modifier returns the entries of every sensor
+ * of that type, so sensors are read as groups (one per first modifier).
+ * Each group has its own part of the DMA buffer, so the groups can be
+ * read concurrently, and all the requests that arrive while a group is
+ * being read are completed by that one read. The result is then kept
+ * for a while, during which reads of the group's sensors are answered
+ * synchronously from it.
  */
 
 #include <skiboot.h>
@@ -38,6 +46,8 @@
 #include <opal-msg.h>
 #include <errorlog.h>
 #include <sensor.h>
+#include <timebase.h>
+#include <ccan/list/list.h>
 
 #define INVALID_DATA	((uint32_t)-1)
 
@@ -95,6 +105,22 @@ enum spcn_attr {
 	SENSOR_MAX,
 };
 
+/* Sensors read together by one SPCN read of the group's modifiers */
+struct sensor_group {
+	uint8_t		mod;		/* First modifier code */
+	uint32_t	max_age;	/* How long a read stays fresh (ms) */
+	uint32_t	first_index;	/* Modifier index of 'mod' */
+	uint32_t	mod_index;	/* Modifier index being read */
+	uint32_t	dma_offset;	/* Group's part of the sensor buffer */
+	uint32_t	buf_size;	/* Size of the group's part */
+	uint32_t	offset;		/* Offset in group's part of buffer */
+	uint32_t	entry_count;	/* Number of entries read */
+	unsigned long	read_tb;	/* When the last read completed */
+	bool		valid;		/* Entries in buffer can be used */
+	bool		busy;		/* Read in progress */
+	struct list_head waiters;	/* Requests waiting for the read */
+};
+
 /* Parsed sensor attributes, passed through OPAL */
 struct opal_sensor_data {
 	uint64_t	async_token;	/* Asynchronous token */
@@ -102,8 +128,8 @@ struct opal_sensor_data {
 	enum spcn_attr	spcn_attr;	/* Modifier attribute */
 	uint16_t	rid;		/* Sensor RID */
 	uint8_t		frc;		/* Sensor resource class */
-	uint32_t	mod_index;	/* Modifier index*/
-	uint32_t	offset;		/* Offset in sensor buffer */
+	struct sensor_group *group;	/* Group the sensor is read with */
+	struct list_node link;		/* On the group's waiters list */
 };
 
 struct spcn_mod_attr {
@@ -116,6 +142,7 @@ struct spcn_mod {
 	uint8_t entry_size;	/* Size of each entry in response buffer */
 	uint16_t entry_count;	/* Number of entries */
 	struct spcn_mod_attr *mod_attr;
+	uint32_t init_size;	/* Bytes read at init, sizes the groups */
 };
 
 static struct spcn_mod_attr prs_status_attrs[] = {
@@ -141,22 +168,22 @@ static struct spcn_mod_attr sensor_power_attrs[] = {
 
 static struct spcn_mod spcn_mod_data[] = {
 		{SPCN_MOD_PRS_STATUS_FIRST, PRS_STATUS_ENTRY_SZ, 0,
-				prs_status_attrs},
+				prs_status_attrs, 0},
 		{SPCN_MOD_PRS_STATUS_SUBS, PRS_STATUS_ENTRY_SZ, 0,
-				prs_status_attrs},
+				prs_status_attrs, 0},
 		{SPCN_MOD_SENSOR_PARAM_FIRST, SENSOR_PARAM_ENTRY_SZ, 0,
-				sensor_param_attrs},
+				sensor_param_attrs, 0},
 		{SPCN_MOD_SENSOR_PARAM_SUBS, SENSOR_PARAM_ENTRY_SZ, 0,
-				sensor_param_attrs},
+				sensor_param_attrs, 0},
 		{SPCN_MOD_SENSOR_DATA_FIRST, SENSOR_DATA_ENTRY_SZ, 0,
-				sensor_data_attrs},
+				sensor_data_attrs, 0},
 		{SPCN_MOD_SENSOR_DATA_SUBS, SENSOR_DATA_ENTRY_SZ, 0,
-				sensor_data_attrs},
+				sensor_data_attrs, 0},
 		/* TODO Support this modifier '0x14', if required */
 		/* {SPCN_MOD_PROC_JUNC_TEMP, PROC_JUNC_ENTRY_SZ, 0, NULL}, */
 		{SPCN_MOD_SENSOR_POWER, SENSOR_DATA_ENTRY_SZ, 0,
-				sensor_power_attrs},
-		{SPCN_MOD_LAST, 0xff, 0xffff, NULL}
+				sensor_power_attrs, 0},
+		{SPCN_MOD_LAST, 0xff, 0xffff, NULL, 0}
 };
 
 /* Frame resource class (FRC) names */
@@ -178,15 +205,28 @@ static const char *frc_names[] = {
 		"io-backplane"
 };
 
+/*
+ * Thresholds and presence rarely change, so those are kept for longer
+ * than sensor readings.
+ */
+static struct sensor_group sensor_groups[] = {
+		{ .mod = SPCN_MOD_PRS_STATUS_FIRST,	.max_age = 2000 },
+		{ .mod = SPCN_MOD_SENSOR_PARAM_FIRST,	.max_age = 30000 },
+		{ .mod = SPCN_MOD_SENSOR_DATA_FIRST,	.max_age = 1000 },
+		{ .mod = SPCN_MOD_SENSOR_POWER,		.max_age = 1000 },
+};
+
+/* Limit on requests waiting for a read, across all groups */
+#define MAX_SENSOR_WAITERS	64
+
 #define SENSOR_MAX_SIZE		0x00100000
 static void *sensor_buffer = NULL;
 static enum sensor_state sensor_state;
-static bool prev_msg_consumed = true;
+static unsigned int sensor_waiters;
 static struct lock sensor_lock;
 
 /* Function prototypes */
-static int64_t fsp_sensor_send_read_request(struct opal_sensor_data *attr);
-static void queue_msg_for_delivery(int rc, struct opal_sensor_data *attr);
+static int64_t fsp_sensor_send_read_request(struct sensor_group *group);
 
 
 /*
@@ -230,23 +270,24 @@ static void queue_msg_for_delivery(int rc, struct opal_sensor_data *attr);
  * --------------------------------------------------------------------------
  */
 
-static void fsp_sensor_process_data(struct opal_sensor_data *attr)
+static uint32_t fsp_sensor_process_data(struct opal_sensor_data *attr)
 {
-	uint8_t *sensor_buf_ptr = (uint8_t *)sensor_buffer;
+	struct sensor_group *group = attr->group;
+	struct spcn_mod *mod = &spcn_mod_data[group->first_index];
+	uint8_t *sensor_buf_ptr = (uint8_t *)sensor_buffer + group->dma_offset;
 	uint32_t sensor_data = INVALID_DATA;
 	uint16_t sensor_mod_data[8];
 	int count, i;
 	uint8_t valid, nr_power;
 	uint32_t power;
 
-	for (count = 0; count < spcn_mod_data[attr->mod_index].entry_count;
-			count++) {
+	for (count = 0; count < group->entry_count; count++) {
 		memcpy((void *)sensor_mod_data, sensor_buf_ptr,
-				spcn_mod_data[attr->mod_index].entry_size);
-		if (spcn_mod_data[attr->mod_index].mod == SPCN_MOD_PROC_JUNC_TEMP) {
+				mod->entry_size);
+		if (mod->mod == SPCN_MOD_PROC_JUNC_TEMP) {
 			/* TODO Support this modifier '0x14', if required */
 
-		} else if (spcn_mod_data[attr->mod_index].mod == SPCN_MOD_SENSOR_POWER) {
+		} else if (mod->mod == SPCN_MOD_SENSOR_POWER) {
 			valid = sensor_buf_ptr[0];
 			if (valid & 0x80) {
 				nr_power = valid & 0x0f;
@@ -293,17 +334,14 @@ static void fsp_sensor_process_data(struct opal_sensor_data *attr)
 			break;
 		}
 
-		sensor_buf_ptr += spcn_mod_data[attr->mod_index].entry_size;
+		sensor_buf_ptr += mod->entry_size;
 	}
 
-	*(attr->sensor_data) = sensor_data;
-	if (sensor_data == INVALID_DATA)
-		queue_msg_for_delivery(OPAL_PARTIAL, attr);
-	else
-		queue_msg_for_delivery(OPAL_SUCCESS, attr);
+	return sensor_data;
 }
 
-static int fsp_sensor_process_read(struct fsp_msg *resp_msg)
+static int fsp_sensor_process_read(struct fsp_msg *resp_msg,
+				   enum sensor_state *state)
 {
 	uint8_t mbx_rsp_status;
 	uint32_t size = 0;
@@ -311,29 +349,29 @@ static int fsp_sensor_process_read(struct fsp_msg *resp_msg)
 	mbx_rsp_status = (resp_msg->word1 >> 8) & 0xff;
 	switch (mbx_rsp_status) {
 	case SP_RSP_STATUS_VALID_DATA:
-		sensor_state = SENSOR_VALID_DATA;
+		*state = SENSOR_VALID_DATA;
 		size = resp_msg->data.words[1] & 0xffff;
 		break;
 	case SP_RSP_STATUS_INVALID_DATA:
 		log_simple_error(&e_info(OPAL_RC_SENSOR_READ),
 			"SENSOR: %s: Received invalid data\n", __func__);
-		sensor_state = SENSOR_INVALID_DATA;
+		*state = SENSOR_INVALID_DATA;
 		break;
 	case SP_RSP_STATUS_SPCN_ERR:
 		log_simple_error(&e_info(OPAL_RC_SENSOR_READ),
 			"SENSOR: %s: Failure due to SPCN error\n", __func__);
-		sensor_state = SENSOR_SPCN_ERROR;
+		*state = SENSOR_SPCN_ERROR;
 		break;
 	case SP_RSP_STATUS_DMA_ERR:
 		log_simple_error(&e_info(OPAL_RC_SENSOR_READ),
 			"SENSOR: %s: Failure due to DMA error\n", __func__);
-		sensor_state = SENSOR_DMA_ERROR;
+		*state = SENSOR_DMA_ERROR;
 		break;
 	default:
 		log_simple_error(&e_info(OPAL_RC_SENSOR_READ),
 			"SENSOR %s: Read failed, status:0x%02X\n",
 					__func__, mbx_rsp_status);
-		sensor_state = SENSOR_INVALID_DATA;
+		*state = SENSOR_INVALID_DATA;
 		break;
 	}
 
@@ -346,49 +384,69 @@ static void queue_msg_for_delivery(int rc, struct opal_sensor_data *attr)
 	      __func__, rc, *(attr->sensor_data));
 	opal_queue_msg(OPAL_MSG_ASYNC_COMP, NULL, NULL,
 			attr->async_token, rc);
-	spcn_mod_data[attr->mod_index].entry_count = 0;
 	free(attr);
-	prev_msg_consumed = true;
+}
+
+/* Complete all the requests waiting for a group. Called with sensor_lock */
+static void fsp_sensor_complete_waiters(struct sensor_group *group, int rc)
+{
+	struct opal_sensor_data *attr;
+	uint32_t data;
+
+	while ((attr = list_pop(&group->waiters, struct opal_sensor_data,
+				link))) {
+		sensor_waiters--;
+		if (rc != OPAL_SUCCESS) {
+			*(attr->sensor_data) = INVALID_DATA;
+			queue_msg_for_delivery(rc, attr);
+			continue;
+		}
+
+		data = fsp_sensor_process_data(attr);
+		*(attr->sensor_data) = data;
+		queue_msg_for_delivery(data == INVALID_DATA ?
+				       OPAL_PARTIAL : OPAL_SUCCESS, attr);
+	}
 }
 
 static void fsp_sensor_read_complete(struct fsp_msg *msg)
 {
-	struct opal_sensor_data *attr = msg->user_data;
+	struct sensor_group *group = msg->user_data;
 	enum spcn_rsp_status status;
+	enum sensor_state state;
 	int rc, size;
 
 	prlog(PR_INSANE, "%s()\n", __func__);
 
 	status = (msg->resp->data.words[1] >> 24) & 0xff;
-	size = fsp_sensor_process_read(msg->resp);
+	size = fsp_sensor_process_read(msg->resp, &state);
 	fsp_freemsg(msg);
 
 	lock(&sensor_lock);
-	if (sensor_state == SENSOR_VALID_DATA) {
-		spcn_mod_data[attr->mod_index].entry_count += (size /
-				spcn_mod_data[attr->mod_index].entry_size);
-		attr->offset += size;
+	if (state == SENSOR_VALID_DATA) {
+		group->entry_count += (size /
+				spcn_mod_data[group->mod_index].entry_size);
+		group->offset += size;
 		/* Fetch the subsequent entries of the same modifier type */
 		if (status == SPCN_RSP_STATUS_COND_SUCCESS) {
-			switch (spcn_mod_data[attr->mod_index].mod) {
+			switch (spcn_mod_data[group->mod_index].mod) {
 			case SPCN_MOD_PRS_STATUS_FIRST:
 			case SPCN_MOD_SENSOR_PARAM_FIRST:
 			case SPCN_MOD_SENSOR_DATA_FIRST:
-				attr->mod_index++;
-				spcn_mod_data[attr->mod_index].entry_count =
-						spcn_mod_data[attr->mod_index - 1].
-						entry_count;
-				spcn_mod_data[attr->mod_index - 1].entry_count = 0;
+				group->mod_index++;
 				break;
 			default:
 				break;
 			}
 
-			rc = fsp_sensor_send_read_request(attr);
+			rc = fsp_sensor_send_read_request(group);
 			if (rc != OPAL_ASYNC_COMPLETION)
 				goto err;
 		} else { /* Notify 'powernv' of read completion */
-			fsp_sensor_process_data(attr);
+			group->busy = false;
+			group->valid = true;
+			group->read_tb = mftb();
+			fsp_sensor_complete_waiters(group, OPAL_SUCCESS);
 		}
 	} else {
 		rc = OPAL_INTERNAL_ERROR;
@@ -397,15 +455,15 @@ static void fsp_sensor_read_complete(struct fsp_msg *msg)
 	unlock(&sensor_lock);
 	return;
 err:
-	*(attr->sensor_data) = INVALID_DATA;
-	queue_msg_for_delivery(rc, attr);
+	group->busy = false;
+	fsp_sensor_complete_waiters(group, rc);
 	unlock(&sensor_lock);
 	log_simple_error(&e_info(OPAL_RC_SENSOR_ASYNC_COMPLETE),
 		"SENSOR: %s: Failed to queue the "
 		"read request to fsp\n", __func__);
 }
 
-static int64_t fsp_sensor_send_read_request(struct opal_sensor_data *attr)
+static int64_t fsp_sensor_send_read_request(struct sensor_group *group)
 {
 	int rc;
 	struct fsp_msg *msg;
@@ -414,31 +472,43 @@ static int64_t fsp_sensor_send_read_request(struct opal_sensor_data *attr)
 	uint32_t cmd_header;
 
 	prlog(PR_INSANE, "Get the data for modifier [%d]\n",
-	      spcn_mod_data[attr->mod_index].mod);
+	      spcn_mod_data[group->mod_index].mod);
+
+	/*
+	 * The FSP doesn't know where the group's part ends, make sure what
+	 * this modifier returned at init still fits, with room to spare.
+	 */
+	if (group->offset + spcn_mod_data[group->mod_index].init_size >=
+	    group->buf_size) {
+		log_simple_error(&e_info(OPAL_RC_SENSOR_READ), "SENSOR: "
+				 "Out of buffer space for modifier [%d]\n",
+				 spcn_mod_data[group->mod_index].mod);
+		return OPAL_INTERNAL_ERROR;
+	}
 
-	if (spcn_mod_data[attr->mod_index].mod == SPCN_MOD_PROC_JUNC_TEMP) {
+	if (spcn_mod_data[group->mod_index].mod == SPCN_MOD_PROC_JUNC_TEMP) {
 		/* TODO Support this modifier '0x14', if required */
-		align = attr->offset % sizeof(*sensor_buf_ptr);
+		align = group->offset % sizeof(*sensor_buf_ptr);
 		if (align)
-			attr->offset += (sizeof(*sensor_buf_ptr) - align);
+			group->offset += (sizeof(*sensor_buf_ptr) - align);
 
 		sensor_buf_ptr = (uint32_t *)((uint8_t *)sensor_buffer +
-				attr->offset);
+				group->dma_offset + group->offset);
 
 		/* TODO Add 8 byte command data required for mod 0x14 */
 
-		attr->offset += 8;
+		group->offset += 8;
 
-		cmd_header = spcn_mod_data[attr->mod_index].mod << 24 |
+		cmd_header = spcn_mod_data[group->mod_index].mod << 24 |
 				SPCN_CMD_PRS << 16 | 0x0008;
 	} else {
-		cmd_header = spcn_mod_data[attr->mod_index].mod << 24 |
+		cmd_header = spcn_mod_data[group->mod_index].mod << 24 |
 				SPCN_CMD_PRS << 16;
 	}
 
 	msg = fsp_mkmsg(FSP_CMD_SPCN_PASSTHRU, 4,
 			SPCN_ADDR_MODE_CEC_NODE, cmd_header, 0,
-			PSI_DMA_SENSOR_BUF + attr->offset);
+			PSI_DMA_SENSOR_BUF + group->dma_offset + group->offset);
 
 	if (!msg) {
 		log_simple_error(&e_info(OPAL_RC_SENSOR_READ), "SENSOR: Failed "
@@ -446,7 +516,7 @@ static int64_t fsp_sensor_send_read_request(struct opal_sensor_data *attr)
 		return OPAL_INTERNAL_ERROR;
 	}
 
-	msg->user_data = attr;
+	msg->user_data = group;
 	rc = fsp_queue_msg(msg, fsp_sensor_read_complete);
 	if (rc) {
 		fsp_freemsg(msg);
@@ -459,6 +529,23 @@ static int64_t fsp_sensor_send_read_request(struct opal_sensor_data *attr)
 	return OPAL_ASYNC_COMPLETION;
 }
 
+/* Start reading a group. Called with sensor_lock held */
+static int64_t fsp_sensor_start_read(struct sensor_group *group)
+{
+	int64_t rc;
+
+	group->mod_index = group->first_index;
+	group->offset = 0;
+	group->entry_count = 0;
+	group->valid = false;
+
+	rc = fsp_sensor_send_read_request(group);
+	if (rc == OPAL_ASYNC_COMPLETION)
+		group->busy = true;
+
+	return rc;
+}
+
 static int64_t parse_sensor_id(uint32_t id, struct opal_sensor_data *attr)
 {
 	uint32_t mod, index;
@@ -478,12 +565,14 @@ static int64_t parse_sensor_id(uint32_t id, struct opal_sensor_data *attr)
 	else
 		return OPAL_PARAMETER;
 
-	for (index = 0; spcn_mod_data[index].mod != SPCN_MOD_LAST; index++) {
-		if (spcn_mod_data[index].mod == mod)
+	for (index = 0; index < ARRAY_SIZE(sensor_groups); index++) {
+		if (sensor_groups[index].mod == mod)
 			break;
 	}
+	if (index == ARRAY_SIZE(sensor_groups))
+		return OPAL_PARAMETER;
 
-	attr->mod_index = index;
+	attr->group = &sensor_groups[index];
 	attr->frc = (id >> 16) & 0xff;
 	attr->rid = id & 0xffff;
 
@@ -494,64 +583,78 @@ static int64_t parse_sensor_id(uint32_t id, struct opal_sensor_data *attr)
 int64_t fsp_opal_read_sensor(uint32_t sensor_hndl, int token,
 		uint32_t *sensor_data)
 {
-	struct opal_sensor_data *attr;
+	struct opal_sensor_data req, *attr;
+	struct sensor_group *group;
+	uint32_t data;
 	int64_t rc;
 
 	prlog(PR_INSANE, "fsp_opal_read_sensor [%08x]\n", sensor_hndl);
 
-	if (sensor_state == SENSOR_PERMANENT_ERROR) {
-		rc = OPAL_HARDWARE;
-		goto out;
-	}
+	if (sensor_state == SENSOR_PERMANENT_ERROR)
+		return OPAL_HARDWARE;
+
+	if (!sensor_hndl)
+		return OPAL_PARAMETER;
 
-	if (!sensor_hndl) {
-		rc = OPAL_PARAMETER;
-		goto out;
+	/* Parse the sensor id and store them to the local structure */
+	memset(&req, 0, sizeof(req));
+	rc = parse_sensor_id(sensor_hndl, &req);
+	if (rc) {
+		log_simple_error(&e_info(OPAL_RC_SENSOR_READ),
+			"SENSOR: %s: Failed to parse the sensor "
+			"handle[0x%08x]\n", __func__, sensor_hndl);
+		return rc;
 	}
+	group = req.group;
 
 	lock(&sensor_lock);
-	if (prev_msg_consumed) {
-		attr = zalloc(sizeof(*attr));
-		if (!attr) {
-			log_simple_error(&e_info(OPAL_RC_SENSOR_READ),
-				"SENSOR: Failed to allocate memory\n");
-			rc = OPAL_NO_MEM;
-			goto out_lock;
-		}
 
-		/* Parse the sensor id and store them to the local structure */
-		rc = parse_sensor_id(sensor_hndl, attr);
-		if (rc) {
-			log_simple_error(&e_info(OPAL_RC_SENSOR_READ),
-				"SENSOR: %s: Failed to parse the sensor "
-				"handle[0x%08x]\n", __func__, sensor_hndl);
-			goto out_free;
-		}
-		/* Kernel buffer pointer to copy the data later when ready */
-		attr->sensor_data = sensor_data;
-		attr->async_token = token;
+	/* Answer from the last read of the group while it's fresh */
+	if (group->valid && tb_compare(mftb(), group->read_tb +
+			msecs_to_tb(group->max_age)) == TB_ABEFOREB) {
+		data = fsp_sensor_process_data(&req);
+		unlock(&sensor_lock);
+
+		*sensor_data = data;
+		return data == INVALID_DATA ? OPAL_PARTIAL : OPAL_SUCCESS;
+	}
 
-		rc = fsp_sensor_send_read_request(attr);
+	if (sensor_waiters >= MAX_SENSOR_WAITERS) {
+		rc = OPAL_BUSY_EVENT;
+		goto out_lock;
+	}
+
+	attr = zalloc(sizeof(*attr));
+	if (!attr) {
+		log_simple_error(&e_info(OPAL_RC_SENSOR_READ),
+			"SENSOR: Failed to allocate memory\n");
+		rc = OPAL_NO_MEM;
+		goto out_lock;
+	}
+	*attr = req;
+
+	/* Kernel buffer pointer to copy the data later when ready */
+	attr->sensor_data = sensor_data;
+	attr->async_token = token;
+
+	/* Join a read already in progress, or start one */
+	if (!group->busy) {
+		rc = fsp_sensor_start_read(group);
 		if (rc != OPAL_ASYNC_COMPLETION) {
 			log_simple_error(&e_info(OPAL_RC_SENSOR_READ),
 				"SENSOR: %s: Failed to queue the read "
 					"request to fsp\n", __func__);
-			goto out_free;
+			free(attr);
+			goto out_lock;
 		}
-
-		prev_msg_consumed = false;
-	} else {
-		rc = OPAL_BUSY_EVENT;
 	}
 
-	unlock(&sensor_lock);
-	return rc;
+	list_add_tail(&group->waiters, &attr->link);
+	sensor_waiters++;
+	rc = OPAL_ASYNC_COMPLETION;
 
-out_free:
-	free(attr);
 out_lock:
 	unlock(&sensor_lock);
-out:
 	return rc;
 }
 
@@ -693,6 +796,72 @@ static void add_sensor_ids(struct dt_node *sensors)
 		free(prids[index]);
 }
 
+static void init_sensor_groups(void)
+{
+	struct sensor_group *group;
+	uint32_t i, index;
+
+	for (i = 0; i < ARRAY_SIZE(sensor_groups); i++) {
+		group = &sensor_groups[i];
+
+		for (index = 0; spcn_mod_data[index].mod != SPCN_MOD_LAST;
+				index++) {
+			if (spcn_mod_data[index].mod == group->mod)
+				break;
+		}
+		group->first_index = index;
+		list_head_init(&group->waiters);
+	}
+}
+
+/*
+ * Share the sensor buffer out between the groups, now that we know how
+ * much each one read at init. Whatever is left over is split evenly,
+ * for sensors showing up later. Groups get no space, and all reads of
+ * them fail, if the buffer can't even hold what was found at init.
+ */
+static bool size_sensor_groups(void)
+{
+	uint32_t need[ARRAY_SIZE(sensor_groups)];
+	uint32_t i, index, end, total = 0, spare, offset = 0;
+	struct sensor_group *group;
+
+	for (i = 0; i < ARRAY_SIZE(sensor_groups); i++) {
+		group = &sensor_groups[i];
+		if (i + 1 < ARRAY_SIZE(sensor_groups))
+			end = sensor_groups[i + 1].first_index;
+		else
+			for (end = group->first_index;
+			     spcn_mod_data[end].mod != SPCN_MOD_LAST; end++)
+				;
+
+		need[i] = 0;
+		for (index = group->first_index; index < end; index++)
+			need[i] += spcn_mod_data[index].init_size;
+		need[i] = ALIGN_UP(need[i], 8);
+		total += need[i];
+	}
+
+	if (total > PSI_DMA_SENSOR_BUF_SZ) {
+		log_simple_error(&e_info(OPAL_RC_SENSOR_INIT), "SENSOR: "
+				 "%u bytes of sensors don't fit in the "
+				 "buffer\n", total);
+		return false;
+	}
+
+	spare = ((PSI_DMA_SENSOR_BUF_SZ - total) /
+		 ARRAY_SIZE(sensor_groups)) & ~7u;
+	for (i = 0; i < ARRAY_SIZE(sensor_groups); i++) {
+		group = &sensor_groups[i];
+		group->dma_offset = offset;
+		group->buf_size = need[i] + spare;
+		offset += group->buf_size;
+		prlog(PR_DEBUG, "SENSOR: Group [%d] %u bytes at 0x%x\n",
+		      group->mod, group->buf_size, group->dma_offset);
+	}
+	return true;
+}
+
 static void add_opal_sensor_node(void)
 {
 	int index;
@@ -716,6 +885,8 @@ void fsp_init_sensor(void)
 	struct fsp_msg msg, resp;
 	int index, rc;
 
+	init_sensor_groups();
+
 	if (!fsp_present()) {
 		sensor_state = SENSOR_PERMANENT_ERROR;
 		return;
@@ -765,8 +936,9 @@ void fsp_init_sensor(void)
 		rc = fsp_sync_msg(&msg, false);
 		if (rc >= 0) {
 			status = (resp.data.words[1] >> 24) & 0xff;
-			size = fsp_sensor_process_read(&resp);
+			size = fsp_sensor_process_read(&resp, &sensor_state);
 			psi_dma_offset += size;
+			spcn_mod_data[index].init_size += size;
 			spcn_mod_data[index].entry_count += (size /
 					spcn_mod_data[index].entry_size);
 		} else {
@@ -797,7 +969,7 @@ void fsp_init_sensor(void)
 		}
 	}
 
-	if (sensor_state != SENSOR_VALID_DATA)
+	if (sensor_state != SENSOR_VALID_DATA || !size_sensor_groups())
 		sensor_state = SENSOR_PERMANENT_ERROR;
 	else
 		add_opal_sensor_node();
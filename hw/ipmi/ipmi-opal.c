@@ -62,6 +62,12 @@ static int64_t opal_ipmi_send(uint64_t interface,
 
 	msg->complete = opal_send_complete;
 	msg->error = opal_send_complete;
+
+	/* The host may be waiting on this, don't leave it behind
+	 * our own bulk SEL/FRU traffic
+	 */
+	if (msg->prio > IPMI_PRIO_NORMAL)
+		msg->prio = IPMI_PRIO_NORMAL;
 	return ipmi_queue_msg(msg);
 }
 
@@ -115,11 +115,74 @@ static uint32_t lpc_fw_opb_base 	= 0xf0000000;
 static uint32_t lpc_reg_opb_base 	= 0xc0012000;
 static uint32_t opb_master_reg_base 	= 0xc0010000;
 
+/*
+ * An ECCB access is a write of the control register followed by polls
+ * of the status register, run as one XSCOM batch
+ */
+static int64_t opb_access(struct proc_chip *chip, uint64_t ctl,
+			  uint64_t *data_reg, uint64_t *stat)
+{
+	struct xscom_op ops[] = {
+		{ .type = XSCOM_OP_WRITE,
+		  .addr = chip->lpc_xbase + ECCB_DATA },
+		{ .type = XSCOM_OP_WRITE,
+		  .addr = chip->lpc_xbase + ECCB_CTL, .data = ctl },
+		{ .type = XSCOM_OP_POLL,
+		  .addr = chip->lpc_xbase + ECCB_STAT,
+		  .mask = ECCB_STAT_OP_DONE, .match = ECCB_STAT_OP_DONE,
+		  .tries = ECCB_TIMEOUT, .delay = 100 },
+	};
+	struct xscom_op *op = ops;
+	bool is_write = !(ctl & ECCB_CTL_READ);
+	struct opal_err_info *err;
+	int64_t rc;
+
+	/* Reads don't need the data register */
+	if (is_write) {
+		ops[0].data = *data_reg;
+		err = &e_info(OPAL_RC_LPC_WRITE);
+	} else {
+		op++;
+		err = &e_info(OPAL_RC_LPC_READ);
+	}
+
+	rc = xscom_batch(chip->id, op, ops + ARRAY_SIZE(ops) - op);
+	*stat = ops[2].data;
+
+	if (ops[0].rc && is_write) {
+		log_simple_error(err,
+			"LPC: XSCOM write to ECCB DATA error %d\n",
+			ops[0].rc);
+		return ops[0].rc;
+	}
+	if (ops[1].rc) {
+		log_simple_error(err,
+			"LPC: XSCOM write to ECCB CTL error %d\n", ops[1].rc);
+		return ops[1].rc;
+	}
+	if (ops[2].rc == OPAL_BUSY) {
+		log_simple_error(err, "LPC: %s timeout !\n",
+				 is_write ? "Write" : "Read");
+		return OPAL_HARDWARE;
+	}
+	if (rc) {
+		log_simple_error(err,
+			"LPC: XSCOM read from ECCB STAT err %lld\n", rc);
+		return rc;
+	}
+	if (*stat & ECCB_STAT_ERR_MASK) {
+		log_simple_error(err,
+			"LPC: Error status: 0x%llx\n", *stat);
+		return OPAL_HARDWARE;
+	}
+
+	return OPAL_SUCCESS;
+}
+
 static int64_t opb_write(struct proc_chip *chip, uint32_t addr, uint32_t data,
 			 uint32_t sz)
 {
 	uint64_t ctl = ECCB_CTL_MAGIC, stat;
-	int64_t rc, tout;
 	uint64_t data_reg;
 
 	switch(sz) {
@@ -137,50 +200,19 @@ static int64_t opb_write(struct proc_chip *chip, uint32_t addr, uint32_t data,
 		return OPAL_PARAMETER;
 	}
 
-	rc = xscom_write(chip->id, chip->lpc_xbase + ECCB_DATA, data_reg);
-	if (rc) {
-		log_simple_error(&e_info(OPAL_RC_LPC_WRITE),
-			"LPC: XSCOM write to ECCB DATA error %lld\n", rc);
-		return rc;
-	}
-
 	ctl = SETFIELD(ECCB_CTL_DATASZ, ctl, sz);
 	ctl = SETFIELD(ECCB_CTL_ADDRLEN, ctl, ECCB_ADDRLEN_4B);
 	ctl = SETFIELD(ECCB_CTL_ADDR, ctl, addr);
-	rc = xscom_write(chip->id, chip->lpc_xbase + ECCB_CTL, ctl);
-	if (rc) {
-		log_simple_error(&e_info(OPAL_RC_LPC_WRITE),
-			"LPC: XSCOM write to ECCB CTL error %lld\n", rc);
-		return rc;
-	}
 
-	for (tout = 0; tout < ECCB_TIMEOUT; tout++) {
-		rc = xscom_read(chip->id, chip->lpc_xbase + ECCB_STAT, &stat);
-		if (rc) {
-			log_simple_error(&e_info(OPAL_RC_LPC_WRITE),
-				"LPC: XSCOM read from ECCB STAT err %lld\n",
-									rc);
-			return rc;
-		}
-		if (stat & ECCB_STAT_OP_DONE) {
-			if (stat & ECCB_STAT_ERR_MASK) {
-				log_simple_error(&e_info(OPAL_RC_LPC_WRITE),
-					"LPC: Error status: 0x%llx\n", stat);
-				return OPAL_HARDWARE;
-			}
-			return OPAL_SUCCESS;
-		}
-		time_wait_nopoll(100);
-	}
-	log_simple_error(&e_info(OPAL_RC_LPC_WRITE), "LPC: Write timeout !\n");
-	return OPAL_HARDWARE;
+	return opb_access(chip, ctl, &data_reg, &stat);
 }
 
 static int64_t opb_read(struct proc_chip *chip, uint32_t addr, uint32_t *data,
 		        uint32_t sz)
 {
 	uint64_t ctl = ECCB_CTL_MAGIC | ECCB_CTL_READ, stat;
-	int64_t rc, tout;
+	uint32_t rdata;
+	int64_t rc;
 
 	if (sz != 1 && sz != 2 && sz != 4) {
 		prerror("LPC: Invalid data size %d\n", sz);
@@ -190,45 +222,24 @@ static int64_t opb_read(struct proc_chip *chip, uint32_t addr, uint32_t *data,
 	ctl = SETFIELD(ECCB_CTL_DATASZ, ctl, sz);
 	ctl = SETFIELD(ECCB_CTL_ADDRLEN, ctl, ECCB_ADDRLEN_4B);
 	ctl = SETFIELD(ECCB_CTL_ADDR, ctl, addr);
-	rc = xscom_write(chip->id, chip->lpc_xbase + ECCB_CTL, ctl);
-	if (rc) {
-		log_simple_error(&e_info(OPAL_RC_LPC_READ),
-			"LPC: XSCOM write to ECCB CTL error %lld\n", rc);
+
+	rc = opb_access(chip, ctl, NULL, &stat);
+	if (rc)
 		return rc;
-	}
 
-	for (tout = 0; tout < ECCB_TIMEOUT; tout++) {
-		rc = xscom_read(chip->id, chip->lpc_xbase + ECCB_STAT, &stat);
-		if (rc) {
-			log_simple_error(&e_info(OPAL_RC_LPC_READ),
-				"LPC: XSCOM read from ECCB STAT err %lld\n",
-									rc);
-			return rc;
-		}
-		if (stat & ECCB_STAT_OP_DONE) {
-			uint32_t rdata = GETFIELD(ECCB_STAT_RD_DATA, stat);
-			if (stat & ECCB_STAT_ERR_MASK) {
-				log_simple_error(&e_info(OPAL_RC_LPC_READ),
-					"LPC: Error status: 0x%llx\n", stat);
-				return OPAL_HARDWARE;
-			}
-			switch(sz) {
-			case 1:
-				*data = rdata >> 24;
-				break;
-			case 2:
-				*data = rdata >> 16;
-				break;
-			default:
-				*data = rdata;
-				break;
-			}
-			return 0;
-		}
-		time_wait_nopoll(100);
+	rdata = GETFIELD(ECCB_STAT_RD_DATA, stat);
+	switch(sz) {
+	case 1:
+		*data = rdata >> 24;
+		break;
+	case 2:
+		*data = rdata >> 16;
+		break;
+	default:
+		*data = rdata;
+		break;
 	}
-	log_simple_error(&e_info(OPAL_RC_LPC_READ), "LPC: Read timeout !\n");
-	return OPAL_HARDWARE;
+	return 0;
 }
 
 static int64_t lpc_set_fw_idsel(struct proc_chip *chip, uint8_t idsel)
@@ -453,6 +464,76 @@ int64_t lpc_read(enum OpalLPCAddressType addr_type, uint32_t addr,
 	return __lpc_read(lpc_default_chip_id, addr_type, addr, data, sz);
 }
 
+/*
+ * Number of bytes read with the LPC lock held. It is dropped in between
+ * so that the console and other users don't stall for a whole image.
+ */
+#define LPC_FW_BLOCK_CHUNK	0x400
+
+static int64_t __lpc_fw_read_block(uint32_t chip_id, uint32_t addr,
+				   void *buf, uint32_t len)
+{
+	struct proc_chip *chip = get_chip(chip_id);
+	uint32_t opb_base, data, sz, chunk;
+	uint8_t *dst = buf;
+	int64_t rc = OPAL_SUCCESS;
+
+	if (!chip || !chip->lpc_xbase)
+		return OPAL_PARAMETER;
+
+	/* Address wraparound */
+	if (addr + len < addr)
+		return OPAL_PARAMETER;
+
+	while (len && !rc) {
+		chunk = MIN(len, LPC_FW_BLOCK_CHUNK);
+		len -= chunk;
+
+		lock(&chip->lpc_lock);
+		while (chunk) {
+			/* Word accesses, bytes for any unaligned head/tail */
+			sz = (chunk > 3 && !(addr & 3)) ? 4 : 1;
+
+			/*
+			 * Only touches the HC when the segment or read size
+			 * changes, which is rare within a block
+			 */
+			rc = lpc_opb_prepare(chip, OPAL_LPC_FW, addr, sz,
+					     &opb_base, false);
+			if (rc)
+				break;
+
+			rc = opb_read(chip, opb_base + addr, &data, sz);
+			if (rc)
+				break;
+
+			if (sz == 4)
+				*(uint32_t *)dst = data;
+			else
+				*dst = data;
+			chunk -= sz;
+			addr += sz;
+			dst += sz;
+		}
+		unlock(&chip->lpc_lock);
+	}
+
+	return rc;
+}
+
+/*
+ * Read a block of FW space. The data is stored in LPC address order,
+ * as the big endian FW accessors do. Unlike a loop of lpc_read() calls,
+ * this only takes the LPC lock once per chunk and skips the per access
+ * argument checking and HC setup.
+ */
+int64_t lpc_fw_read_block(uint32_t addr, void *buf, uint32_t len)
+{
+	if (lpc_default_chip_id < 0)
+		return OPAL_PARAMETER;
+	return __lpc_fw_read_block(lpc_default_chip_id, addr, buf, len);
+}
+
 /*
  * The "OPAL" variant add the emulation of 2 and 4 byte accesses using
  * byte accesses for IO and MEM space in order to be compatible with
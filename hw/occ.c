@@ -77,20 +77,31 @@ DEFINE_LOG_ENTRY(OPAL_RC_OCC_TIMEOUT, OPAL_PLATFORM_ERR_EVT, OPAL_OCC,
 		 OPAL_CEC_HARDWARE, OPAL_UNRECOVERABLE_ERR_GENERAL,
 		 OPAL_NA, NULL);
 
-/* Check each chip's HOMER/Sapphire area for PState valid bit */
+/* How often the pstate tables are looked at while waiting for the OCCs */
+#define OCC_READY_POLL_MS	1
+
+/*
+ * Check each chip's HOMER/Sapphire area for PState valid bit. The OCCs
+ * boot in parallel, so all the chips are watched together rather than
+ * one after the other, and the timeout applies to the whole lot.
+ */
 static bool wait_for_all_occ_init(void)
 {
 	struct proc_chip *chip;
-	uint64_t occ_data_area;
 	struct occ_pstate_table *occ_data;
-	int tries;
-	uint64_t start_time, end_time;
+	uint64_t start_time, end_time, deadline;
+	uint64_t pending = 0;
 	uint32_t timeout = 0;
 
+	/* One bit per chip in pending */
+	BUILD_ASSERT(MAX_CHIPS <= 64);
+
 	if (platform.occ_timeout)
 		timeout = platform.occ_timeout();
 
 	start_time = mftb();
+	deadline = start_time + secs_to_tb(timeout);
+
 	for_each_chip(chip) {
 		/* Check for valid homer address */
 		if (!chip->homer_base) {
@@ -98,31 +109,45 @@ static bool wait_for_all_occ_init(void)
 				chip->id);
 			return false;
 		}
-		/* Get PState table address */
-		occ_data_area = chip->homer_base + P8_HOMER_SAPPHIRE_DATA_OFFSET;
-		occ_data = (struct occ_pstate_table *)occ_data_area;
+		pending |= 1ull << chip->id;
+	}
 
-		/*
-		 * Checking for occ_data->valid == 1 is ok because we clear all
-		 * homer_base+size before passing memory to host services.
-		 * This ensures occ_data->valid == 0 before OCC load
-		 */
-		tries = timeout * 10;
-		while((occ_data->valid != 1) && tries--) {
-			time_wait_ms(100);
+	for (;;) {
+		for_each_chip(chip) {
+			if (!(pending & (1ull << chip->id)))
+				continue;
+
+			/*
+			 * Checking for occ_data->valid == 1 is ok because we
+			 * clear all homer_base+size before passing memory to
+			 * host services. This ensures occ_data->valid == 0
+			 * before OCC load
+			 */
+			occ_data = chip_occ_data(chip);
+			if (occ_data->valid != 1)
+				continue;
+
+			pending &= ~(1ull << chip->id);
+			prlog(PR_DEBUG, "OCC: Chip %02x ready after %lu ms,"
+			      " Data (%016llx) = %016llx\n", chip->id,
+			      tb_to_msecs(mftb() - start_time),
+			      (uint64_t)occ_data, *(uint64_t *)occ_data);
 		}
-		if (occ_data->valid != 1) {
-			prerror("OCC: Chip: %x PState table is not valid\n",
-				chip->id);
+		if (!pending)
+			break;
+
+		if (tb_compare(mftb(), deadline) == TB_AAFTERB) {
+			for_each_chip(chip)
+				if (pending & (1ull << chip->id))
+					prerror("OCC: Chip: %x PState table is"
+						" not valid\n", chip->id);
 			return false;
 		}
-		prlog(PR_DEBUG, "OCC: Chip %02x Data (%016llx) = %016llx\n",
-		      chip->id, occ_data_area,
-		      *(uint64_t *)occ_data_area);
+		time_wait_ms(OCC_READY_POLL_MS);
 	}
 	end_time = mftb();
-	prlog(PR_NOTICE, "OCC: All Chip Rdy after %lld ms\n",
-	      (end_time - start_time) / 512 / 1000);
+	prlog(PR_NOTICE, "OCC: All Chip Rdy after %lu ms\n",
+	      tb_to_msecs(end_time - start_time));
 	return true;
 }
 
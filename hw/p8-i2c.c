@@ -64,6 +64,20 @@ DEFINE_LOG_ENTRY(OPAL_RC_I2C_RESET, OPAL_INPUT_OUTPUT_ERR_EVT, OPAL_I2C,
 #define I2C_FIFO_HI_LVL		4
 #define I2C_FIFO_LO_LVL		4
 
+/* Max FIFO entries moved by a single xscom_batch() */
+#define I2C_FIFO_BATCH		16
+
+/* Status passes per interrupt/poll, lets us pick up a data request
+ * or command completion that became pending while we were draining
+ * the FIFO without waiting for the next interrupt or poll
+ */
+#define I2C_MAX_STATUS_PASSES	4
+
+/* Once interrupts are seen to work, the poller stays off the
+ * hardware unless the engine has been quiet for that long
+ */
+#define I2C_IRQ_QUIET_MS	10
+
 /*
  * I2C registers set.
  * Below is the offset of registers from base which is stored in the
@@ -189,6 +203,7 @@ struct p8_i2c_master {
 	uint8_t			obuf[4];	/* Offset buffer */
 	uint32_t		bytes_sent;
 	bool			irq_ok;		/* Interrupt working ? */
+	uint64_t		irq_tb;		/* Last interrupt serviced */
 	bool			occ_cache_dis;  /* I have disabled the cache */
 	enum request_state {
 		state_idle,
@@ -198,7 +213,10 @@ struct p8_i2c_master {
 		state_error,
 		state_recovery,
 	}			state;
-	struct list_head	req_list;	/* Request queue head */
+	struct list_head	req_list;	/* Request in flight */
+	struct p8_i2c_master_port *ports;	/* Ports driven by this master */
+	uint32_t		nports;
+	uint32_t		next_port;	/* Round-robin cursor */
 	struct timer		poller;
 	struct timer		timeout;
 	struct timer		recovery;
@@ -212,6 +230,7 @@ struct p8_i2c_master_port {
 	struct p8_i2c_master	*master;
 	uint32_t		port_num;
 	uint32_t		bit_rate_div;	/* Divisor to set bus speed*/
+	struct list_head	req_list;	/* Requests waiting for the engine */
 };
 
 struct p8_i2c_request {
@@ -519,20 +538,25 @@ exit:
 static int p8_i2c_fifo_read(struct p8_i2c_master *master,
 			    uint8_t *buf, uint32_t count)
 {
-	uint64_t fifo;
-	uint32_t i;
+	struct xscom_op ops[I2C_FIFO_BATCH];
+	uint32_t i, n;
 	int rc = 0;
 
-	for (i = 0; i < count; i++, buf++) {
-		rc = xscom_read(master->chip_id, master->xscom_base +
-				I2C_FIFO_REG, &fifo);
+	while (count) {
+		n = count > I2C_FIFO_BATCH ? I2C_FIFO_BATCH : count;
+		for (i = 0; i < n; i++) {
+			ops[i].type = XSCOM_OP_READ;
+			ops[i].addr = master->xscom_base + I2C_FIFO_REG;
+		}
+		rc = xscom_batch(master->chip_id, ops, n);
 		if (rc) {
 			log_simple_error(&e_info(OPAL_RC_I2C_TRANSFER),
 					 "I2C: Failed to read the fifo\n");
 			break;
 		}
-
-		*buf = GETFIELD(I2C_FIFO, fifo);
+		for (i = 0; i < n; i++)
+			*(buf++) = GETFIELD(I2C_FIFO, ops[i].data);
+		count -= n;
 	}
 	return rc;
 }
@@ -540,19 +564,24 @@ static int p8_i2c_fifo_read(struct p8_i2c_master *master,
 static int p8_i2c_fifo_write(struct p8_i2c_master *master,
 			     uint8_t *buf, uint32_t count)
 {
-	uint64_t fifo;
-	uint32_t i;
+	struct xscom_op ops[I2C_FIFO_BATCH];
+	uint32_t i, n;
 	int rc = 0;
 
-	for (i = 0; i < count; i++, buf++) {
-		fifo = SETFIELD(I2C_FIFO, 0ull, *buf);
-		rc = xscom_write(master->chip_id, master->xscom_base +
-				 I2C_FIFO_REG, fifo);
+	while (count) {
+		n = count > I2C_FIFO_BATCH ? I2C_FIFO_BATCH : count;
+		for (i = 0; i < n; i++) {
+			ops[i].type = XSCOM_OP_WRITE;
+			ops[i].addr = master->xscom_base + I2C_FIFO_REG;
+			ops[i].data = SETFIELD(I2C_FIFO, 0ull, *(buf++));
+		}
+		rc = xscom_batch(master->chip_id, ops, n);
 		if (rc) {
 			log_simple_error(&e_info(OPAL_RC_I2C_TRANSFER),
 					 "I2C: Failed to write the fifo\n");
 			break;
 		}
+		count -= n;
 	}
 	return rc;
 }
@@ -706,7 +735,7 @@ static void p8_i2c_status_cmd_completion(struct p8_i2c_master *master,
 	p8_i2c_complete_request(master, req, rc);
 }
 
-static void  p8_i2c_check_status(struct p8_i2c_master *master)
+static bool p8_i2c_check_status_once(struct p8_i2c_master *master)
 {
 	struct p8_i2c_master_port *port;
 	struct i2c_request *req;
@@ -717,7 +746,7 @@ static void  p8_i2c_check_status(struct p8_i2c_master *master)
 	 * when we next try to enqueue a request
 	 */
 	if (master->state == state_idle)
-		return;
+		return false;
 
 	/* Read status register */
 	rc = xscom_read(master->chip_id, master->xscom_base + I2C_STAT_REG,
@@ -725,13 +754,13 @@ static void  p8_i2c_check_status(struct p8_i2c_master *master)
 	if (rc) {
 		log_simple_error(&e_info(OPAL_RC_I2C_TRANSFER), "I2C: Failed "
 				 "to read the STAT_REG\n");
-		return;
+		return false;
 	}
 
 	/* Nothing happened ? Go back */
 	if (!(status & (I2C_STAT_ANY_ERR | I2C_STAT_DATA_REQ |
 			I2C_STAT_CMD_COMP)))
-		return;
+		return false;
 
 	DBG("Non-0 status: %016llx\n", status);
 
@@ -741,7 +770,7 @@ static void  p8_i2c_check_status(struct p8_i2c_master *master)
 	if (rc) {
 		log_simple_error(&e_info(OPAL_RC_I2C_TRANSFER), "I2C: Failed "
 				 "to disable the interrupts\n");
-		return;
+		return false;
 	}
 
 	/* No request ? That's not normal ! Bail out without re-enabling
@@ -752,7 +781,7 @@ static void  p8_i2c_check_status(struct p8_i2c_master *master)
 		log_simple_error(&e_info(OPAL_RC_I2C_TRANSFER),
 				 "I2C: Interrupt with no request"
 				 ", status=0x%016llx\n", status);
-		return;
+		return false;
 	}
 
 	/* Get port for current request */
@@ -767,6 +796,21 @@ static void  p8_i2c_check_status(struct p8_i2c_master *master)
 		p8_i2c_status_data_request(master, req, status);
 	else if (status & I2C_STAT_CMD_COMP)
 		p8_i2c_status_cmd_completion(master, req);
+
+	return true;
+}
+
+static void p8_i2c_check_status(struct p8_i2c_master *master)
+{
+	int pass;
+
+	/* Keep going while the engine has something for us: the FIFO
+	 * usually hits the watermark again, or the command completes,
+	 * while we are busy draining it.
+	 */
+	for (pass = 0; pass < I2C_MAX_STATUS_PASSES; pass++)
+		if (!p8_i2c_check_status_once(master))
+			break;
 }
 
 static int p8_i2c_check_initial_status(struct p8_i2c_master_port *port)
@@ -818,7 +862,6 @@ static int p8_i2c_check_initial_status(struct p8_i2c_master_port *port)
 
 		/* Delay 5ms for bus to settle */
 		schedule_timer(&master->recovery, msecs_to_tb(5));
-		unlock(&master->lock);
 		return OPAL_BUSY;
 	}
 
@@ -838,7 +881,6 @@ static int p8_i2c_check_initial_status(struct p8_i2c_master_port *port)
 
 		/* Delay 5ms for bus to settle */
 		schedule_timer(&master->recovery, msecs_to_tb(5));
-		unlock(&master->lock);
 		return OPAL_BUSY;
 	}
 
@@ -969,13 +1011,56 @@ static int p8_i2c_start_request(struct p8_i2c_master *master,
 	return OPAL_SUCCESS;
 }
 
+static bool p8_i2c_has_work(struct p8_i2c_master *master)
+{
+	uint32_t i;
+
+	if (!list_empty(&master->req_list))
+		return true;
+	for (i = 0; i < master->nports; i++)
+		if (!list_empty(&master->ports[i].req_list))
+			return true;
+	return false;
+}
+
+/*
+ * The engine runs one transfer at a time, whatever port it is
+ * steered to, so the ports of a master take turns: the next request
+ * comes from the first port after the last one served that has
+ * anything queued. A busy port thus can't starve the others.
+ */
+static struct i2c_request *p8_i2c_next_request(struct p8_i2c_master *master)
+{
+	struct p8_i2c_master_port *port;
+	struct i2c_request *req;
+	uint32_t i, idx;
+
+	req = list_top(&master->req_list, struct i2c_request, link);
+	if (req)
+		return req;
+
+	for (i = 0; i < master->nports; i++) {
+		idx = (master->next_port + i) % master->nports;
+		port = &master->ports[idx];
+		req = list_pop(&port->req_list, struct i2c_request, link);
+		if (!req)
+			continue;
+		master->next_port = (idx + 1) % master->nports;
+		list_add_tail(&master->req_list, &req->link);
+		return req;
+	}
+	return NULL;
+}
+
 static void p8_i2c_check_work(struct p8_i2c_master *master)
 {
 	struct i2c_request *req;
 	int rc;
 
-	while (master->state == state_idle && !list_empty(&master->req_list)) {
-		req = list_top(&master->req_list, struct i2c_request, link);
+	while (master->state == state_idle) {
+		req = p8_i2c_next_request(master);
+		if (!req)
+			break;
 		rc = p8_i2c_start_request(master, req);
 		if (rc && rc != OPAL_BUSY)
 			p8_i2c_complete_request(master, req, rc);
@@ -1001,7 +1086,7 @@ static int p8_i2c_queue_request(struct i2c_request *req)
 		return OPAL_PARAMETER;
 	}
 	lock(&master->lock);
-	list_add_tail(&master->req_list, &req->link);
+	list_add_tail(&port->req_list, &req->link);
 	p8_i2c_check_work(master);
 	unlock(&master->lock);
 
@@ -1106,7 +1191,7 @@ static void p8_i2c_recover(struct timer *t __unused, void *data)
 	 * immediately if we don't (we just waited the recovery time so there is
 	 * little point waiting longer).
 	 */
-	if (master->occ_cache_dis && list_empty(&master->req_list)) {
+	if (master->occ_cache_dis && !p8_i2c_has_work(master)) {
 		DBG("Re-enabling OCC cache after recovery\n");
 		centaur_enable_sensor_cache(master->chip_id);
 		master->occ_cache_dis = false;
@@ -1147,6 +1232,19 @@ static void p8_i2c_poll(struct timer *t __unused, void *data)
 		return;
 
 	lock(&master->lock);
+
+	/* Interrupts are doing the work, stay off the hardware and
+	 * just keep watching in case they stop
+	 */
+	if (master->irq_ok && master->irq_tb &&
+	    tb_compare(mftb(), master->irq_tb +
+		       msecs_to_tb(I2C_IRQ_QUIET_MS)) == TB_ABEFOREB) {
+		if (master->state != state_idle)
+			schedule_timer(&master->poller, master->poll_interval);
+		unlock(&master->lock);
+		return;
+	}
+
 	p8_i2c_check_status(master);
 	if (master->state != state_idle)
 		schedule_timer(&master->poller, master->poll_interval);
@@ -1167,6 +1265,7 @@ void p8_i2c_interrupt(uint32_t chip_id)
 			continue;
 
 		lock(&master->lock);
+		master->irq_tb = mftb();
 
 		/* Run the state machine */
 		p8_i2c_check_status(master);
@@ -1338,6 +1437,8 @@ static void p8_i2c_init_one(struct dt_node *i2cm, enum p8_i2c_master_type type)
 		free(master);
 		return;
 	}
+	master->ports = port;
+	master->nports = count;
 
 	/* Add master to chip's list */
 	list_add_tail(chip_list, &master->link);
@@ -1348,6 +1449,7 @@ static void p8_i2c_init_one(struct dt_node *i2cm, enum p8_i2c_master_type type)
 
 		port->port_num = dt_prop_get_u32(i2cm_port, "reg");
 		port->master = master;
+		list_head_init(&port->req_list);
 		speed = dt_prop_get_u32(i2cm_port, "bus-frequency");
 		if (speed > max_bus_speed)
 			max_bus_speed = speed;
@@ -101,6 +101,60 @@ static inline uint64_t phb3_set_sm_timeout(struct phb3 *p, uint64_t dur)
 	return dur;
 }
 
+static const char *phb3_state_names[PHB3_STATE_COUNT] = {
+	[PHB3_STATE_UNINITIALIZED]		= "uninitialized",
+	[PHB3_STATE_INITIALIZING]		= "initializing",
+	[PHB3_STATE_BROKEN]			= "broken",
+	[PHB3_STATE_FENCED]			= "fenced",
+	[PHB3_STATE_FUNCTIONAL]			= "functional",
+	[PHB3_STATE_HRESET_DELAY]		= "hreset-delay",
+	[PHB3_STATE_HRESET_DELAY2]		= "hreset-delay2",
+	[PHB3_STATE_FRESET_ASSERT_DELAY]	= "freset-assert",
+	[PHB3_STATE_FRESET_DEASSERT_DELAY]	= "freset-deassert",
+	[PHB3_STATE_CRESET_WAIT_CQ]		= "creset-wait-cq",
+	[PHB3_STATE_CRESET_REINIT]		= "creset-reinit",
+	[PHB3_STATE_CRESET_FRESET]		= "creset-freset",
+	[PHB3_STATE_WAIT_LINK_ELECTRICAL]	= "wait-link-electrical",
+	[PHB3_STATE_WAIT_LINK]			= "wait-link",
+};
+
+/* Reset and link training states, the ones we keep a timeline of */
+static inline bool phb3_state_timed(enum phb3_state state)
+{
+	return state >= PHB3_STATE_HRESET_DELAY;
+}
+
+/*
+ * Change state. Time spent in each reset/link state is accumulated
+ * and dumped once the PHB settles back in a steady state.
+ */
+static void phb3_set_state(struct phb3 *p, enum phb3_state state)
+{
+	enum phb3_state old = p->state;
+	uint64_t now = mftb(), total = 0;
+	int i;
+
+	if (phb3_state_timed(old))
+		p->state_time[old] += now - p->state_tb;
+	p->state_tb = now;
+	p->state = state;
+
+	if (!phb3_state_timed(old) || phb3_state_timed(state))
+		return;
+
+	for (i = 0; i < PHB3_STATE_COUNT; i++)
+		total += p->state_time[i];
+	PHBDBG(p, "Reset timeline, %lu ms to %s:\n",
+	       tb_to_msecs(total), phb3_state_names[state]);
+	for (i = 0; i < PHB3_STATE_COUNT; i++) {
+		if (!p->state_time[i])
+			continue;
+		PHBDBG(p, "  %-22s %lu ms\n", phb3_state_names[i],
+		       tb_to_msecs(p->state_time[i]));
+		p->state_time[i] = 0;
+	}
+}
+
 /* Check if AIB is fenced via PBCQ NFIR */
 static bool phb3_fenced(struct phb3 *p)
 {
@@ -110,7 +164,7 @@ static bool phb3_fenced(struct phb3 *p)
 	xscom_read(p->chip_id, p->pe_xscom + 0x0, &nfir);
 	if (nfir & PPC_BIT(16)) {
 		p->flags |= PHB3_AIB_FENCED;
-		p->state = PHB3_STATE_FENCED;
+		phb3_set_state(p, PHB3_STATE_FENCED);
 		return true;
 	}
 	return false;
@@ -533,10 +587,26 @@ static int64_t phb3_presence_detect(struct phb *phb)
 	return OPAL_SHPC_DEV_PRESENT;
 }
 
+static inline void phb3_ioda_set_dirty(uint64_t *dirty, uint32_t idx)
+{
+	dirty[idx / 64] |= 1ull << (idx % 64);
+}
+
+/* Update a cached IODA entry, flagging it for the next flush if changed */
+static inline void phb3_ioda_cache_set(uint64_t *cache, uint64_t *dirty,
+				       uint32_t idx, uint64_t val)
+{
+	if (cache[idx] == val)
+		return;
+	cache[idx] = val;
+	phb3_ioda_set_dirty(dirty, idx);
+}
+
 /* Clear IODA cache tables */
 static void phb3_init_ioda_cache(struct phb3 *p)
 {
-	uint32_t i;
+	static const uint8_t zero_row[PHB3_MAX_PE_NUM / 8];
+	uint32_t i, row = PHB3_MAX_PE_NUM / 8;
 	uint64_t *data64;
 
 	/*
@@ -560,7 +630,14 @@ static void phb3_init_ioda_cache(struct phb3 *p)
 	 * for EEH etc... (HW278969).
 	 */
 	memset(p->rte_cache, 0x00, RTT_TABLE_SIZE);
-	memset(p->peltv_cache, 0x0,  sizeof(p->peltv_cache));
+
+	/* PELTV is tracked by parent PE, a row of one bit per child */
+	for (i = 0; i < PHB3_MAX_PE_NUM; i++) {
+		if (!memcmp(&p->peltv_cache[i * row], zero_row, row))
+			continue;
+		memset(&p->peltv_cache[i * row], 0x0, row);
+		phb3_ioda_set_dirty(p->peltv_dirty, i);
+	}
 
 	/* Disable all LSI */
 	for (i = 0; i < ARRAY_SIZE(p->lxive_cache); i++) {
@@ -577,11 +654,84 @@ static void phb3_init_ioda_cache(struct phb3 *p)
 	}
 
 	/* Clear TVT */
-	memset(p->tve_cache, 0x0, sizeof(p->tve_cache));
+	for (i = 0; i < ARRAY_SIZE(p->tve_cache); i++)
+		phb3_ioda_cache_set(p->tve_cache, p->tve_dirty, i, 0);
 	/* Clear M32 domain */
-	memset(p->m32d_cache, 0x0, sizeof(p->m32d_cache));
+	for (i = 0; i < ARRAY_SIZE(p->m32d_cache); i++)
+		phb3_ioda_cache_set(p->m32d_cache, p->m32d_dirty, i, 0);
 	/* Clear M64 domain */
-	memset(p->m64b_cache, 0x0, sizeof(p->m64b_cache));
+	for (i = 0; i < ARRAY_SIZE(p->m64b_cache); i++)
+		phb3_ioda_cache_set(p->m64b_cache, p->m64b_dirty, i, 0);
+}
+
+/*
+ * Write back an on-chip IODA table from its cache. Unless @all is
+ * set, only the dirty entries are written, reselecting the table
+ * address at the start of each run of them and relying on the
+ * auto-increment within a run. Returns the number of entries written.
+ */
+static uint32_t phb3_ioda_flush(struct phb3 *p, uint32_t table,
+				const uint64_t *cache, uint64_t *dirty,
+				uint32_t count, bool all)
+{
+	uint32_t i, written = 0;
+	bool selected = false;
+
+	for (i = 0; i < count; i++) {
+		if (!all && !(dirty[i / 64] & (1ull << (i % 64)))) {
+			selected = false;
+			continue;
+		}
+		if (!selected) {
+			phb3_ioda_sel(p, table, i, true);
+			selected = true;
+		}
+		out_be64(p->regs + PHB_IODA_DATA0, cache[i]);
+		written++;
+	}
+	memset(dirty, 0, ((count + 63) / 64) * sizeof(uint64_t));
+
+	return written;
+}
+
+/*
+ * Clear PEST. The freeze bits live in the on-chip table, so read
+ * each half back in one auto-increment pass to report frozen PEs,
+ * then clear it in a second one, rather than reselecting the entry
+ * for every access.
+ */
+static void phb3_pest_clear(struct phb3 *p)
+{
+	uint64_t mmio_frozen[PHB3_MAX_PE_NUM / 64] = { 0 };
+	uint64_t dma_stopped[PHB3_MAX_PE_NUM / 64] = { 0 };
+	uint32_t i;
+
+	phb3_ioda_sel(p, IODA2_TBL_PESTA, 0, true);
+	for (i = 0; i < PHB3_MAX_PE_NUM; i++) {
+		if (in_be64(p->regs + PHB_IODA_DATA0) & IODA2_PESTA_MMIO_FROZEN)
+			phb3_ioda_set_dirty(mmio_frozen, i);
+	}
+	phb3_ioda_sel(p, IODA2_TBL_PESTA, 0, true);
+	for (i = 0; i < PHB3_MAX_PE_NUM; i++)
+		out_be64(p->regs + PHB_IODA_DATA0, 0);
+
+	phb3_ioda_sel(p, IODA2_TBL_PESTB, 0, true);
+	for (i = 0; i < PHB3_MAX_PE_NUM; i++) {
+		if (in_be64(p->regs + PHB_IODA_DATA0) & IODA2_PESTB_DMA_STOPPED)
+			phb3_ioda_set_dirty(dma_stopped, i);
+	}
+	phb3_ioda_sel(p, IODA2_TBL_PESTB, 0, true);
+	for (i = 0; i < PHB3_MAX_PE_NUM; i++)
+		out_be64(p->regs + PHB_IODA_DATA0, 0);
+
+	for (i = 0; i < PHB3_MAX_PE_NUM; i++) {
+		bool mmio = mmio_frozen[i / 64] & (1ull << (i % 64));
+		bool dma = dma_stopped[i / 64] & (1ull << (i % 64));
+
+		if (mmio || dma)
+			PHBDBG(p, "Frozen PE#%d (%s - %s)\n",
+			       i, mmio ? "DMA" : "", dma ? "MMIO" : "");
+	}
 }
 
 /* phb3_ioda_reset - Reset the IODA tables
@@ -599,7 +749,9 @@ static int64_t phb3_ioda_reset(struct phb *phb, bool purge)
 	struct phb3 *p = phb_to_phb3(phb);
 	uint64_t server, prio;
 	uint64_t *pdata64, data64;
-	uint32_t i;
+	uint64_t start = mftb();
+	uint32_t i, row = PHB3_MAX_PE_NUM / 8, written = 0;
+	bool all = !p->ioda_hw_valid;
 
 	if (purge) {
 		prlog(PR_DEBUG, "PHB%d: Purging all IODA tables...\n",
@@ -623,28 +775,42 @@ static int64_t phb3_ioda_reset(struct phb *phb, bool purge)
 	for (i = 0; i < 8; i++)
 		out_be64(p->regs + PHB_IODA_DATA0, 0);
 
+	/*
+	 * The remaining on-chip tables only need the entries that
+	 * changed since they were last loaded, unless the PHB was
+	 * reset underneath us
+	 */
+
 	/* Init_31..32 - TVT */
-	phb3_ioda_sel(p, IODA2_TBL_TVT, 0, true);
-	for (i = 0; i < ARRAY_SIZE(p->tve_cache); i++)
-		out_be64(p->regs + PHB_IODA_DATA0, p->tve_cache[i]);
+	written += phb3_ioda_flush(p, IODA2_TBL_TVT, p->tve_cache,
+				   p->tve_dirty, ARRAY_SIZE(p->tve_cache), all);
 
 	/* Init_33..34 - M64BT */
-	phb3_ioda_sel(p, IODA2_TBL_M64BT, 0, true);
-	for (i = 0; i < ARRAY_SIZE(p->m64b_cache); i++)
-		out_be64(p->regs + PHB_IODA_DATA0, p->m64b_cache[i]);
+	written += phb3_ioda_flush(p, IODA2_TBL_M64BT, p->m64b_cache,
+				   p->m64b_dirty, ARRAY_SIZE(p->m64b_cache), all);
 
 	/* Init_35..36 - M32DT */
-	phb3_ioda_sel(p, IODA2_TBL_M32DT, 0, true);
-	for (i = 0; i < ARRAY_SIZE(p->m32d_cache); i++)
-		out_be64(p->regs + PHB_IODA_DATA0, p->m32d_cache[i]);
+	written += phb3_ioda_flush(p, IODA2_TBL_M32DT, p->m32d_cache,
+				   p->m32d_dirty, ARRAY_SIZE(p->m32d_cache), all);
 
 	/* Load RTE, PELTV */
 	if (p->tbl_rtt)
 		memcpy((void *)p->tbl_rtt, p->rte_cache, RTT_TABLE_SIZE);
-	if (p->tbl_peltv)
-		memcpy((void *)p->tbl_peltv, p->peltv_cache, PELTV_TABLE_SIZE);
+	if (p->tbl_peltv) {
+		for (i = 0; i < PHB3_MAX_PE_NUM; i++) {
+			if (!all && !(p->peltv_dirty[i / 64] & (1ull << (i % 64))))
+				continue;
+			memcpy((void *)p->tbl_peltv + i * row,
+			       &p->peltv_cache[i * row], row);
+		}
+	}
+	memset(p->peltv_dirty, 0, sizeof(p->peltv_dirty));
 
-	/* Load IVT */
+	/*
+	 * Load IVT. This one is always rewritten in full as the HW
+	 * updates the P and Q bits of the in-memory entries behind
+	 * the cache's back.
+	 */
 	if (p->tbl_ivt) {
 		pdata64 = (uint64_t *)p->tbl_ivt;
 		for (i = 0; i < IVT_TABLE_ENTRIES; i++)
@@ -664,27 +830,16 @@ static int64_t phb3_ioda_reset(struct phb *phb, bool purge)
 	}
 
 	/* Clear PEST & PEEV */
-	for (i = 0; i < PHB3_MAX_PE_NUM; i++) {
-		uint64_t pesta, pestb;
-
-		phb3_ioda_sel(p, IODA2_TBL_PESTA, i, false);
-		pesta = in_be64(p->regs + PHB_IODA_DATA0);
-		out_be64(p->regs + PHB_IODA_DATA0, 0);
-		phb3_ioda_sel(p, IODA2_TBL_PESTB, i, false);
-		pestb = in_be64(p->regs + PHB_IODA_DATA0);
-		out_be64(p->regs + PHB_IODA_DATA0, 0);
-
-		if ((pesta & IODA2_PESTA_MMIO_FROZEN) ||
-		    (pestb & IODA2_PESTB_DMA_STOPPED))
-			PHBDBG(p, "Frozen PE#%d (%s - %s)\n",
-			       i, (pesta & IODA2_PESTA_MMIO_FROZEN) ? "DMA" : "",
-			       (pestb & IODA2_PESTB_DMA_STOPPED) ? "MMIO" : "");
-	}
+	phb3_pest_clear(p);
 
 	phb3_ioda_sel(p, IODA2_TBL_PEEV, 0, true);
 	for (i = 0; i < 4; i++)
 		out_be64(p->regs + PHB_IODA_DATA0, 0);
 
+	p->ioda_hw_valid = true;
+	PHBDBG(p, "IODA reset: %d cached entries written in %lu us\n",
+	       written, tb_to_usecs(mftb() - start));
+
 	return OPAL_SUCCESS;
 }
 
@@ -765,7 +920,7 @@ static int64_t phb3_set_phb_mem_window(struct phb *phb,
 		data64 = SETFIELD(IODA2_M64BT_MASK, data64,
 				  0x40000000 - (size >> 20));
 	}
-	p->m64b_cache[window_num] = data64;
+	phb3_ioda_cache_set(p->m64b_cache, p->m64b_dirty, window_num, data64);
 
 	return OPAL_SUCCESS;
 }
@@ -889,7 +1044,8 @@ static int64_t phb3_map_pe_mmio_window(struct phb *phb,
 		data64 |= IODA2_M64BT_SINGLE_PE;
 		data64 = SETFIELD(IODA2_M64BT_PE_HI, data64, pe_num >> 5);
 		data64 = SETFIELD(IODA2_M64BT_PE_LOW, data64, pe_num);
-		*cache = data64;
+		phb3_ioda_cache_set(p->m64b_cache, p->m64b_dirty,
+				    window_num, data64);
 
 		break;
 	default:
@@ -1978,13 +2134,13 @@ static int64_t phb3_sm_link_poll(struct phb3 *p)
 		if (reg & (PHB_PCIE_DLP_INBAND_PRESENCE |
 			   PHB_PCIE_DLP_TC_DL_LINKACT)) {
 			PHBDBG(p, "Electrical link detected...\n");
-			p->state = PHB3_STATE_WAIT_LINK;
+			phb3_set_state(p, PHB3_STATE_WAIT_LINK);
 			p->retries = PHB3_LINK_WAIT_RETRIES;
 		} else if (p->retries-- == 0) {
 			PHBDBG(p, "Timeout waiting for electrical link\n");
 			PHBDBG(p, "DLP train control: 0x%016llx\n", reg);
 			/* No link, we still mark the PHB as functional */
-			p->state = PHB3_STATE_FUNCTIONAL;
+			phb3_set_state(p, PHB3_STATE_FUNCTIONAL);
 			return OPAL_SUCCESS;
 		}
 		return phb3_set_sm_timeout(p, msecs_to_tb(100));
@@ -1998,14 +2154,14 @@ static int64_t phb3_sm_link_poll(struct phb3 *p)
 			/* Setup PHB for link up */
 			phb3_setup_for_link_up(p);
 			PHBDBG(p, "Link is up!\n");
-			p->state = PHB3_STATE_FUNCTIONAL;
+			phb3_set_state(p, PHB3_STATE_FUNCTIONAL);
 			return OPAL_SUCCESS;
 		}
 		if (p->retries-- == 0) {
 			PHBDBG(p, "Timeout waiting for link up\n");
 			PHBDBG(p, "DLP train control: 0x%016llx\n", reg);
 			/* No link, we still mark the PHB as functional */
-			p->state = PHB3_STATE_FUNCTIONAL;
+			phb3_set_state(p, PHB3_STATE_FUNCTIONAL);
 			return OPAL_SUCCESS;
 		}
 		return phb3_set_sm_timeout(p, msecs_to_tb(100));
@@ -2024,7 +2180,7 @@ static int64_t phb3_start_link_poll(struct phb3 *p)
 	 * stablished according to the DLP link control register
 	 */
 	p->retries = PHB3_LINK_ELECTRICAL_RETRIES;
-	p->state = PHB3_STATE_WAIT_LINK_ELECTRICAL;
+	phb3_set_state(p, PHB3_STATE_WAIT_LINK_ELECTRICAL);
 	return phb3_set_sm_timeout(p, msecs_to_tb(100));
 }
 
@@ -2049,7 +2205,7 @@ static int64_t phb3_sm_hot_reset(struct phb3 *p)
 		phb3_pcicfg_write16(&p->phb, 0, PCI_CFG_BRCTL, brctl);
 		PHBDBG(p, "Slot hreset: assert reset\n");
 
-		p->state = PHB3_STATE_HRESET_DELAY;
+		phb3_set_state(p, PHB3_STATE_HRESET_DELAY);
 		return phb3_set_sm_timeout(p, secs_to_tb(1));
 	case PHB3_STATE_HRESET_DELAY:
 		/* Turn off hot reset */
@@ -2065,7 +2221,7 @@ static int64_t phb3_sm_hot_reset(struct phb3 *p)
 		 * we can get a spurrious link down interrupt which
 		 * causes us to EEH immediately.
 		 */
-		p->state = PHB3_STATE_HRESET_DELAY2;
+		phb3_set_state(p, PHB3_STATE_HRESET_DELAY2);
 		return phb3_set_sm_timeout(p, secs_to_tb(1));
 	case PHB3_STATE_HRESET_DELAY2:
 		return phb3_start_link_poll(p);
@@ -2074,7 +2230,7 @@ static int64_t phb3_sm_hot_reset(struct phb3 *p)
 		break;
 	}
 
-	p->state = PHB3_STATE_FUNCTIONAL;
+	phb3_set_state(p, PHB3_STATE_FUNCTIONAL);
 	return OPAL_HARDWARE;
 }
 
@@ -2111,7 +2267,7 @@ static int64_t phb3_sm_fundamental_reset(struct phb3 *p)
 	/* Handle boot time skipping of reset */
 	if (p->skip_perst && p->state == PHB3_STATE_FUNCTIONAL) {
 		PHBINF(p, "Cold boot, skipping PERST assertion\n");
-		p->state = PHB3_STATE_FRESET_ASSERT_DELAY;
+		phb3_set_state(p, PHB3_STATE_FRESET_ASSERT_DELAY);
 		/* PERST skipping happens only once */
 		p->skip_perst = false;
 	}
@@ -2130,7 +2286,7 @@ static int64_t phb3_sm_fundamental_reset(struct phb3 *p)
 		PHBDBG(p, "Slot freset: Asserting PERST\n");
 
 		/* XXX Check delay for PERST... doing 1s for now */
-		p->state = PHB3_STATE_FRESET_ASSERT_DELAY;
+		phb3_set_state(p, PHB3_STATE_FRESET_ASSERT_DELAY);
 		return phb3_set_sm_timeout(p, secs_to_tb(1));
 
 	case PHB3_STATE_FRESET_ASSERT_DELAY:
@@ -2140,7 +2296,7 @@ static int64_t phb3_sm_fundamental_reset(struct phb3 *p)
 		out_be64(p->regs + PHB_RESET, reg);
 		PHBDBG(p, "Slot freset: Deasserting PERST\n");
 
-		p->state = PHB3_STATE_FRESET_DEASSERT_DELAY;
+		phb3_set_state(p, PHB3_STATE_FRESET_DEASSERT_DELAY);
 		/* CAPP fpga requires 1s to flash before polling link */
 		return phb3_set_sm_timeout(p, secs_to_tb(1));
 
@@ -2154,7 +2310,7 @@ static int64_t phb3_sm_fundamental_reset(struct phb3 *p)
 		break;
 	}
 
-	p->state = PHB3_STATE_FUNCTIONAL;
+	phb3_set_state(p, PHB3_STATE_FUNCTIONAL);
 	return OPAL_HARDWARE;
 }
 
@@ -2357,7 +2513,7 @@ static int64_t phb3_sm_complete_reset(struct phb3 *p)
 		xscom_read(p->chip_id, p->spci_xscom + 1, &val);/* HW275117 */
 		xscom_write(p->chip_id, p->pci_xscom + 0xa,
 			    0x8000000000000000);
-		p->state = PHB3_STATE_CRESET_WAIT_CQ;
+		phb3_set_state(p, PHB3_STATE_CRESET_WAIT_CQ);
 		p->retries = 500;
 		return phb3_set_sm_timeout(p, msecs_to_tb(10));
 	case PHB3_STATE_CRESET_WAIT_CQ:
@@ -2368,7 +2524,7 @@ static int64_t phb3_sm_complete_reset(struct phb3 *p)
 		if (!(cqsts & 0xC000000000000000)) {
 			xscom_write(p->chip_id, p->pe_xscom + 0x1, ~p->nfir_cache);
 
-			p->state = PHB3_STATE_CRESET_REINIT;
+			phb3_set_state(p, PHB3_STATE_CRESET_REINIT);
 			return phb3_set_sm_timeout(p, msecs_to_tb(100));
 		}
 
@@ -2382,10 +2538,10 @@ static int64_t phb3_sm_complete_reset(struct phb3 *p)
 		p->flags &= ~PHB3_CAPP_RECOVERY;
 		phb3_init_hw(p, false);
 
-		p->state = PHB3_STATE_CRESET_FRESET;
+		phb3_set_state(p, PHB3_STATE_CRESET_FRESET);
 		return phb3_set_sm_timeout(p, msecs_to_tb(100));
 	case PHB3_STATE_CRESET_FRESET:
-		p->state = PHB3_STATE_FUNCTIONAL;
+		phb3_set_state(p, PHB3_STATE_FUNCTIONAL);
 		p->flags |= PHB3_CFG_BLOCKED;
 		return phb3_sm_fundamental_reset(p);
 	default:
@@ -2394,7 +2550,7 @@ static int64_t phb3_sm_complete_reset(struct phb3 *p)
 
 	/* Mark the PHB as dead and expect it to be removed */
 error:
-	p->state = PHB3_STATE_BROKEN;
+	phb3_set_state(p, PHB3_STATE_BROKEN);
 	return OPAL_PARAMETER;
 }
 
@@ -3825,6 +3981,9 @@ static void phb3_init_hw(struct phb3 *p, bool first_init)
 
 	PHBDBG(p, "Initializing PHB...\n");
 
+	/* The reset below wipes the on-chip IODA tables */
+	p->ioda_hw_valid = false;
+
 	/* Fixups for PEC inits */
 	if (phb3_fixup_pec_inits(p)) {
 		PHBERR(p, "Failed to init PEC, PHB appears broken\n");
@@ -4013,7 +4172,7 @@ static void phb3_init_hw(struct phb3 *p, bool first_init)
 	out_be64(p->regs + PHB_TIMEOUT_CTRL2,			0x2320d71600000000);
 
 	/* Mark the PHB as functional which enables all the various sequences */
-	p->state = PHB3_STATE_FUNCTIONAL;
+	phb3_set_state(p, PHB3_STATE_FUNCTIONAL);
 
 	PHBDBG(p, "Initialization complete\n");
 
@@ -4021,7 +4180,7 @@ static void phb3_init_hw(struct phb3 *p, bool first_init)
 
  failed:
 	PHBERR(p, "Initialization failed\n");
-	p->state = PHB3_STATE_BROKEN;
+	phb3_set_state(p, PHB3_STATE_BROKEN);
 }
 
 static void phb3_allocate_tables(struct phb3 *p)
@@ -4210,7 +4369,7 @@ static void phb3_create(struct dt_node *np)
 	p->phb.phb_type = phb_type_pcie_v3;
 	p->phb.scan_map = 0x1; /* Only device 0 to scan */
 	p->max_link_speed = dt_prop_get_u32_def(np, "ibm,max-link-speed", 3);
-	p->state = PHB3_STATE_UNINITIALIZED;
+	phb3_set_state(p, PHB3_STATE_UNINITIALIZED);
 
 	if (!phb3_calculate_windows(p))
 		return;
@@ -169,20 +169,17 @@ static int sfc_buf_write(uint32_t len, const void *data)
 
 static int sfc_buf_read(uint32_t len, void *data)
 {
-	uint32_t tmp, off = 0;
+	uint32_t tmp, off = len & ~3;
 	int rc;
 
 	if (len > SFC_CMDBUF_SIZE)
 		return FLASH_ERR_PARM_ERROR;
 
-	while (len >= 4) {
-		rc = lpc_fw_read32(data, SFC_CMDBUF_OFFSET + off);
-		if (rc)
-			return rc;
-		off += 4;
-		len -= 4;
-		data += 4;
-	}
+	rc = lpc_fw_read_block(SFC_CMDBUF_OFFSET, data, off);
+	if (rc)
+		return rc;
+	len -= off;
+	data += off;
 	if (!len)
 		return 0;
 
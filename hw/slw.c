@@ -179,57 +179,68 @@ static void slw_unpatch_reset(void)
 }
 #endif /* __HAVE_LIBPORE__ */
 
-static bool slw_general_init(struct proc_chip *chip, struct cpu_thread *c)
+/*
+ * The per-core idle setup is a fixed sequence of SCOMs, each step below
+ * queues its share into one batch so a core costs a single trip through
+ * the XSCOM lock instead of one per access.
+ */
+#define SLW_CORE_MAX_OPS	16
+
+struct slw_core_batch {
+	struct xscom_op		ops[SLW_CORE_MAX_OPS];
+	struct opal_err_info	*einfo[SLW_CORE_MAX_OPS];
+	const char		*what[SLW_CORE_MAX_OPS];
+	unsigned int		count;
+
+	/* Read backs, for debug */
+	struct xscom_op		*gp0, *oha_mode, *gp1, *history[2];
+};
+
+static struct xscom_op *slw_add_op(struct slw_core_batch *b,
+				   enum xscom_op_type type, uint64_t addr,
+				   uint64_t data, uint64_t mask,
+				   struct opal_err_info *einfo,
+				   const char *what)
 {
-	uint32_t core = pir_to_core_id(c->pir);
-	uint64_t tmp;
-	int rc;
+	struct xscom_op *op = &b->ops[b->count];
+
+	assert(b->count < SLW_CORE_MAX_OPS);
+	op->type = type;
+	op->addr = addr;
+	op->data = data;
+	op->mask = mask;
+	b->einfo[b->count] = einfo;
+	b->what[b->count] = what;
+	b->count++;
+
+	return op;
+}
+
+static void slw_general_init(struct slw_core_batch *b, uint32_t core)
+{
+	struct opal_err_info *einfo = &e_info(OPAL_RC_SLW_INIT);
 
 	/* PowerManagement GP0 clear PM_DISABLE */
-	rc = xscom_read(chip->id, XSCOM_ADDR_P8_EX_SLAVE(core, EX_PM_GP0), &tmp);
-	if (rc) {
-		log_simple_error(&e_info(OPAL_RC_SLW_INIT),
-				"SLW: Failed to read PM_GP0\n");
-		return false;
-	}
-	tmp = tmp & ~0x8000000000000000ULL;
-	rc = xscom_write(chip->id, XSCOM_ADDR_P8_EX_SLAVE(core, EX_PM_GP0), tmp);
-	if (rc) {
-		log_simple_error(&e_info(OPAL_RC_SLW_INIT),
-				"SLW: Failed to write PM_GP0\n");
-		return false;
-	}
-	prlog(PR_TRACE, "SLW: PMGP0 set to 0x%016llx\n", tmp);
+	slw_add_op(b, XSCOM_OP_RMW, XSCOM_ADDR_P8_EX_SLAVE(core, EX_PM_GP0),
+		   0, 0x8000000000000000ULL, einfo, "update PM_GP0");
 
 	/* Read back for debug */
-	rc = xscom_read(chip->id, XSCOM_ADDR_P8_EX_SLAVE(core, EX_PM_GP0), &tmp);
-	prlog(PR_TRACE, "SLW: PMGP0 read   0x%016llx\n", tmp);
-
+	b->gp0 = slw_add_op(b, XSCOM_OP_READ,
+			    XSCOM_ADDR_P8_EX_SLAVE(core, EX_PM_GP0),
+			    0, 0, einfo, "read PM_GP0");
 
 	/* Set CORE and ECO PFET Vret to select zero */
-	rc = xscom_write(chip->id,
-			 XSCOM_ADDR_P8_EX_SLAVE(core, EX_PM_CORE_PFET_VRET), 0);
-	if (rc) {
-		log_simple_error(&e_info(OPAL_RC_SLW_INIT),
-			"SLW: Failed to write PM_CORE_PFET_VRET\n");
-		return false;
-	}
-	rc = xscom_write(chip->id,
-			 XSCOM_ADDR_P8_EX_SLAVE(core, EX_PM_CORE_ECO_VRET), 0);
-	if (rc) {
-		log_simple_error(&e_info(OPAL_RC_SLW_INIT),
-			"SLW: Failed to write PM_CORE_ECO_VRET\n");
-		return false;
-	}
-
-	return true;
+	slw_add_op(b, XSCOM_OP_WRITE,
+		   XSCOM_ADDR_P8_EX_SLAVE(core, EX_PM_CORE_PFET_VRET),
+		   0, 0, einfo, "write PM_CORE_PFET_VRET");
+	slw_add_op(b, XSCOM_OP_WRITE,
+		   XSCOM_ADDR_P8_EX_SLAVE(core, EX_PM_CORE_ECO_VRET),
+		   0, 0, einfo, "write PM_CORE_ECO_VRET");
 }
 
-static bool slw_set_overrides(struct proc_chip *chip, struct cpu_thread *c)
+static void slw_set_overrides(struct slw_core_batch *b, uint32_t core)
 {
-	uint32_t core = pir_to_core_id(c->pir);
-	uint64_t tmp;
-	int rc;
+	struct opal_err_info *einfo = &e_info(OPAL_RC_SLW_SET);
 
 	/*
 	 * Set ENABLE_IGNORE_RECOV_ERRORS in OHA_MODE_REG
@@ -238,58 +249,29 @@ static bool slw_set_overrides(struct proc_chip *chip, struct cpu_thread *c)
 	 * when doing repairs or LE transition, and we should restore the
 	 * original value when done
 	 */
-	rc = xscom_read(chip->id, XSCOM_ADDR_P8_EX(core, PM_OHA_MODE_REG),
-			&tmp);
-	if (rc) {
-		log_simple_error(&e_info(OPAL_RC_SLW_SET),
-				"SLW: Failed to read PM_OHA_MODE_REG\n");
-		return false;
-	}
-	tmp = tmp | 0x8000000000000000ULL;
-	rc = xscom_write(chip->id, XSCOM_ADDR_P8_EX(core, PM_OHA_MODE_REG),
-			 tmp);
-	if (rc) {
-		log_simple_error(&e_info(OPAL_RC_SLW_SET),
-				"SLW: Failed to write PM_OHA_MODE_REG\n");
-		return false;
-	}
-	prlog(PR_TRACE, "SLW: PM_OHA_MODE_REG set to 0x%016llx\n", tmp);
+	slw_add_op(b, XSCOM_OP_RMW, XSCOM_ADDR_P8_EX(core, PM_OHA_MODE_REG),
+		   0x8000000000000000ULL, 0x8000000000000000ULL, einfo,
+		   "update PM_OHA_MODE_REG");
 
 	/* Read back for debug */
-	rc = xscom_read(chip->id, XSCOM_ADDR_P8_EX(core, PM_OHA_MODE_REG),&tmp);
-	prlog(PR_TRACE, "SLW: PM_OHA_MODE_REG read   0x%016llx\n", tmp);
+	b->oha_mode = slw_add_op(b, XSCOM_OP_READ,
+				 XSCOM_ADDR_P8_EX(core, PM_OHA_MODE_REG),
+				 0, 0, einfo, "read PM_OHA_MODE_REG");
 
 	/*
 	 * Clear special wakeup bits that could hold power mgt
 	 *
 	 * XXX FIXME: See above
 	 */
-	rc = xscom_write(chip->id,
-			 XSCOM_ADDR_P8_EX_SLAVE(core, EX_PM_SPECIAL_WAKEUP_FSP),
-			 0);
-	if (rc) {
-		log_simple_error(&e_info(OPAL_RC_SLW_SET),
-			"SLW: Failed to write PM_SPECIAL_WAKEUP_FSP\n");
-		return false;
-	}
-	rc = xscom_write(chip->id,
-			 XSCOM_ADDR_P8_EX_SLAVE(core, EX_PM_SPECIAL_WAKEUP_OCC),
-			 0);
-	if (rc) {
-		log_simple_error(&e_info(OPAL_RC_SLW_SET),
-			"SLW: Failed to write PM_SPECIAL_WAKEUP_OCC\n");
-		return false;
-	}
-	rc = xscom_write(chip->id,
-			 XSCOM_ADDR_P8_EX_SLAVE(core, EX_PM_SPECIAL_WAKEUP_PHYP),
-			 0);
-	if (rc) {
-		log_simple_error(&e_info(OPAL_RC_SLW_SET),
-			"SLW: Failed to write PM_SPECIAL_WAKEUP_PHYP\n");
-		return false;
-	}
-
-	return true;
+	slw_add_op(b, XSCOM_OP_WRITE,
+		   XSCOM_ADDR_P8_EX_SLAVE(core, EX_PM_SPECIAL_WAKEUP_FSP),
+		   0, 0, einfo, "write PM_SPECIAL_WAKEUP_FSP");
+	slw_add_op(b, XSCOM_OP_WRITE,
+		   XSCOM_ADDR_P8_EX_SLAVE(core, EX_PM_SPECIAL_WAKEUP_OCC),
+		   0, 0, einfo, "write PM_SPECIAL_WAKEUP_OCC");
+	slw_add_op(b, XSCOM_OP_WRITE,
+		   XSCOM_ADDR_P8_EX_SLAVE(core, EX_PM_SPECIAL_WAKEUP_PHYP),
+		   0, 0, einfo, "write PM_SPECIAL_WAKEUP_PHYP");
 }
 
 #ifdef __HAVE_LIBPORE__
@@ -303,11 +285,9 @@ static bool slw_unset_overrides(struct proc_chip *chip, struct cpu_thread *c)
 }
 #endif /* __HAVE_LIBPORE__ */
 
-static bool slw_set_idle_mode(struct proc_chip *chip, struct cpu_thread *c)
+static void slw_set_idle_mode(struct slw_core_batch *b, uint32_t core)
 {
-	uint32_t core = pir_to_core_id(c->pir);
-	uint64_t tmp;
-	int rc;
+	struct opal_err_info *einfo = &e_info(OPAL_RC_SLW_SET);
 
 	/*
 	 * PM GP1 allows fast/deep mode to be selected independently for sleep
@@ -318,83 +298,70 @@ static bool slw_set_idle_mode(struct proc_chip *chip, struct cpu_thread *c)
 	 * managing idle states are cleared so as to override any bits set at
 	 * init time.
 	 */
-
-	tmp = ~EX_PM_GP1_SLEEP_WINKLE_MASK;
-	rc = xscom_write(chip->id, XSCOM_ADDR_P8_EX_SLAVE(core, EX_PM_CLEAR_GP1),
-			 tmp);
-	if (rc) {
-		log_simple_error(&e_info(OPAL_RC_SLW_SET),
-						"SLW: Failed to write PM_GP1\n");
-		return false;
-	}
-
-	rc = xscom_write(chip->id, XSCOM_ADDR_P8_EX_SLAVE(core, EX_PM_SET_GP1),
-			 EX_PM_SETUP_GP1_FAST_SLEEP_DEEP_WINKLE);
-	if (rc) {
-		log_simple_error(&e_info(OPAL_RC_SLW_SET),
-						"SLW: Failed to write PM_GP1\n");
-		return false;
-	}
+	slw_add_op(b, XSCOM_OP_WRITE,
+		   XSCOM_ADDR_P8_EX_SLAVE(core, EX_PM_CLEAR_GP1),
+		   ~EX_PM_GP1_SLEEP_WINKLE_MASK, 0, einfo, "write PM_GP1");
+	slw_add_op(b, XSCOM_OP_WRITE,
+		   XSCOM_ADDR_P8_EX_SLAVE(core, EX_PM_SET_GP1),
+		   EX_PM_SETUP_GP1_FAST_SLEEP_DEEP_WINKLE, 0, einfo,
+		   "write PM_GP1");
 
 	/* Read back for debug */
-	xscom_read(chip->id, XSCOM_ADDR_P8_EX_SLAVE(core, EX_PM_GP1), &tmp);
-	prlog(PR_TRACE, "SLW: PMGP1 read   0x%016llx\n", tmp);
-	return true;
+	b->gp1 = slw_add_op(b, XSCOM_OP_READ,
+			    XSCOM_ADDR_P8_EX_SLAVE(core, EX_PM_GP1),
+			    0, 0, einfo, "read PM_GP1");
 }
 
-static bool slw_get_idle_state_history(struct proc_chip *chip, struct cpu_thread *c)
+static void slw_get_idle_state_history(struct slw_core_batch *b,
+				       uint32_t core)
 {
-	uint32_t core = pir_to_core_id(c->pir);
-	uint64_t tmp;
-	int rc;
+	struct opal_err_info *einfo = &e_info(OPAL_RC_SLW_GET);
+	unsigned int i;
 
 	/* Cleanup history */
-	rc = xscom_read(chip->id,
-		   XSCOM_ADDR_P8_EX_SLAVE(core, EX_PM_IDLE_STATE_HISTORY_PHYP),
-		   &tmp);
-	if (rc) {
-		log_simple_error(&e_info(OPAL_RC_SLW_GET),
-			"SLW: Failed to read PM_IDLE_STATE_HISTORY\n");
-		return false;
-	}
-
-	prlog(PR_TRACE, "SLW: core %x:%x history: 0x%016llx (old1)\n",
-	    chip->id, core, tmp);
-
-	rc = xscom_read(chip->id,
-		   XSCOM_ADDR_P8_EX_SLAVE(core, EX_PM_IDLE_STATE_HISTORY_PHYP),
-		   &tmp);
+	for (i = 0; i < 2; i++)
+		b->history[i] = slw_add_op(b, XSCOM_OP_READ,
+			XSCOM_ADDR_P8_EX_SLAVE(core,
+					       EX_PM_IDLE_STATE_HISTORY_PHYP),
+			0, 0, einfo, "read PM_IDLE_STATE_HISTORY");
+}
 
-	if (rc) {
-		log_simple_error(&e_info(OPAL_RC_SLW_GET),
-			"SLW: Failed to read PM_IDLE_STATE_HISTORY\n");
+/* @b is the chip's batch, too big for the stack of a job */
+static bool idle_prepare_core(struct proc_chip *chip, struct cpu_thread *c,
+			      struct slw_core_batch *b)
+{
+	uint32_t core = pir_to_core_id(c->pir);
+	unsigned int i;
+
+	prlog(PR_TRACE, "FASTSLEEP: Prepare core %x:%x\n", chip->id, core);
+
+	memset(b, 0, sizeof(*b));
+	slw_general_init(b, core);
+	slw_set_overrides(b, core);
+	slw_set_idle_mode(b, core);
+	slw_get_idle_state_history(b, core);
+
+	if (xscom_batch(chip->id, b->ops, b->count)) {
+		/* The batch stops at the first failure */
+		for (i = 0; i < b->count && !b->ops[i].rc; i++)
+			;
+		log_simple_error(b->einfo[i], "SLW: Failed to %s on core %x:%x\n",
+				 b->what[i], chip->id, core);
 		return false;
 	}
 
+	prlog(PR_TRACE, "SLW: PMGP0 read   0x%016llx\n", b->gp0->data);
+	prlog(PR_TRACE, "SLW: PM_OHA_MODE_REG read   0x%016llx\n",
+	      b->oha_mode->data);
+	prlog(PR_TRACE, "SLW: PMGP1 read   0x%016llx\n", b->gp1->data);
+	prlog(PR_TRACE, "SLW: core %x:%x history: 0x%016llx (old1)\n",
+	      chip->id, core, b->history[0]->data);
 	prlog(PR_TRACE, "SLW: core %x:%x history: 0x%016llx (old2)\n",
-	    chip->id, core, tmp);
+	      chip->id, core, b->history[1]->data);
 
 	return true;
 }
 
-static bool idle_prepare_core(struct proc_chip *chip, struct cpu_thread *c)
-{
-	prlog(PR_TRACE, "FASTSLEEP: Prepare core %x:%x\n",
-	    chip->id, pir_to_core_id(c->pir));
-
-	if(!slw_general_init(chip, c))
-		return false;
-	if(!slw_set_overrides(chip, c))
-		return false;
-	if(!slw_set_idle_mode(chip, c))
-		return false;
-	if(!slw_get_idle_state_history(chip, c))
-		return false;
-
-	return true;
-
-}
-
 /* Define device-tree fields */
 #define MAX_NAME_LEN	16
 struct cpu_idle_states {
@@ -891,10 +858,17 @@ static void slw_patch_regs(struct proc_chip *chip)
 }
 #endif /* __HAVE_LIBPORE__ */
 
-static void slw_init_chip(struct proc_chip *chip)
+/* Can run concurrently for all chips, on a thread of @chip */
+void slw_init_chip(struct proc_chip *chip)
 {
 	int rc __unused;
 	struct cpu_thread *c;
+	unsigned int cores = 0, failed = 0;
+	uint64_t start = mftb(), patched;
+	struct slw_core_batch *batch;
+
+	if (proc_gen != proc_gen_p8)
+		return;
 
 	prlog(PR_DEBUG, "SLW: Init chip 0x%x\n", chip->id);
 
@@ -928,23 +902,35 @@ static void slw_init_chip(struct proc_chip *chip)
 	/* Patch SLW image */
         slw_patch_regs(chip);
 #endif /* __HAVE_LIBPORE__ */
+	patched = mftb();
 
 	/* At power ON setup inits for fast-sleep */
+	batch = zalloc(sizeof(*batch));
+	if (!batch) {
+		log_simple_error(&e_info(OPAL_RC_SLW_INIT),
+			"SLW: Chip 0x%x: out of memory for core setup\n",
+			chip->id);
+		return;
+	}
 	for_each_available_core_in_chip(c, chip->id) {
-		idle_prepare_core(chip, c);
+		cores++;
+		if (!idle_prepare_core(chip, c, batch))
+			failed++;
 	}
+	free(batch);
+
+	prlog(PR_INFO, "SLW: Chip 0x%x done in %lu us (image %lu us,"
+	      " %u cores %lu us%s)\n", chip->id, tb_to_usecs(mftb() - start),
+	      tb_to_usecs(patched - start), cores,
+	      tb_to_usecs(mftb() - patched), failed ? ", some failed" : "");
 }
 
+/* Once slw_init_chip() is done on all chips */
 void slw_init(void)
 {
-	struct proc_chip *chip;
-
 	if (proc_gen != proc_gen_p8)
 		return;
 
-	for_each_chip(chip)
-		slw_init_chip(chip);
-
 	add_cpu_idle_state_properties();
 }
 
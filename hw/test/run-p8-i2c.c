@@ -0,0 +1,541 @@
+/* Copyright 2013-2014 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host simulation of the P8 I2C master state machine: the XSCOM
+ * accessors below model one engine with an 8 entry FIFO and a small
+ * EEPROM behind each port, and the bus moves a few bytes every time
+ * the driver looks at the status register.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <assert.h>
+
+#define __TEST__
+
+static uint64_t sim_tb;
+#define mftb()	(sim_tb)
+
+#include "../p8-i2c.c"
+
+#undef zalloc
+#undef free
+
+/* Locking: catch unbalanced lock/unlock */
+void lock(struct lock *l)
+{
+	assert(!l->lock_val);
+	l->lock_val = 1;
+}
+
+void unlock(struct lock *l)
+{
+	assert(l->lock_val);
+	l->lock_val = 0;
+}
+
+void *__zalloc(size_t size, const char *location)
+{
+	(void)location;
+	return calloc(size, 1);
+}
+
+void __free(void *p, const char *location)
+{
+	(void)location;
+	free(p);
+}
+
+void _prlog(int log_level, const char* fmt, ...)
+{
+	(void)log_level;
+	(void)fmt;
+}
+
+void log_simple_error(struct opal_err_info *e_info, const char *fmt, ...)
+{
+	(void)e_info;
+	(void)fmt;
+}
+
+/* Timers: the tests drive expiries by hand */
+void init_timer(struct timer *t, timer_func_t expiry, void *data)
+{
+	memset(t, 0, sizeof(*t));
+	t->expiry = expiry;
+	t->user_data = data;
+}
+
+uint64_t schedule_timer(struct timer *t, uint64_t how_long)
+{
+	t->target = sim_tb + how_long;
+	return sim_tb;
+}
+
+void schedule_timer_at(struct timer *t, uint64_t when)
+{
+	t->target = when;
+}
+
+void cancel_timer_async(struct timer *t)
+{
+	t->target = 0;
+}
+
+static struct proc_chip sim_chip;
+
+struct proc_chip *get_chip(uint32_t chip_id)
+{
+	assert(chip_id == 0);
+	return &sim_chip;
+}
+
+struct dt_node *dt_root;
+
+/*
+ * Simulated engine
+ */
+#define SIM_BASE		0xa0000
+#define SIM_FIFO_SIZE		8
+#define SIM_BYTES_PER_STAT	3	/* bus progress per status read */
+#define SIM_NPORTS		2
+#define SIM_EEPROM_ADDR		0x50
+
+static struct {
+	uint64_t	mode;
+	uint64_t	watermark;
+	uint64_t	intr_cond;
+	uint64_t	err;		/* Sticky STAT error bits */
+	bool		busy;		/* Command in progress */
+	bool		read;
+	bool		nack;
+	uint32_t	len;		/* Bytes left on the bus */
+	uint32_t	pos;		/* Bytes of this command seen */
+	uint8_t		fifo[SIM_FIFO_SIZE];
+	uint32_t	fifo_count;
+	/* One EEPROM per port, first byte of a write sets the address */
+	uint8_t		mem[SIM_NPORTS][256];
+	uint8_t		ptr[SIM_NPORTS];
+
+	/* Access accounting */
+	unsigned int	reads, writes, batches, fifo_ops;
+} sim;
+
+static uint32_t sim_port(void)
+{
+	return GETFIELD(I2C_MODE_PORT_NUM, sim.mode);
+}
+
+static void sim_fifo_push(uint8_t b)
+{
+	assert(sim.fifo_count < SIM_FIFO_SIZE);
+	sim.fifo[sim.fifo_count++] = b;
+}
+
+static uint8_t sim_fifo_pop(void)
+{
+	uint8_t b;
+
+	assert(sim.fifo_count);
+	b = sim.fifo[0];
+	memmove(sim.fifo, sim.fifo + 1, --sim.fifo_count);
+	return b;
+}
+
+/* Move up to SIM_BYTES_PER_STAT bytes between the FIFO and the device */
+static void sim_bus_tick(void)
+{
+	uint32_t port = sim_port(), n;
+
+	if (!sim.busy)
+		return;
+	if (sim.nack) {
+		sim.err |= I2C_STAT_NACK_RCVD_ERR;
+		sim.busy = false;
+		return;
+	}
+	for (n = 0; n < SIM_BYTES_PER_STAT && sim.len; n++) {
+		if (sim.read) {
+			if (sim.fifo_count == SIM_FIFO_SIZE)
+				break;
+			sim_fifo_push(sim.mem[port][sim.ptr[port]++]);
+		} else {
+			if (!sim.fifo_count)
+				break;
+			if (sim.pos++ == 0)
+				sim.ptr[port] = sim_fifo_pop();
+			else
+				sim.mem[port][sim.ptr[port]++] = sim_fifo_pop();
+		}
+		sim.len--;
+	}
+	if (!sim.len)
+		sim.busy = false;
+}
+
+static uint64_t sim_status(void)
+{
+	uint64_t stat = sim.err;
+	uint32_t lo = GETFIELD(I2C_WATERMARK_LOW, sim.watermark);
+	uint32_t hi = GETFIELD(I2C_WATERMARK_HIGH, sim.watermark);
+
+	sim_bus_tick();
+	stat = SETFIELD(I2C_STAT_FIFO_ENTRY_COUNT, stat, sim.fifo_count);
+	if (sim.err)
+		return stat;
+	if (sim.read) {
+		if (sim.fifo_count >= hi ||
+		    (sim.fifo_count && sim.fifo_count >= sim.len))
+			stat |= I2C_STAT_DATA_REQ;
+		else if (!sim.busy && !sim.fifo_count)
+			stat |= I2C_STAT_CMD_COMP;
+	} else {
+		if (sim.busy && sim.fifo_count <= lo &&
+		    sim.fifo_count < sim.len)
+			stat |= I2C_STAT_DATA_REQ;
+		else if (!sim.busy)
+			stat |= I2C_STAT_CMD_COMP;
+	}
+	return stat;
+}
+
+static void sim_command(uint64_t cmd)
+{
+	assert(!sim.busy);
+	sim.pos = 0;
+	sim.fifo_count = 0;
+	if (!(cmd & I2C_CMD_WITH_START)) {
+		/* Immediate STOP after an error */
+		assert(cmd == I2C_CMD_WITH_STOP);
+		sim.read = false;
+		sim.len = 0;
+		return;
+	}
+	sim.read = !!(cmd & I2C_CMD_READ_NOT_WRITE);
+	sim.len = GETFIELD(I2C_CMD_LEN_BYTES, cmd);
+	sim.nack = GETFIELD(I2C_CMD_DEV_ADDR, cmd) != SIM_EEPROM_ADDR;
+	sim.busy = true;
+}
+
+static void sim_reset(void)
+{
+	sim.busy = false;
+	sim.read = false;
+	sim.err = 0;
+	sim.len = 0;
+	sim.fifo_count = 0;
+}
+
+static int sim_access(uint64_t addr, uint64_t *val, bool write)
+{
+	assert(addr >= SIM_BASE);
+	switch (addr - SIM_BASE) {
+	case I2C_FIFO_REG:
+		if (write)
+			sim_fifo_push(GETFIELD(I2C_FIFO, *val));
+		else
+			*val = SETFIELD(I2C_FIFO, 0ull, sim_fifo_pop());
+		break;
+	case I2C_CMD_REG:
+		assert(write);
+		sim_command(*val);
+		break;
+	case I2C_MODE_REG:
+		if (write)
+			sim.mode = *val;
+		else
+			*val = sim.mode;
+		break;
+	case I2C_WATERMARK_REG:
+		if (write)
+			sim.watermark = *val;
+		else
+			*val = sim.watermark;
+		break;
+	case I2C_INTR_COND_REG:
+		assert(write);
+		sim.intr_cond = *val;
+		break;
+	case I2C_INTR_REG:
+		assert(write);
+		break;
+	case I2C_STAT_REG:
+		/* Writing the status register resets the engine */
+		if (write)
+			sim_reset();
+		else
+			*val = sim_status();
+		break;
+	case I2C_EXTD_STAT_REG:
+		assert(!write);
+		*val = SETFIELD(I2C_EXTD_STAT_FIFO_SIZE, 0ull, SIM_FIFO_SIZE);
+		break;
+	default:
+		*val = 0;
+	}
+	return 0;
+}
+
+int xscom_read(uint32_t partid, uint64_t pcb_addr, uint64_t *val)
+{
+	assert(partid == 0);
+	sim.reads++;
+	return sim_access(pcb_addr, val, false);
+}
+
+int xscom_write(uint32_t partid, uint64_t pcb_addr, uint64_t val)
+{
+	assert(partid == 0);
+	sim.writes++;
+	return sim_access(pcb_addr, &val, true);
+}
+
+int xscom_batch(uint32_t partid, struct xscom_op *ops, unsigned int count)
+{
+	unsigned int i;
+
+	assert(partid == 0);
+	sim.batches++;
+	for (i = 0; i < count; i++) {
+		assert(ops[i].type == XSCOM_OP_READ ||
+		       ops[i].type == XSCOM_OP_WRITE);
+		if (ops[i].addr == SIM_BASE + I2C_FIFO_REG)
+			sim.fifo_ops++;
+		ops[i].rc = sim_access(ops[i].addr, &ops[i].data,
+				       ops[i].type == XSCOM_OP_WRITE);
+	}
+	return 0;
+}
+
+/*
+ * Driver side
+ */
+static struct p8_i2c_master *master;
+static struct p8_i2c_master_port ports[SIM_NPORTS];
+
+static struct i2c_request *done_order[8];
+static unsigned int ndone;
+
+static void completion(int rc, struct i2c_request *req)
+{
+	req->result = rc;
+	assert(ndone < 8);
+	done_order[ndone++] = req;
+}
+
+static void setup_master(bool irq_ok)
+{
+	uint32_t i;
+
+	memset(&sim, 0, sizeof(sim));
+	memset(ports, 0, sizeof(ports));
+	memset(&sim_chip, 0, sizeof(sim_chip));
+	list_head_init(&sim_chip.i2cms);
+	free(master);
+	master = calloc(1, sizeof(*master));
+
+	master->type = I2C_POWER8;
+	master->state = state_idle;
+	master->xscom_base = SIM_BASE;
+	master->fifo_size = SIM_FIFO_SIZE;
+	master->irq_ok = irq_ok;
+	master->poll_interval = irq_ok ? TIMER_POLL : usecs_to_tb(2);
+	master->byte_timeout = msecs_to_tb(I2C_TIMEOUT_POLL_MS);
+	init_timer(&master->timeout, p8_i2c_timeout, master);
+	init_timer(&master->poller, p8_i2c_poll, master);
+	init_timer(&master->recovery, p8_i2c_recover, master);
+	init_timer(&master->sensor_cache, p8_i2c_enable_scache, master);
+	list_head_init(&master->req_list);
+	master->ports = ports;
+	master->nports = SIM_NPORTS;
+	for (i = 0; i < SIM_NPORTS; i++) {
+		ports[i].master = master;
+		ports[i].port_num = i;
+		list_head_init(&ports[i].req_list);
+		ports[i].bus.queue_req = p8_i2c_queue_request;
+		ports[i].bus.alloc_req = p8_i2c_alloc_request;
+		ports[i].bus.free_req = p8_i2c_free_request;
+	}
+	list_add_tail(&sim_chip.i2cms, &master->link);
+	assert(p8_i2c_prog_watermark(master) == 0);
+	ndone = 0;
+}
+
+static struct i2c_request *new_req(uint32_t port, int op, uint32_t offset,
+				   uint8_t *buf, uint32_t len)
+{
+	struct i2c_request *req = p8_i2c_alloc_request(&ports[port].bus);
+
+	assert(req);
+	req->op = op;
+	req->dev_addr = SIM_EEPROM_ADDR;
+	req->offset_bytes = (op == SMBUS_READ || op == SMBUS_WRITE) ? 1 : 0;
+	req->offset = offset;
+	req->rw_buf = buf;
+	req->rw_len = len;
+	req->completion = completion;
+	req->result = 1;
+	return req;
+}
+
+/* Run the engine until @count requests have completed */
+static void run(unsigned int count, bool irq)
+{
+	unsigned int spins = 0;
+
+	while (ndone < count) {
+		assert(spins++ < 10000);
+		sim_tb += 100;
+		if (irq)
+			p8_i2c_interrupt(0);
+		else
+			p8_i2c_poll(NULL, master);
+	}
+	assert(master->state == state_idle);
+	assert(!master->lock.lock_val);
+}
+
+static void test_smbus(bool irq)
+{
+	static uint8_t wbuf[100], rbuf[100];
+	struct i2c_request *req;
+	unsigned int i;
+
+	setup_master(irq);
+	for (i = 0; i < sizeof(wbuf); i++)
+		wbuf[i] = i * 7 + 3;
+
+	req = new_req(0, SMBUS_WRITE, 0x20, wbuf, sizeof(wbuf));
+	assert(p8_i2c_queue_request(req) == 0);
+	run(1, irq);
+	assert(req->result == OPAL_SUCCESS);
+	assert(memcmp(sim.mem[0] + 0x20, wbuf, sizeof(wbuf)) == 0);
+	p8_i2c_free_request(req);
+
+	sim.batches = sim.fifo_ops = 0;
+	req = new_req(0, SMBUS_READ, 0x20, rbuf, sizeof(rbuf));
+	assert(p8_i2c_queue_request(req) == 0);
+	run(2, irq);
+	assert(req->result == OPAL_SUCCESS);
+	assert(memcmp(rbuf, wbuf, sizeof(rbuf)) == 0);
+	p8_i2c_free_request(req);
+
+	/* Offset byte plus data through the FIFO, several per batch */
+	assert(sim.fifo_ops == sizeof(rbuf) + 1);
+	assert(sim.batches * 2 < sim.fifo_ops);
+	printf("%s: %u FIFO accesses in %u batches\n",
+	       irq ? "irq" : "poll", sim.fifo_ops, sim.batches);
+}
+
+static void test_nack(void)
+{
+	static uint8_t buf[4];
+	struct i2c_request *req;
+
+	setup_master(true);
+	req = new_req(1, I2C_READ, 0, buf, sizeof(buf));
+	req->dev_addr = 0x23;
+	assert(p8_i2c_queue_request(req) == 0);
+	run(1, true);
+	assert(req->result == OPAL_I2C_NACK_RCVD);
+	p8_i2c_free_request(req);
+
+	/* The engine is usable again afterwards */
+	req = new_req(1, I2C_READ, 0, buf, sizeof(buf));
+	assert(p8_i2c_queue_request(req) == 0);
+	run(2, true);
+	assert(req->result == OPAL_SUCCESS);
+	p8_i2c_free_request(req);
+}
+
+static void test_port_fairness(void)
+{
+	static uint8_t buf[4][8];
+	struct i2c_request *a, *b, *c, *d;
+
+	setup_master(true);
+	a = new_req(0, I2C_READ, 0, buf[0], 8);
+	b = new_req(0, I2C_READ, 0, buf[1], 8);
+	c = new_req(0, I2C_READ, 0, buf[2], 8);
+	d = new_req(1, I2C_READ, 0, buf[3], 8);
+
+	/* a goes straight to the engine, the rest wait on their port */
+	assert(p8_i2c_queue_request(a) == 0);
+	assert(p8_i2c_queue_request(b) == 0);
+	assert(p8_i2c_queue_request(c) == 0);
+	assert(p8_i2c_queue_request(d) == 0);
+	assert(master->state != state_idle);
+	assert(list_top(&master->req_list, struct i2c_request, link) == a);
+
+	/* Port 1 doesn't wait behind the whole of port 0's queue */
+	run(4, true);
+	assert(done_order[0] == a);
+	assert(done_order[1] == d);
+	assert(done_order[2] == b);
+	assert(done_order[3] == c);
+	assert(a->result == 0 && b->result == 0 &&
+	       c->result == 0 && d->result == 0);
+	p8_i2c_free_request(a);
+	p8_i2c_free_request(b);
+	p8_i2c_free_request(c);
+	p8_i2c_free_request(d);
+}
+
+static void test_poll_fallback(void)
+{
+	static uint8_t buf[32];
+	struct i2c_request *req;
+	unsigned int reads;
+
+	setup_master(true);
+	req = new_req(0, I2C_READ, 0, buf, sizeof(buf));
+	assert(p8_i2c_queue_request(req) == 0);
+
+	/* Before any interrupt is seen, the poller drives the engine */
+	reads = sim.reads;
+	sim_tb += 100;
+	p8_i2c_poll(NULL, master);
+	assert(sim.reads > reads);
+
+	/* Once interrupts flow, the poller leaves the hardware alone */
+	sim_tb += 100;
+	p8_i2c_interrupt(0);
+	reads = sim.reads;
+	p8_i2c_poll(NULL, master);
+	assert(sim.reads == reads);
+	assert(master->poller.target);
+
+	/* ...until they have been quiet for too long */
+	sim_tb += msecs_to_tb(I2C_IRQ_QUIET_MS) + 1;
+	run(1, false);
+	assert(req->result == OPAL_SUCCESS);
+	p8_i2c_free_request(req);
+}
+
+int main(void)
+{
+	test_smbus(true);
+	test_smbus(false);
+	test_nack();
+	test_port_fairness();
+	test_poll_fallback();
+	free(master);
+	return 0;
+}
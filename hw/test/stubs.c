@@ -0,0 +1,41 @@
+/* Copyright 2013-2014 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdlib.h>
+
+/* Add any stub functions required for linking here. */
+static void stub_function(void)
+{
+	abort();
+}
+
+#define STUB(fnname) \
+	void fnname(void) __attribute__((weak, alias ("stub_function")))
+
+STUB(centaur_disable_sensor_cache);
+STUB(centaur_enable_sensor_cache);
+STUB(get_centaur);
+STUB(time_wait);
+STUB(i2c_add_bus);
+STUB(dt_prop_get_u32);
+STUB(dt_prop_get);
+STUB(dt_get_chip_id);
+STUB(dt_get_address);
+STUB(dt_find_property);
+STUB(dt_add_property_string);
+STUB(__dt_add_property_strings);
+STUB(dt_first);
+STUB(dt_next);
+STUB(dt_find_compatible_node);
@@ -23,6 +23,7 @@
 #include <centaur.h>
 #include <errorlog.h>
 #include <opal-api.h>
+#include <timebase.h>
 
 /* Mask of bits to clear in HMER before an access */
 #define HMER_CLR_MASK	(~(SPR_HMER_XSCOM_FAIL | \
@@ -41,6 +42,9 @@
 /* HB folks say: try 10 time for now */
 #define XSCOM_IND_MAX_RETRIES		10
 
+/* Longest a batch holds the XSCOM lock before letting others in */
+#define XSCOM_BATCH_MAX_HOLD_US		100
+
 DEFINE_LOG_ENTRY(OPAL_RC_XSCOM_RW, OPAL_PLATFORM_ERR_EVT, OPAL_XSCOM,
 		OPAL_CEC_HARDWARE, OPAL_PREDICTIVE_ERR_GENERAL,
 		OPAL_NA, NULL);
@@ -174,6 +178,28 @@ static bool xscom_gcid_ok(uint32_t gcid)
 	return get_chip(gcid) != NULL;
 }
 
+/*
+ * Count SCOMs per chip, and how many were issued over the last full
+ * second. Called with the XSCOM lock held.
+ */
+static void xscom_account(uint32_t gcid)
+{
+	struct proc_chip *chip = get_chip(gcid);
+	uint64_t now;
+
+	chip->xscom_count++;
+
+	now = mftb();
+	if (now - chip->xscom_rate_tb < secs_to_tb(1))
+		return;
+	if (now - chip->xscom_rate_tb < secs_to_tb(2))
+		chip->xscom_rate = chip->xscom_count - chip->xscom_rate_count;
+	else
+		chip->xscom_rate = 0;
+	chip->xscom_rate_count = chip->xscom_count;
+	chip->xscom_rate_tb = now;
+}
+
 /*
  * Low level XSCOM access functions, perform a single direct xscom
  * access via MMIO
@@ -187,6 +213,8 @@ static int __xscom_read(uint32_t gcid, uint32_t pcb_addr, uint64_t *val)
 		return OPAL_PARAMETER;
 	}
 
+	xscom_account(gcid);
+
 	for (;;) {
 		/* Clear status bits in HMER (HMER is special
 		 * writing to it *ands* bits
@@ -219,6 +247,8 @@ static int __xscom_write(uint32_t gcid, uint32_t pcb_addr, uint64_t val)
 		return OPAL_PARAMETER;
 	}
 
+	xscom_account(gcid);
+
 	for (;;) {
 		/* Clear status bits in HMER (HMER is special
 		 * writing to it *ands* bits
@@ -409,6 +439,136 @@ int xscom_write(uint32_t partid, uint64_t pcb_addr, uint64_t val)
 }
 opal_call(OPAL_XSCOM_WRITE, xscom_write, 3);
 
+/*
+ * One access of a batch. For processor chips this is called with the
+ * XSCOM lock held, Centaurs do their own locking.
+ */
+static int xscom_batch_access(uint32_t partid, uint32_t gcid,
+			      uint64_t pcb_addr, uint64_t *val, bool is_write)
+{
+	switch(partid >> 28) {
+	case 8: /* Centaur */
+		if (is_write)
+			return centaur_xscom_write(partid, pcb_addr, *val);
+		return centaur_xscom_read(partid, pcb_addr, val);
+	case 4: /* EX chiplet */
+		xscom_decode_chiplet(partid, &pcb_addr);
+		break;
+	}
+
+	/* Direct vs indirect access */
+	if (pcb_addr & XSCOM_ADDR_IND_FLAG) {
+		if (is_write)
+			return xscom_indirect_write(gcid, pcb_addr, *val);
+		return xscom_indirect_read(gcid, pcb_addr, val);
+	}
+	if (is_write)
+		return __xscom_write(gcid, pcb_addr & 0x7fffffff, *val);
+	return __xscom_read(gcid, pcb_addr & 0x7fffffff, val);
+}
+
+static int xscom_batch_op(uint32_t partid, uint32_t gcid,
+			  struct xscom_op *op, bool locked,
+			  unsigned long *lock_tb)
+{
+	uint64_t val;
+	uint32_t tries;
+	int rc;
+
+	switch(op->type) {
+	case XSCOM_OP_READ:
+		return xscom_batch_access(partid, gcid, op->addr, &op->data,
+					  false);
+	case XSCOM_OP_WRITE:
+		return xscom_batch_access(partid, gcid, op->addr, &op->data,
+					  true);
+	case XSCOM_OP_RMW:
+		rc = xscom_batch_access(partid, gcid, op->addr, &val, false);
+		if (rc)
+			return rc;
+		val = (val & ~op->mask) | (op->data & op->mask);
+		return xscom_batch_access(partid, gcid, op->addr, &val, true);
+	case XSCOM_OP_POLL:
+		for (tries = 0; tries < op->tries; tries++) {
+			rc = xscom_batch_access(partid, gcid, op->addr,
+						&op->data, false);
+			if (rc)
+				return rc;
+			if ((op->data & op->mask) == op->match)
+				return 0;
+			if (!op->delay)
+				continue;
+
+			/* Don't hold everybody else off while waiting */
+			if (locked)
+				unlock(&xscom_lock);
+			time_wait_nopoll(op->delay);
+			if (locked) {
+				lock(&xscom_lock);
+				*lock_tb = mftb();
+			}
+		}
+		return OPAL_BUSY;
+	}
+
+	return OPAL_PARAMETER;
+}
+
+int xscom_batch(uint32_t partid, struct xscom_op *ops, unsigned int count)
+{
+	unsigned long lock_tb = 0;
+	uint32_t gcid = 0;
+	unsigned int i;
+	bool locked;
+	int rc = 0;
+
+	/* Handle part ID decoding, Centaurs are locked by centaur.c */
+	switch(partid >> 28) {
+	case 0: /* Normal processor chip */
+		gcid = partid;
+		break;
+	case 8: /* Centaur */
+		break;
+	case 4: /* EX chiplet */
+		gcid = (partid & 0x0fffffff) >> 4;
+		break;
+	default:
+		return OPAL_PARAMETER;
+	}
+	locked = (partid >> 28) != 8;
+
+	/* HW822317 requires us to do global locking */
+	if (locked) {
+		lock(&xscom_lock);
+		lock_tb = mftb();
+	}
+
+	for (i = 0; i < count; i++) {
+		if (rc) {
+			ops[i].rc = OPAL_WRONG_STATE;
+			continue;
+		}
+
+		/* Bound the lock hold time */
+		if (locked && tb_compare(mftb(), lock_tb +
+				usecs_to_tb(XSCOM_BATCH_MAX_HOLD_US)) ==
+				TB_AAFTERB) {
+			unlock(&xscom_lock);
+			lock(&xscom_lock);
+			lock_tb = mftb();
+		}
+
+		ops[i].rc = xscom_batch_op(partid, gcid, &ops[i], locked,
+					   &lock_tb);
+		rc = ops[i].rc;
+	}
+
+	if (locked)
+		unlock(&xscom_lock);
+
+	return rc;
+}
+
 int xscom_readme(uint64_t pcb_addr, uint64_t *val)
 {
 	return xscom_read(this_cpu()->chip_id, pcb_addr, val);
@@ -540,3 +700,32 @@ bool xscom_ok(void)
 {
 	return !lock_held_by_me(&xscom_lock);
 }
+
+/* Print how many SCOMs each chip has seen, total and recently */
+void xscom_dump_stats(void)
+{
+	struct proc_chip *chip;
+	uint64_t count, now;
+	uint32_t rate;
+
+	for_each_chip(chip) {
+		lock(&xscom_lock);
+		count = chip->xscom_count;
+		now = mftb();
+
+		/*
+		 * The rate is only updated by the next SCOM after a full
+		 * second, none since then means none in the last second.
+		 */
+		if (now - chip->xscom_rate_tb < secs_to_tb(1))
+			rate = chip->xscom_rate;
+		else if (now - chip->xscom_rate_tb < secs_to_tb(2))
+			rate = count - chip->xscom_rate_count;
+		else
+			rate = 0;
+		unlock(&xscom_lock);
+
+		printf("XSCOM: chip 0x%x: %llu SCOMs, %u in the last second\n",
+		       chip->id, count, rate);
+	}
+}
@@ -0,0 +1,40 @@
+/* Copyright 2016 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __BOOT_PROFILE_H
+#define __BOOT_PROFILE_H
+
+#include <stdint.h>
+#include <boot_profile_types.h>
+
+#define BOOT_PROF_MAX_MARKS	512
+
+/*
+ * Record the start of a boot phase on the current CPU. Phases nest:
+ * one started while another is open on the same CPU becomes its child.
+ * Returns a handle for boot_prof_end(), negative if the table is full
+ * or already exported, which boot_prof_end() quietly ignores.
+ */
+extern int boot_prof_begin(const char *name, uint32_t arg);
+extern void boot_prof_end(int mark);
+
+/* Timebases are in sync from now on (called after chiptod_init) */
+extern void boot_prof_tb_synced(void);
+
+/* Freeze the table and add it to the device-tree under /ibm,opal */
+extern void boot_prof_add_dt(void);
+
+#endif /* __BOOT_PROFILE_H */
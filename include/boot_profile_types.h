@@ -0,0 +1,42 @@
+/* Copyright 2016 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/* Layout of the boot profile exported in the device-tree. */
+#ifndef __BOOT_PROFILE_TYPES_H
+#define __BOOT_PROFILE_TYPES_H
+
+#include <types.h>
+
+#define BOOT_PROF_NAME_LEN	24
+#define BOOT_PROF_NO_PARENT	0xffff
+
+/* Started before the timebases were synchronized by chiptod */
+#define BOOT_PROF_PRESYNC	0x0001
+/* Still running when the profile was exported, end is meaningless */
+#define BOOT_PROF_OPEN		0x0002
+
+struct boot_prof_rec {
+	__be64	start;			/* Timebase */
+	__be64	end;
+	__be32	pir;			/* CPU that ran it */
+	__be32	arg;			/* Chip, PHB, resource... */
+	__be16	depth;			/* Nesting level on that CPU */
+	__be16	parent;			/* Index of enclosing record */
+	__be16	flags;
+	__be16	reserved;
+	char	name[BOOT_PROF_NAME_LEN];
+};
+
+#endif /* __BOOT_PROFILE_TYPES_H */
@@ -131,6 +131,10 @@ struct proc_chip {
 
 	/* Used by hw/xscom.c */
 	uint64_t		xscom_base;
+	uint64_t		xscom_count;	/* SCOMs issued to the chip */
+	uint64_t		xscom_rate_count;
+	uint64_t		xscom_rate_tb;
+	uint32_t		xscom_rate;	/* SCOMs in the last second */
 
 	/* Used by hw/lpc.c */
 	uint32_t		lpc_xbase;
@@ -39,6 +39,9 @@
 /* Enable lock debugging */
 #define DEBUG_LOCKS		1
 
+/* Enable per-lock contention statistics */
+//#define LOCK_STATS		1
+
 /* Enable malloc debugging */
 #define DEBUG_MALLOC		1
 
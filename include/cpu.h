@@ -41,6 +41,7 @@ enum cpu_thread_state {
 };
 
 struct cpu_job;
+struct malloc_cache;
 
 struct cpu_thread {
 	uint32_t			pir;
@@ -52,6 +53,7 @@ struct cpu_thread {
 	enum cpu_thread_state		state;
 	struct dt_node			*node;
 	struct trace_info		*trace;
+	struct malloc_cache		*malloc_cache;
 	uint64_t			save_r1;
 	void				*icp_regs;
 	uint32_t			lock_depth;
@@ -72,6 +74,8 @@ struct cpu_thread {
 #endif
 	struct lock			job_lock;
 	struct list_head		job_queue;
+	bool				job_idle;
+	bool				job_kick;
 	/*
 	 * Per-core mask tracking for threads in HMI handler and
 	 * a cleanup done bit.
@@ -234,6 +238,8 @@ extern void cpu_free_job(struct cpu_job *job);
 
 /* Called by init to process jobs */
 extern void cpu_process_jobs(void);
+/* Called by idle secondaries, returns when there may be jobs to process */
+extern void cpu_idle_job_wait(void);
 /* Fallback to running jobs synchronously for global jobs */
 extern void cpu_process_local_jobs(void);
 
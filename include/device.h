@@ -45,6 +45,8 @@ struct dt_node {
 	struct list_head children;
 	struct dt_node *parent;
 	u32 phandle;
+	/* Next node in the same phandle hash bucket */
+	struct dt_node *phandle_next;
 };
 
 /* This is shared with device_tree.c .. make it static when
@@ -0,0 +1,76 @@
+/* Copyright 2016 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __INIT_TASKS_H
+#define __INIT_TASKS_H
+
+#include <stdint.h>
+
+struct proc_chip;
+struct init_chip_job;
+
+#define INIT_TASK_MAX_DEPS	6
+
+/*
+ * A boot step and what it depends on.
+ *
+ * A task either has a global function, which is run once on the boot
+ * CPU, or a chip function, which is run for every chip on a thread of
+ * that chip, all chips concurrently. Global tasks are run one at a time
+ * so they can keep touching the device-tree and other unlocked state,
+ * chip functions must only use per-chip or locked state.
+ *
+ * Dependencies are the names of other tasks of the same table, which
+ * must appear before the task depending on them.
+ *
+ * Use the INIT_TASK() and INIT_CHIP_TASK() initializers, the other
+ * fields belong to the scheduler.
+ */
+struct init_task {
+	const char		*name;
+	void			(*fn)(void);
+	void			(*chip_fn)(struct proc_chip *chip);
+	const char		*deps[INIT_TASK_MAX_DEPS + 1];
+
+	unsigned int		dep_idx[INIT_TASK_MAX_DEPS];
+	unsigned int		ndeps;
+	enum {
+		INIT_TASK_WAITING,
+		INIT_TASK_RUNNING,
+		INIT_TASK_DONE,
+	}			state;
+	struct init_chip_job	*jobs;
+	unsigned int		njobs;
+	uint64_t		start_tb;
+	uint64_t		end_tb;
+};
+
+#define INIT_TASK(_name, _fn, ...) \
+	{ .name = _name, .fn = _fn, .deps = { __VA_ARGS__ } }
+#define INIT_CHIP_TASK(_name, _fn, ...) \
+	{ .name = _name, .chip_fn = _fn, .deps = { __VA_ARGS__ } }
+
+/*
+ * Run a table of tasks to completion, starting each as soon as its
+ * dependencies are done. Chip tasks are dispatched to the secondary
+ * threads, so this wants to be called after cpu_bringup().
+ */
+extern void init_tasks_run(struct init_task *tasks, unsigned int count);
+
+/* Log the graph, and how long each task took if it was run */
+extern void init_tasks_dump(struct init_task *tasks, unsigned int count);
+
+#endif /* __INIT_TASKS_H */
@@ -116,6 +116,7 @@
 #define IPMI_GET_MESSAGE_FLAGS		IPMI_CODE(IPMI_NETFN_APP, 0x31)
 #define IPMI_GET_MESSAGE		IPMI_CODE(IPMI_NETFN_APP, 0x33)
 #define IPMI_READ_EVENT			IPMI_CODE(IPMI_NETFN_APP, 0x35)
+#define IPMI_GET_BT_CAPS		IPMI_CODE(IPMI_NETFN_APP, 0x36)
 #define IPMI_SET_SENSOR_READING		IPMI_CODE(IPMI_NETFN_SE, 0x30)
 
 /* AMI OEM comamnds. AMI uses NETFN 0x3a and 0x32 */
@@ -144,11 +145,24 @@
 #define IPMI_MAX_RESP_SIZE		60
 
 struct ipmi_backend;
+/*
+ * Queueing priority of a message in the backend, highest first. Set
+ * from the command by ipmi_init_msg(), callers may override it before
+ * queueing.
+ */
+enum ipmi_msg_prio {
+	IPMI_PRIO_HIGH,		/* Watchdog, BMC attention handling */
+	IPMI_PRIO_NORMAL,	/* Host passthrough, sensors, power... */
+	IPMI_PRIO_BULK,		/* SEL and FRU writes */
+	IPMI_PRIO_COUNT,
+};
+
 struct ipmi_msg {
 	/* Can be used by command implementations to track requests */
 	struct list_node link;
 
 	struct ipmi_backend *backend;
+	enum ipmi_msg_prio prio;
 	uint8_t netfn;
 	uint8_t cmd;
 	uint8_t cc;
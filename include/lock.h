@@ -18,6 +18,9 @@
 #define __LOCK_H
 
 #include <stdbool.h>
+#include <stdint.h>
+
+struct lock_stats;
 
 struct lock {
 	/* Lock value has bit 63 as lock bit and the PIR of the owner
@@ -25,15 +28,46 @@ struct lock {
 	 */
 	unsigned long lock_val;
 
+	/*
+	 * Ticket lock: a waiter atomically takes next_ticket and spins
+	 * until now_serving reaches it, which grants the lock in FIFO
+	 * order. The owner then publishes itself in lock_val.
+	 */
+	uint32_t next_ticket;
+	uint32_t now_serving;
+
 	/*
 	 * Set to true if lock is involved in the console flush path
 	 * in which case taking it will suspend console flushing
 	 */
 	bool in_con_path;
+
+#ifdef LOCK_STATS
+	/* Contention statistics, assigned on first acquisition */
+	struct lock_stats *stats;
+#endif
 };
 
 /* Initializer */
-#define LOCK_UNLOCKED	{ .lock_val = 0, .in_con_path = 0 }
+#define LOCK_UNLOCKED	{ .lock_val = 0, .next_ticket = 0, \
+			  .now_serving = 0, .in_con_path = 0 }
+
+/*
+ * Per-lock contention statistics (LOCK_STATS). The table is exported
+ * through the "ibm,opal-lock-stats" property of the /ibm,opal node as
+ * <address-hi address-lo entries entry-size> and updated live, so it
+ * can be read from the OS at any time. The last entry aggregates the
+ * locks that did not get an entry of their own (lock == 0).
+ */
+struct lock_stats {
+	uint64_t	lock;		/* Address of the lock */
+	uint64_t	caller;		/* First site to acquire it */
+	uint64_t	acquisitions;
+	uint64_t	contended;	/* Acquisitions that had to wait */
+	uint64_t	spins;		/* Total wait loop iterations */
+	uint64_t	max_hold;	/* Longest hold, in timebase ticks */
+	uint64_t	acquired_tb;	/* Timebase of the last acquisition */
+};
 
 /* Note vs. libc and locking:
  *
@@ -64,6 +98,7 @@ static inline void init_lock(struct lock *l)
 }
 
 extern bool __try_lock(struct lock *l);
+extern uint32_t __take_ticket(uint32_t *ticket);
 extern bool try_lock(struct lock *l);
 extern void lock(struct lock *l);
 extern void unlock(struct lock *l);
@@ -80,5 +115,6 @@ extern bool lock_recursive(struct lock *l);
 
 /* Called after per-cpu data structures are available */
 extern void init_locks(void);
+extern void lock_add_dt_props(void);
 
 #endif /* __LOCK_H */
@@ -97,6 +97,9 @@ extern int64_t lpc_write(enum OpalLPCAddressType addr_type, uint32_t addr,
 extern int64_t lpc_read(enum OpalLPCAddressType addr_type, uint32_t addr,
 			uint32_t *data, uint32_t sz);
 
+/* Bulk FW space read, data is stored in LPC address order */
+extern int64_t lpc_fw_read_block(uint32_t addr, void *buf, uint32_t len);
+
 /* Mark LPC bus as used by console */
 extern void lpc_used_by_console(void);
 
@@ -40,4 +40,8 @@ void *__local_alloc(unsigned int chip, size_t size, size_t align,
 #define local_alloc(chip_id, size, align)	\
 	__local_alloc((chip_id), (size), (align), __location__)
 
+/* Per-CPU caches for small allocations, see core/malloc.c */
+void init_malloc_caches(void);
+void malloc_dump_cache_stats(void);
+
 #endif /* __MEM_REGION_MALLOC_H */
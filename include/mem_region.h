@@ -38,6 +38,9 @@ enum mem_region_type {
 	REGION_OS,
 };
 
+/* Free blocks are kept in size-class bins, one bit per bin in free_bins */
+#define MEM_REGION_FREE_BINS	(sizeof(unsigned long) * 8)
+
 /* An area of physical memory. */
 struct mem_region {
 	struct list_node list;
@@ -45,7 +48,8 @@ struct mem_region {
 	uint64_t start, len;
 	struct dt_node *node;
 	enum mem_region_type type;
-	struct list_head free_list;
+	struct list_head free_list[MEM_REGION_FREE_BINS];
+	unsigned long free_bins;
 	struct lock free_list_lock;
 };
 
@@ -59,6 +63,9 @@ void mem_free(struct mem_region *region, void *mem,
 bool mem_resize(struct mem_region *region, void *mem, size_t len,
 		const char *location);
 size_t mem_allocated_size(const void *ptr);
+void mem_set_location(void *ptr, const char *location);
+void mem_check_free(struct mem_region *region, const void *ptr, bool cached,
+		    const char *location);
 bool mem_check(const struct mem_region *region);
 void mem_region_release_unused(void);
 
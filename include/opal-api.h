@@ -161,7 +161,8 @@
 #define OPAL_PRD_MSG				113
 #define OPAL_LEDS_GET_INDICATOR			114
 #define OPAL_LEDS_SET_INDICATOR			115
-#define OPAL_LAST				115
+#define OPAL_MSG_RING_CONTROL			116
+#define OPAL_LAST				116
 
 /* Device tree flags */
 
@@ -428,6 +429,28 @@ struct opal_msg {
 	__be64 params[8];
 };
 
+/*
+ * Shared memory message ring, found through the "ibm,opal-msg-ring"
+ * property of the ibm,opal node as <address-hi address-lo entries>.
+ *
+ * OPAL produces at head and the host consumes at tail. Both are free
+ * running counters and the slot is the counter modulo entries. OPAL
+ * only uses the ring once the host took it with OPAL_MSG_RING_CONTROL,
+ * then fills it whenever it has room and nothing is queued for
+ * OPAL_GET_MSG. The host should drain the ring and then call
+ * OPAL_GET_MSG until it gets OPAL_RESOURCE. Async completions delivered
+ * through the ring are not seen by OPAL_CHECK_ASYNC_COMPLETION.
+ */
+struct opal_msg_ring {
+	__be32 entries;
+	__be32 enabled;		/* Written by OPAL */
+	__be32 head;		/* Written by OPAL */
+	uint8_t pad0[116];
+	__be32 tail;		/* Written by the host */
+	uint8_t pad1[124];
+	struct opal_msg msgs[];
+};
+
 /* System parameter permission */
 enum OpalSysparamPerm {
 	OPAL_SYSPARAM_READ  = 0x1,
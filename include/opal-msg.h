@@ -38,4 +38,7 @@ int _opal_queue_msg(enum opal_msg_type msg_type, void *data,
 
 void opal_init_msg(void);
 
+/* Take the ring back from the OS, for a new one that may not know it */
+void opal_msg_ring_reset(void);
+
 #endif /* __OPALMSG_H */
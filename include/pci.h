@@ -441,6 +441,12 @@ struct phb {
 	/* Base location code used to generate the children one */
 	const char		*base_loc_code;
 
+	/* BDFN to device index for pci_find_dev(), one table of 256
+	 * devfns per bus number, allocated as devices show up
+	 */
+	struct pci_device	**dev_map[256];
+	bool			dev_map_incomplete;
+
 	/* Additional data the platform might need to attach */
 	void			*platform_data;
 };
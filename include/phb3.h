@@ -226,6 +226,7 @@ enum phb3_state {
 	PHB3_STATE_WAIT_LINK_ELECTRICAL,
 	PHB3_STATE_WAIT_LINK,
 };
+#define PHB3_STATE_COUNT	(PHB3_STATE_WAIT_LINK + 1)
 
 /*
  * PHB3 error descriptor. Errors from all components (PBCQ, PHB)
@@ -293,6 +294,8 @@ struct phb3 {
 	bool			skip_perst; /* Skip first perst */
 	bool			has_link;
 	enum phb3_state		state;
+	uint64_t		state_tb;   /* Entered current state */
+	uint64_t		state_time[PHB3_STATE_COUNT];
 	uint64_t		delay_tgt_tb;
 	uint64_t		retries;
 	int64_t			ecap;	    /* cached PCI-E cap offset */
@@ -307,6 +310,16 @@ struct phb3 {
 	uint64_t		tve_cache[512];
 	uint64_t		m32d_cache[256];
 	uint64_t		m64b_cache[16];
+
+	/* Entries whose cached value may not be in HW yet, flushed
+	 * by phb3_ioda_reset(). Only meaningful once ioda_hw_valid
+	 * says a full load happened since the last PHB reset.
+	 */
+	uint64_t		tve_dirty[512 / 64];
+	uint64_t		m32d_dirty[256 / 64];
+	uint64_t		m64b_dirty[1];
+	uint64_t		peltv_dirty[PHB3_MAX_PE_NUM / 64];
+	bool			ioda_hw_valid;
 	uint64_t		nfir_cache;	/* Used by complete reset */
 	bool			err_pending;
 	struct phb3_err		err;
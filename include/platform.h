@@ -126,6 +126,15 @@ struct platform {
 	 */
 	uint32_t	(*occ_timeout)(void);
 
+	/*
+	 * DTS sampling. How often the core temperature sensors are read
+	 * in the background, and how old a sample can be and still
+	 * answer a sensor read. In milliseconds, 0 picks the defaults:
+	 * every second, and twice that.
+	 */
+	uint32_t	dts_sample_ms;
+	uint32_t	dts_max_age_ms;
+
 	int		(*elog_commit)(struct errorlog *buf);
 
 	/*
@@ -214,6 +214,8 @@ extern void phb3_preload_vpd(void);
 extern void uart_init(bool enable_interrupt);
 extern void homer_init(void);
 extern void occ_pstates_init(void);
+struct proc_chip;
+extern void slw_init_chip(struct proc_chip *chip);
 extern void slw_init(void);
 extern void occ_fsp_init(void);
 extern void lpc_rtc_init(void);
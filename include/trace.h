@@ -29,8 +29,10 @@ struct cpu_thread;
 void init_boot_tracebuf(struct cpu_thread *boot_cpu);
 
 struct trace_info {
-	/* Lock for writers. */
+	/* Lock for writers, only taken if the buffer is shared. */
 	struct lock lock;
+	/* More than one thread writes to this buffer. */
+	bool shared;
 	/* Exposed to kernel. */
 	struct tracebuf tb;
 };
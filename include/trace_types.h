@@ -63,7 +63,11 @@ struct trace_repeat {
 	__be16 cpu;
 	__be16 prev_len;
 	__be16 num; /* Starts at 1, ie. 1 repeat, or two traces. */
-	/* Note that the count can be one short, if read races a repeat. */
+	/*
+	 * Note that the count can be one short, if read races a repeat.
+	 * The writer stores timestamp before num, so a reader that loads
+	 * num first never sees a timestamp older than its count.
+	 */
 };
 
 /* Overflow is special */
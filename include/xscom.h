@@ -165,6 +165,39 @@
 extern int xscom_read(uint32_t partid, uint64_t pcb_addr, uint64_t *val);
 extern int xscom_write(uint32_t partid, uint64_t pcb_addr, uint64_t val);
 
+/*
+ * Batched SCOM access
+ *
+ * The ops are run in order on one target with the XSCOM lock taken
+ * once for the batch, rather than once per SCOM. The lock is dropped
+ * and retaken when it has been held for too long, and while a poll
+ * op waits between reads.
+ *
+ * Each op's rc is set. The batch stops at the first failing op, and
+ * the ones after it are left with OPAL_WRONG_STATE. xscom_batch()
+ * returns the rc of the failing op, or 0.
+ */
+enum xscom_op_type {
+	XSCOM_OP_READ,		/* data = value read */
+	XSCOM_OP_WRITE,		/* write data */
+	XSCOM_OP_RMW,		/* replace the mask bits with those of data */
+	XSCOM_OP_POLL,		/* read until (value & mask) == match */
+};
+
+struct xscom_op {
+	enum xscom_op_type	type;
+	uint64_t		addr;
+	uint64_t		data;
+	uint64_t		mask;	/* RMW and POLL */
+	uint64_t		match;	/* POLL */
+	uint32_t		tries;	/* POLL: reads before OPAL_BUSY */
+	uint32_t		delay;	/* POLL: timebase ticks between reads */
+	int			rc;
+};
+
+extern int xscom_batch(uint32_t partid, struct xscom_op *ops,
+		       unsigned int count);
+
 /* This chip SCOM access */
 extern int xscom_readme(uint64_t pcb_addr, uint64_t *val);
 extern int xscom_writeme(uint64_t pcb_addr, uint64_t val);
@@ -180,4 +213,7 @@ extern bool xscom_ok(void);
 
 extern int64_t xscom_read_cfam_chipid(uint32_t partid, uint32_t *chip_id);
 
+/* Print the per-chip SCOM counts and rates */
+extern void xscom_dump_stats(void);
+
 #endif /* __XSCOM_H */
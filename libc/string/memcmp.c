@@ -11,6 +11,7 @@
  *****************************************************************************/
 
 #include "string.h"
+#include "wordops.h"
 
 
 int
@@ -18,6 +19,31 @@ memcmp(const void *ptr1, const void *ptr2, size_t n)
 {
 	const unsigned char *p1 = ptr1;
 	const unsigned char *p2 = ptr2;
+	const word_t *w1, *w2;
+
+	/*
+	 * Skip over identical words when both buffers are aligned the
+	 * same way, the bytes of the first differing one are then
+	 * compared below to get the sign right on either endianness.
+	 */
+	if (n >= 2 * WORD_SIZE && word_offset(p1) == word_offset(p2)) {
+		while (word_offset(p1)) {
+			if (*p1 != *p2)
+				return (*p1 - *p2);
+			p1 += 1;
+			p2 += 1;
+			n--;
+		}
+		w1 = (const word_t *)p1;
+		w2 = (const word_t *)p2;
+		while (n >= WORD_SIZE && *w1 == *w2) {
+			w1++;
+			w2++;
+			n -= WORD_SIZE;
+		}
+		p1 = (const unsigned char *)w1;
+		p2 = (const unsigned char *)w2;
+	}
 
 	while (n-- > 0) {
 		if (*p1 != *p2)
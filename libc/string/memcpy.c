@@ -11,14 +11,61 @@
  *****************************************************************************/
 
 #include "string.h"
+#include "wordops.h"
 
 void *
 memcpy(void *dest, const void *src, size_t n)
 {
-	char *cdest;
-	const char *csrc = src;
+	unsigned char *cdest = dest;
+	const unsigned char *csrc = src;
+	word_t *wdest;
+	const word_t *wsrc;
+	word_t lo, hi;
+	size_t shift;
 
-	cdest = dest;
+	/* Not worth setting up the word copy for short ones */
+	if (n < 2 * WORD_SIZE)
+		goto tail;
+
+	/* Align the destination, stores are what must not straddle */
+	while (word_offset(cdest)) {
+		*cdest++ = *csrc++;
+		n--;
+	}
+	wdest = (word_t *)cdest;
+
+	shift = word_offset(csrc);
+	if (!shift) {
+		wsrc = (const word_t *)csrc;
+		while (n >= 4 * WORD_SIZE) {
+			wdest[0] = wsrc[0];
+			wdest[1] = wsrc[1];
+			wdest[2] = wsrc[2];
+			wdest[3] = wsrc[3];
+			wdest += 4;
+			wsrc += 4;
+			n -= 4 * WORD_SIZE;
+		}
+		while (n >= WORD_SIZE) {
+			*wdest++ = *wsrc++;
+			n -= WORD_SIZE;
+		}
+		csrc = (const unsigned char *)wsrc;
+	} else {
+		/* Source is misaligned, stitch each word out of two */
+		wsrc = (const word_t *)(csrc - shift);
+		lo = *wsrc++;
+		while (n >= WORD_SIZE) {
+			hi = *wsrc++;
+			*wdest++ = word_merge(lo, hi, shift);
+			lo = hi;
+			n -= WORD_SIZE;
+		}
+		csrc = (const unsigned char *)wsrc - WORD_SIZE + shift;
+	}
+	cdest = (unsigned char *)wdest;
+
+ tail:
 	while (n-- > 0) {
 		*cdest++ = *csrc++;
 	}
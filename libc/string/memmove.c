@@ -11,31 +11,47 @@
  *****************************************************************************/
 
 #include "string.h"
+#include "wordops.h"
 
 
 void *
 memmove(void *dest, const void *src, size_t n)
 {
-	char *cdest;
-	const char *csrc;
-	int i;
-
-	/* Do the buffers overlap in a bad way? */
-	if (src < dest && src + n >= dest) {
-		/* Copy from end to start */
-		cdest = dest + n - 1;
-		csrc = src + n - 1;
-		for (i = 0; i < n; i++) {
-			*cdest-- = *csrc--;
+	unsigned char *cdest;
+	const unsigned char *csrc;
+	word_t *wdest;
+	const word_t *wsrc;
+
+	/*
+	 * Unless the destination starts inside the source, memcpy()
+	 * copies strictly forward, which never overwrites source bytes
+	 * it still has to read.
+	 */
+	if (!(src < dest && src + n > dest))
+		return memcpy(dest, src, n);
+
+	/* Copy from end to start */
+	cdest = dest + n;
+	csrc = src + n;
+
+	/* Word copy when both ends line up the same way */
+	if (n >= 2 * WORD_SIZE && word_offset(cdest) == word_offset(csrc)) {
+		while (word_offset(cdest)) {
+			*--cdest = *--csrc;
+			n--;
 		}
-	}
-	else {
-		/* Normal copy is possible */
-		cdest = dest;
-		csrc = src;
-		for (i = 0; i < n; i++) {
-			*cdest++ = *csrc++;
+		wdest = (word_t *)cdest;
+		wsrc = (const word_t *)csrc;
+		while (n >= WORD_SIZE) {
+			*--wdest = *--wsrc;
+			n -= WORD_SIZE;
 		}
+		cdest = (unsigned char *)wdest;
+		csrc = (const unsigned char *)wsrc;
+	}
+
+	while (n-- > 0) {
+		*--cdest = *--csrc;
 	}
 
 	return dest;
@@ -11,6 +11,7 @@
  *****************************************************************************/
 
 #include "string.h"
+#include "wordops.h"
 
 #define CACHE_LINE_SIZE 128
 
@@ -18,6 +19,7 @@ void *
 memset(void *dest, int c, size_t size)
 {
 	unsigned char *d = (unsigned char *)dest;
+	word_t pattern = word_repeat(c);
 
 #if defined(__powerpc__) || defined(__powerpc64__)
 	if (size > CACHE_LINE_SIZE && c==0) {
@@ -33,10 +35,24 @@ memset(void *dest, int c, size_t size)
 	}
 #endif
 
-	while (size >= 8 && c == 0) {
-		*((unsigned long long*)d) = 0ULL;
-		d+=8;
-		size-=8;
+	if (size >= 2 * WORD_SIZE) {
+		while (word_offset(d)) {
+			*d++ = (unsigned char)c;
+			size--;
+		}
+		while (size >= 4 * WORD_SIZE) {
+			((word_t *)d)[0] = pattern;
+			((word_t *)d)[1] = pattern;
+			((word_t *)d)[2] = pattern;
+			((word_t *)d)[3] = pattern;
+			d += 4 * WORD_SIZE;
+			size -= 4 * WORD_SIZE;
+		}
+		while (size >= WORD_SIZE) {
+			*((word_t *)d) = pattern;
+			d += WORD_SIZE;
+			size -= WORD_SIZE;
+		}
 	}
 
 	while (size-- > 0) {
@@ -11,11 +11,36 @@
  *****************************************************************************/
 
 #include <string.h>
+#include "wordops.h"
 
 
 int
 strcmp(const char *s1, const char *s2)
 {
+	const word_t *w1, *w2;
+
+	/*
+	 * With both strings aligned the same way, skip whole words
+	 * that match and hold no terminator, the bytes loop below then
+	 * finds where they differ or end.
+	 */
+	if (word_offset(s1) == word_offset(s2)) {
+		while (word_offset(s1)) {
+			if (*s1 == 0 || *s1 != *s2)
+				return *s1 - *s2;
+			s1 += 1;
+			s2 += 1;
+		}
+		w1 = (const word_t *)s1;
+		w2 = (const word_t *)s2;
+		while (*w1 == *w2 && !word_has_zero(*w1)) {
+			w1++;
+			w2++;
+		}
+		s1 = (const char *)w1;
+		s2 = (const char *)w2;
+	}
+
 	while (*s1 != 0 && *s2 != 0) {
 		if (*s1 != *s2)
 			break;
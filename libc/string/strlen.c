@@ -11,17 +11,29 @@
  *****************************************************************************/
 
 #include <string.h>
+#include "wordops.h"
 
 size_t
 strlen(const char *s)
 {
-	int len = 0;
+	const char *start = s;
+	const word_t *w;
 
-	while (*s != 0) {
-		len += 1;
+	while (word_offset(s)) {
+		if (*s == 0)
+			return s - start;
 		s += 1;
 	}
 
-	return len;
+	/* Aligned loads can't run off the end of the page */
+	w = (const word_t *)s;
+	while (!word_has_zero(*w))
+		w++;
+
+	s = (const char *)w;
+	while (*s != 0)
+		s += 1;
+
+	return s - start;
 }
 
@@ -0,0 +1,63 @@
+/******************************************************************************
+ * Copyright (c) 2016 IBM Corporation
+ * All rights reserved.
+ * This program and the accompanying materials
+ * are made available under the terms of the BSD License
+ * which accompanies this distribution, and is available at
+ * http://www.opensource.org/licenses/bsd-license.php
+ *
+ * Contributors:
+ *     IBM Corporation - initial implementation
+ *****************************************************************************/
+
+/*
+ * Helpers for the word at a time string and memory functions.
+ *
+ * Loads are only ever done on naturally aligned words, so reading a
+ * whole word to get at some of its bytes can't cross into a page the
+ * caller doesn't own.
+ */
+
+#ifndef _WORDOPS_H
+#define _WORDOPS_H
+
+#include <stddef.h>
+
+typedef unsigned long __attribute__((__may_alias__)) word_t;
+
+#define WORD_SIZE	sizeof(word_t)
+#define WORD_MASK	(WORD_SIZE - 1)
+#define WORD_ONES	((word_t)-1 / 0xff)
+#define WORD_HIGHS	(WORD_ONES * 0x80)
+
+static inline size_t word_offset(const void *p)
+{
+	return (unsigned long)p & WORD_MASK;
+}
+
+/* Non-zero if any byte of @w is zero */
+static inline word_t word_has_zero(word_t w)
+{
+	return (w - WORD_ONES) & ~w & WORD_HIGHS;
+}
+
+/* @c in every byte of a word */
+static inline word_t word_repeat(unsigned char c)
+{
+	return WORD_ONES * c;
+}
+
+/*
+ * Build the word that starts @shift bytes (1 to WORD_SIZE - 1) into
+ * the aligned word @lo and carries on into the next one, @hi.
+ */
+static inline word_t word_merge(word_t lo, word_t hi, size_t shift)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	return (lo << (shift * 8)) | (hi >> ((WORD_SIZE - shift) * 8));
+#else
+	return (lo >> (shift * 8)) | (hi << ((WORD_SIZE - shift) * 8));
+#endif
+}
+
+#endif /* _WORDOPS_H */
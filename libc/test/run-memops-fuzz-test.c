@@ -0,0 +1,38 @@
+/* Copyright 2016 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * This file is built against the skiboot libc. The functions are
+ * renamed so that the other half of the test can hold them up
+ * against the system libc ones.
+ */
+
+#include <config.h>
+#include <stdarg.h>
+
+#define memcpy	skiboot_memcpy
+#define memmove	skiboot_memmove
+#define memcmp	skiboot_memcmp
+#define memset	skiboot_memset
+#define strlen	skiboot_strlen
+#define strcmp	skiboot_strcmp
+
+#include "../string/memcmp.c"
+#include "../string/memcpy.c"
+#include "../string/memmove.c"
+#include "../string/memset.c"
+#include "../string/strcmp.c"
+#include "../string/strlen.c"
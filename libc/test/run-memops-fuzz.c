@@ -0,0 +1,324 @@
+/* Copyright 2016 IBM Corp.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+ * implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Fuzz the word at a time skiboot string and memory functions against
+ * the system libc, over random lengths, alignments and overlaps.
+ *
+ * Run with "bench" as argument to get throughput numbers for them, for
+ * the byte loops they replaced and for the system libc.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+void *skiboot_memcpy(void *dest, const void *src, size_t n);
+void *skiboot_memmove(void *dest, const void *src, size_t n);
+int skiboot_memcmp(const void *ptr1, const void *ptr2, size_t n);
+void *skiboot_memset(void *dest, int c, size_t size);
+size_t skiboot_strlen(const char *s);
+int skiboot_strcmp(const char *s1, const char *s2);
+
+#define FUZZ_LOOPS	20000
+#define BUF_SIZE	8192
+#define MAX_OFF		16
+
+static unsigned char buf_a[BUF_SIZE + 2 * MAX_OFF];
+static unsigned char buf_b[BUF_SIZE + 2 * MAX_OFF];
+static unsigned char buf_c[BUF_SIZE + 2 * MAX_OFF];
+
+static unsigned long seed = 0x5eed;
+
+static unsigned long rnd(unsigned long max)
+{
+	/* xorshift, reproducible on any host */
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return max ? seed % max : 0;
+}
+
+/* Mostly short lengths, which is what skiboot does, some long ones */
+static size_t rnd_len(void)
+{
+	if (rnd(8) == 0)
+		return rnd(BUF_SIZE);
+	return rnd(300);
+}
+
+/*
+ * Strings are kept to 1..127 so the result doesn't depend on the
+ * signedness of char, which differs between the host and the firmware.
+ */
+static void fill(unsigned char *buf, size_t len, bool text)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = text ? 1 + rnd(127) : rnd(256);
+}
+
+static int sign(int v)
+{
+	return (v > 0) - (v < 0);
+}
+
+static void fuzz_memcpy(void)
+{
+	size_t len = rnd_len(), so = rnd(MAX_OFF), doff = rnd(MAX_OFF);
+
+	fill(buf_a, sizeof(buf_a), false);
+	fill(buf_b, sizeof(buf_b), false);
+	memcpy(buf_c, buf_b, sizeof(buf_c));
+
+	assert(skiboot_memcpy(buf_b + doff, buf_a + so, len) == buf_b + doff);
+	memcpy(buf_c + doff, buf_a + so, len);
+	assert(memcmp(buf_b, buf_c, sizeof(buf_b)) == 0);
+}
+
+static void fuzz_memmove(void)
+{
+	size_t len = rnd_len(), so = rnd(BUF_SIZE - len + 1),
+		doff = rnd(BUF_SIZE - len + 1);
+
+	fill(buf_a, sizeof(buf_a), false);
+	memcpy(buf_c, buf_a, sizeof(buf_c));
+
+	/* Bias towards overlapping copies, in both directions */
+	if (rnd(2) && len) {
+		doff = so + rnd(2 * MAX_OFF) - MAX_OFF;
+		if (doff > BUF_SIZE - len)
+			doff = so;
+	}
+
+	assert(skiboot_memmove(buf_a + doff, buf_a + so, len) == buf_a + doff);
+	memmove(buf_c + doff, buf_c + so, len);
+	assert(memcmp(buf_a, buf_c, sizeof(buf_a)) == 0);
+}
+
+static void fuzz_memset(void)
+{
+	size_t len = rnd_len(), off = rnd(MAX_OFF);
+	int c = rnd(4) ? (int)rnd(256) : 0;
+
+	fill(buf_a, sizeof(buf_a), false);
+	memcpy(buf_c, buf_a, sizeof(buf_c));
+
+	assert(skiboot_memset(buf_a + off, c, len) == buf_a + off);
+	memset(buf_c + off, c, len);
+	assert(memcmp(buf_a, buf_c, sizeof(buf_a)) == 0);
+}
+
+static void fuzz_memcmp(void)
+{
+	size_t len = rnd_len(), o1 = rnd(MAX_OFF), o2 = rnd(MAX_OFF);
+
+	fill(buf_a, sizeof(buf_a), false);
+	memcpy(buf_b + o2, buf_a + o1, len);
+
+	/* Sometimes equal, otherwise differing somewhere */
+	if (len && rnd(4))
+		buf_b[o2 + rnd(len)] ^= 1 + rnd(255);
+
+	assert(sign(skiboot_memcmp(buf_a + o1, buf_b + o2, len)) ==
+	       sign(memcmp(buf_a + o1, buf_b + o2, len)));
+}
+
+static void fuzz_strlen(void)
+{
+	size_t len = rnd_len(), off = rnd(MAX_OFF);
+
+	fill(buf_a, sizeof(buf_a), true);
+	buf_a[off + len] = 0;
+
+	assert(skiboot_strlen((char *)buf_a + off) == len);
+}
+
+static void fuzz_strcmp(void)
+{
+	size_t len = rnd_len(), o1 = rnd(MAX_OFF), o2 = rnd(MAX_OFF);
+	char *s1 = (char *)buf_a + o1, *s2 = (char *)buf_b + o2;
+
+	fill(buf_a, sizeof(buf_a), true);
+	fill(buf_b, sizeof(buf_b), true);
+	memcpy(s2, s1, len);
+	s1[len] = 0;
+	s2[len] = 0;
+
+	switch (rnd(4)) {
+	case 0:
+		break;
+	case 1:
+		/* Shorter second string */
+		if (len)
+			s2[rnd(len)] = 0;
+		break;
+	default:
+		if (len)
+			s2[rnd(len)] = 1 + rnd(127);
+	}
+
+	assert(sign(skiboot_strcmp(s1, s2)) == sign(strcmp(s1, s2)));
+	assert(sign(skiboot_strcmp(s2, s1)) == sign(strcmp(s2, s1)));
+}
+
+/* What the firmware had before, for the benchmark */
+static void *byte_memcpy(void *dest, const void *src, size_t n)
+{
+	char *cdest = dest;
+	const char *csrc = src;
+
+	while (n-- > 0)
+		*cdest++ = *csrc++;
+	return dest;
+}
+
+static void *byte_memset(void *dest, int c, size_t n)
+{
+	unsigned char *d = dest;
+
+	while (n-- > 0)
+		*d++ = c;
+	return dest;
+}
+
+static int byte_memcmp(const void *ptr1, const void *ptr2, size_t n)
+{
+	const unsigned char *p1 = ptr1, *p2 = ptr2;
+
+	for (; n; n--, p1++, p2++)
+		if (*p1 != *p2)
+			return *p1 - *p2;
+	return 0;
+}
+
+static size_t byte_strlen(const char *s)
+{
+	size_t len = 0;
+
+	while (s[len])
+		len++;
+	return len;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+enum bench_op { B_MEMCPY, B_MEMSET, B_MEMCMP, B_STRLEN };
+
+static void bench_one(const char *name, enum bench_op op, size_t len)
+{
+	static const char *impl[] = { "byte loop", "skiboot", "system" };
+	unsigned long loops = (64ul << 20) / (len + 16), i;
+	volatile size_t sink = 0;
+	double t;
+	int which;
+
+	memset(buf_a, 0x5a, sizeof(buf_a));
+	memset(buf_b, 0x5a, sizeof(buf_b));
+	buf_a[len] = 0;
+
+	printf("%-8s %5zu bytes:", name, len);
+	for (which = 0; which < 3; which++) {
+		t = now();
+		for (i = 0; i < loops; i++) {
+			switch (op) {
+			case B_MEMCPY:
+				if (which == 0)
+					byte_memcpy(buf_b, buf_a, len);
+				else if (which == 1)
+					skiboot_memcpy(buf_b, buf_a, len);
+				else
+					memcpy(buf_b, buf_a, len);
+				break;
+			case B_MEMSET:
+				if (which == 0)
+					byte_memset(buf_b, 0x42, len);
+				else if (which == 1)
+					skiboot_memset(buf_b, 0x42, len);
+				else
+					memset(buf_b, 0x42, len);
+				break;
+			case B_MEMCMP:
+				if (which == 0)
+					sink += byte_memcmp(buf_c, buf_c + 8, len);
+				else if (which == 1)
+					sink += skiboot_memcmp(buf_c, buf_c + 8, len);
+				else
+					sink += memcmp(buf_c, buf_c + 8, len);
+				break;
+			case B_STRLEN:
+				if (which == 0)
+					sink += byte_strlen((char *)buf_a);
+				else if (which == 1)
+					sink += skiboot_strlen((char *)buf_a);
+				else
+					sink += strlen((char *)buf_a);
+				break;
+			}
+		}
+		t = now() - t;
+		printf("  %s %7.0f MB/s", impl[which],
+		       loops * (double)len / t / (1 << 20));
+	}
+	printf("\n");
+}
+
+static void bench(void)
+{
+	static const size_t sizes[] = { 16, 64, 256, 4096 };
+	unsigned int i;
+
+	/* Equal halves for memcmp to run all the way */
+	memset(buf_c, 0x33, sizeof(buf_c));
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		bench_one("memcpy", B_MEMCPY, sizes[i]);
+		bench_one("memset", B_MEMSET, sizes[i]);
+		bench_one("memcmp", B_MEMCMP, sizes[i]);
+		bench_one("strlen", B_STRLEN, sizes[i]);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int i;
+
+	if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+		bench();
+		return 0;
+	}
+
+	for (i = 0; i < FUZZ_LOOPS; i++) {
+		fuzz_memcpy();
+		fuzz_memmove();
+		fuzz_memset();
+		fuzz_memcmp();
+		fuzz_strlen();
+		fuzz_strcmp();
+	}
+
+	return 0;
+}
@@ -51,17 +51,59 @@ enum eccbitfields
  *  Note: To make the math easier (and less shifts in resulting code),
  *        row0 = ECC7.  HW numbering is MSB, order here is LSB.
  *
- *  These values come from the HW design of the ECC algorithm.
+ *  These values come from the HW design of the ECC algorithm:
+ *
+ *        0x0000e8423c0f99ff
+ *        0x00e8423c0f99ff00
+ *        0xe8423c0f99ff0000
+ *        0x423c0f99ff0000e8
+ *        0x3c0f99ff0000e842
+ *        0x0f99ff0000e8423c
+ *        0x99ff0000e8423c0f
+ *        0xff0000e8423c0f99
+ *
+ *  The ECC is linear, so it is the XOR of the contribution of each
+ *  data byte. Each row is the previous one rotated left by one byte,
+ *  which makes the contribution of the byte at position n (from the
+ *  LSB) that of the same value at position 0, rotated left by n bits.
+ *
+ *  This table holds the contribution of each byte value at position 0,
+ *  so generating the ECC takes a lookup per byte rather than a parity
+ *  computation per ECC bit.
  */
-static uint64_t eccmatrix[] = {
-        0x0000e8423c0f99ffull,
-        0x00e8423c0f99ff00ull,
-        0xe8423c0f99ff0000ull,
-        0x423c0f99ff0000e8ull,
-        0x3c0f99ff0000e842ull,
-        0x0f99ff0000e8423cull,
-        0x99ff0000e8423c0full,
-        0xff0000e8423c0f99ull
+static const uint8_t eccbytetable[256] = {
+	0x00, 0xc1, 0x51, 0x90, 0x61, 0xa0, 0x30, 0xf1,
+	0xe9, 0x28, 0xb8, 0x79, 0x88, 0x49, 0xd9, 0x18,
+	0xa1, 0x60, 0xf0, 0x31, 0xc0, 0x01, 0x91, 0x50,
+	0x48, 0x89, 0x19, 0xd8, 0x29, 0xe8, 0x78, 0xb9,
+	0x29, 0xe8, 0x78, 0xb9, 0x48, 0x89, 0x19, 0xd8,
+	0xc0, 0x01, 0x91, 0x50, 0xa1, 0x60, 0xf0, 0x31,
+	0x88, 0x49, 0xd9, 0x18, 0xe9, 0x28, 0xb8, 0x79,
+	0x61, 0xa0, 0x30, 0xf1, 0x00, 0xc1, 0x51, 0x90,
+	0x19, 0xd8, 0x48, 0x89, 0x78, 0xb9, 0x29, 0xe8,
+	0xf0, 0x31, 0xa1, 0x60, 0x91, 0x50, 0xc0, 0x01,
+	0xb8, 0x79, 0xe9, 0x28, 0xd9, 0x18, 0x88, 0x49,
+	0x51, 0x90, 0x00, 0xc1, 0x30, 0xf1, 0x61, 0xa0,
+	0x30, 0xf1, 0x61, 0xa0, 0x51, 0x90, 0x00, 0xc1,
+	0xd9, 0x18, 0x88, 0x49, 0xb8, 0x79, 0xe9, 0x28,
+	0x91, 0x50, 0xc0, 0x01, 0xf0, 0x31, 0xa1, 0x60,
+	0x78, 0xb9, 0x29, 0xe8, 0x19, 0xd8, 0x48, 0x89,
+	0x89, 0x48, 0xd8, 0x19, 0xe8, 0x29, 0xb9, 0x78,
+	0x60, 0xa1, 0x31, 0xf0, 0x01, 0xc0, 0x50, 0x91,
+	0x28, 0xe9, 0x79, 0xb8, 0x49, 0x88, 0x18, 0xd9,
+	0xc1, 0x00, 0x90, 0x51, 0xa0, 0x61, 0xf1, 0x30,
+	0xa0, 0x61, 0xf1, 0x30, 0xc1, 0x00, 0x90, 0x51,
+	0x49, 0x88, 0x18, 0xd9, 0x28, 0xe9, 0x79, 0xb8,
+	0x01, 0xc0, 0x50, 0x91, 0x60, 0xa1, 0x31, 0xf0,
+	0xe8, 0x29, 0xb9, 0x78, 0x89, 0x48, 0xd8, 0x19,
+	0x90, 0x51, 0xc1, 0x00, 0xf1, 0x30, 0xa0, 0x61,
+	0x79, 0xb8, 0x28, 0xe9, 0x18, 0xd9, 0x49, 0x88,
+	0x31, 0xf0, 0x60, 0xa1, 0x50, 0x91, 0x01, 0xc0,
+	0xd8, 0x19, 0x89, 0x48, 0xb9, 0x78, 0xe8, 0x29,
+	0xb9, 0x78, 0xe8, 0x29, 0xd8, 0x19, 0x89, 0x48,
+	0x50, 0x91, 0x01, 0xc0, 0x31, 0xf0, 0x60, 0xa1,
+	0x18, 0xd9, 0x49, 0x88, 0x79, 0xb8, 0x28, 0xe9,
+	0xf1, 0x30, 0xa0, 0x61, 0x90, 0x51, 0xc1, 0x00,
 };
 
 /**
@@ -114,13 +156,16 @@ static enum eccbitfields syndromematrix[] = {
  *  @data:	The 8 byte data to generate ECC for.
  *  @return:	The 1 byte ECC corresponding to the data.
  */
-static uint8_t eccgenerate(uint64_t data)
+static inline uint8_t eccgenerate(uint64_t data)
 {
+	uint8_t result = eccbytetable[data & 0xff];
+	uint8_t byte;
 	int i;
-	uint8_t result = 0;
 
-	for (i = 0; i < 8; i++)
-		result |= __builtin_parityl(eccmatrix[i] & data) << i;
+	for (i = 1; i < 8; i++) {
+		byte = eccbytetable[(data >> (8 * i)) & 0xff];
+		result ^= (byte << i) | (byte >> (8 - i));
+	}
 
 	return result;
 }
@@ -151,6 +196,34 @@ static inline uint64_t eccflipbit(uint64_t data, uint8_t bit)
 	return data ^ (1ul << (63 - bit));
 }
 
+/* Number of words checked at once before looking at errors */
+#define ECC_BLOCK_WORDS	8
+
+/*
+ * Copy one word, correcting it if needed.
+ *
+ * @return: 0 on success, UE on an uncorrectable error
+ */
+static int eccword_copy(uint64_t *dst, const struct ecc64 *src)
+{
+	beint64_t data = src->data;
+	uint8_t ecc = src->ecc;
+	uint8_t badbit;
+
+	badbit = eccverify(be64_to_cpu(data), ecc);
+	if (badbit == UE) {
+		FL_ERR("ECC: uncorrectable error: %016lx %02x\n",
+			(long unsigned int)be64_to_cpu(data), ecc);
+		return badbit;
+	}
+	*dst = data;
+	if (badbit <= UE)
+		FL_INF("ECC: correctable error: %i\n", badbit);
+	if (badbit < 64)
+		*dst = (uint64_t)be64_to_cpu(eccflipbit(be64_to_cpu(data), badbit));
+	return 0;
+}
+
 /**
  * Copy data from an input buffer with ECC to an output buffer without ECC.
  * Correct it along the way and check for errors.
@@ -168,9 +241,9 @@ static inline uint64_t eccflipbit(uint64_t data, uint8_t bit)
 int memcpy_from_ecc(uint64_t *dst, struct ecc64 *src, uint32_t len)
 {
 	beint64_t data;
-	uint8_t ecc;
-	uint32_t i;
-	uint8_t badbit;
+	uint8_t syndromes;
+	uint32_t i, j;
+	int rc;
 
 	if (len & 0x7) {
 		/* TODO: we could probably handle this */
@@ -182,22 +255,29 @@ int memcpy_from_ecc(uint64_t *dst, struct ecc64 *src, uint32_t len)
 	/* Handle in chunks of 8 bytes, so adjust the length */
 	len >>= 3;
 
-	for (i = 0; i < len; i++) {
-		data = (src + i)->data;
-		ecc = (src + i)->ecc;
-
-		badbit = eccverify(be64_to_cpu(data), ecc);
-		if (badbit == UE) {
-			FL_ERR("ECC: uncorrectable error: %016lx %02x\n",
-				(long unsigned int)be64_to_cpu(data), ecc);
-			return badbit;
+	for (i = 0; i < len; i += j) {
+		/*
+		 * Errors are rare, so copy a block of words and only look
+		 * at the syndromes once. If any word is bad, go over the
+		 * block again a word at a time.
+		 */
+		if (len - i >= ECC_BLOCK_WORDS) {
+			syndromes = 0;
+			for (j = 0; j < ECC_BLOCK_WORDS; j++) {
+				data = src[i + j].data;
+				syndromes |= eccgenerate(be64_to_cpu(data)) ^
+					src[i + j].ecc;
+				dst[i + j] = data;
+			}
+			if (!syndromes)
+				continue;
+		}
+
+		for (j = 0; j < ECC_BLOCK_WORDS && i + j < len; j++) {
+			rc = eccword_copy(&dst[i + j], &src[i + j]);
+			if (rc)
+				return rc;
 		}
-		*dst = data;
-		if (badbit <= UE)
-			FL_INF("ECC: correctable error: %i\n", badbit);
-		if (badbit < 64)
-			*dst = (uint64_t)be64_to_cpu(eccflipbit(be64_to_cpu(data), badbit));
-		dst++;
 	}
 	return 0;
 }
@@ -17,6 +17,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <time.h>
 
 #include <libflash/ecc.h>
 
@@ -364,6 +365,110 @@ struct ecc64 ecc_data[] = {
 
 };
 
+/* The HW ECC matrix, which eccgenerate() must be equivalent to */
+static const uint64_t ref_eccmatrix[] = {
+	0x0000e8423c0f99ffull,
+	0x00e8423c0f99ff00ull,
+	0xe8423c0f99ff0000ull,
+	0x423c0f99ff0000e8ull,
+	0x3c0f99ff0000e842ull,
+	0x0f99ff0000e8423cull,
+	0x99ff0000e8423c0full,
+	0xff0000e8423c0f99ull
+};
+
+static uint8_t ref_eccgenerate(uint64_t data)
+{
+	uint8_t result = 0;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		result |= __builtin_parityl(ref_eccmatrix[i] & data) << i;
+
+	return result;
+}
+
+static void check_eccgenerate(void)
+{
+	uint64_t data;
+	int i, v;
+
+	/* Every byte value at every byte position */
+	for (i = 0; i < 8; i++) {
+		for (v = 0; v < 256; v++) {
+			data = (uint64_t)v << (8 * i);
+			if (eccgenerate(data) != ref_eccgenerate(data)) {
+				ERR("eccgenerate() wrong for 0x%016lx\n", data);
+				exit(1);
+			}
+		}
+	}
+
+	/* And a bunch of random words */
+	srandom(1);
+	for (i = 0; i < 100000; i++) {
+		data = ((uint64_t)random() << 33) ^ ((uint64_t)random() << 11) ^
+			random();
+		if (eccgenerate(data) != ref_eccgenerate(data)) {
+			ERR("eccgenerate() wrong for 0x%016lx\n", data);
+			exit(1);
+		}
+	}
+}
+
+static double now_secs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#define BENCH_SIZE	(4 * 1024 * 1024)
+#define BENCH_LOOPS	8
+
+static void bench_ecc(void)
+{
+	struct ecc64 *ecc_buf;
+	uint64_t *buf;
+	double start, secs;
+	int i;
+
+	buf = malloc(BENCH_SIZE);
+	ecc_buf = malloc(ecc_buffer_size(BENCH_SIZE));
+	if (!buf || !ecc_buf) {
+		ERR("malloc failed during ecc benchmark\n");
+		exit(1);
+	}
+	for (i = 0; i < BENCH_SIZE / 8; i++)
+		buf[i] = (uint64_t)i * 0x9e3779b97f4a7c15ull;
+	/* Fault the pages in so they aren't part of the measurement */
+	memset(ecc_buf, 0, ecc_buffer_size(BENCH_SIZE));
+
+	start = now_secs();
+	for (i = 0; i < BENCH_LOOPS; i++)
+		memcpy_to_ecc(ecc_buf, buf, BENCH_SIZE);
+	secs = now_secs() - start;
+	printf("memcpy_to_ecc %u MB in %.3f secs: %.1f MB/sec\n",
+	       BENCH_LOOPS * BENCH_SIZE >> 20, secs,
+	       (BENCH_LOOPS * BENCH_SIZE >> 20) / secs);
+
+	start = now_secs();
+	for (i = 0; i < BENCH_LOOPS; i++) {
+		if (memcpy_from_ecc(buf, ecc_buf, BENCH_SIZE)) {
+			ERR("memcpy_from_ecc failed during ecc benchmark\n");
+			exit(1);
+		}
+	}
+	secs = now_secs() - start;
+	printf("memcpy_from_ecc %u MB in %.3f secs: %.1f MB/sec\n",
+	       BENCH_LOOPS * BENCH_SIZE >> 20, secs,
+	       (BENCH_LOOPS * BENCH_SIZE >> 20) / secs);
+
+	free(buf);
+	free(ecc_buf);
+}
+
 int main(void)
 {
 	int i;
@@ -378,6 +483,7 @@ int main(void)
 	 * have intentional bitflips
 	 */
 	printf("Checking eccgenerate()\n");
+	check_eccgenerate();
 	for (i = 64; i < NUM_ECC_ROWS; i++) {
 		if (eccgenerate(be64toh(ecc_data[i].data)) != ecc_data[i].ecc) {
 			ERR("ECC did not generate the correct value, expecting 0x%02x, got 0x%02x\n",
@@ -483,8 +589,31 @@ int main(void)
 		ERR("memcpy_from_ecc didn't detect bad size 15\n");
 		exit(1);
 	}
+
+	/* A correctable and then an uncorrectable error in a clean block */
+	memcpy_to_ecc(ret_buf, buf, NUM_ECC_ROWS * sizeof(*buf));
+	ret_buf[101].data ^= 0x10;
+	memset(buf, 0, NUM_ECC_ROWS * sizeof(*buf));
+	if (memcpy_from_ecc(buf, ret_buf, NUM_ECC_ROWS * sizeof(*buf))) {
+		ERR("memcpy_from_ecc didn't correct a bit in a block\n");
+		exit(1);
+	}
+	for (i = 0; i < NUM_ECC_ROWS; i++) {
+		if (buf[i] != (i < 64 ? 0xffffffffffffffff : ecc_data[i].data)) {
+			ERR("memcpy_from_ecc got uint64_t %d wrong after correcting a block\n",
+					i);
+			exit(1);
+		}
+	}
+	ret_buf[101].data ^= 0x01;
+	if (memcpy_from_ecc(buf, ret_buf, NUM_ECC_ROWS * sizeof(*buf)) != UE) {
+		ERR("memcpy_from_ecc didn't detect a UE in a block\n");
+		exit(1);
+	}
 	printf("ECC error conditions pass\n");
 
+	bench_ecc();
+
 	free(buf);
 	free(ret_buf);
 	return 0;